@@ -0,0 +1,177 @@
+// AI opponents. An Ai_Level picks a row of ai_levels, the knobs one controller
+// is tuned with; add a level by adding a row. ai_ddp is the paddle acceleration
+// for one match, ai_batch_ddp for every match of a Match_Batch, four lanes at a
+// time with the same operations in the same order, so a bot plays the same in
+// a batch as in the game.
+// AI_CLASSIC is the old ai_player_1_ddp: chase the ball's height. The predicting
+// levels aim where the ball will cross the paddle instead, worked out in one
+// go: the straight line there is folded back into the arena, which is where the
+// top and bottom walls would have reflected it. They go back to the middle
+// while the ball heads the other way. The error is a fixed miss for the length
+// of a rally, taken from the ball's speed and the score so replays don't change.
+
+enum Ai_Level {
+	AI_CLASSIC, // Zero, so a zeroed Game_State plays as it did before there were levels
+	AI_EASY,
+	AI_MEDIUM,
+	AI_HARD,
+
+	AI_LEVEL_COUNT,
+};
+
+struct Ai_Params {
+	const char* name;
+	bool predict; // Aim at the intercept instead of the ball's height
+	float gain; // ddp per unit between the paddle and the aim
+	float damping; // ddp per unit of paddle speed, against overshooting
+	float max_ddp;
+	float error; // Misses the aim by up to this many paddle half heights
+};
+
+global_variable Ai_Params ai_levels[AI_LEVEL_COUNT] = {
+	{"classic", false, 100, 0, 1300, 0},
+	{"easy", false, 60, 0, 1000, .75f},
+	{"medium", true, 100, 4, 1500, .6f},
+	{"hard", true, 200, 8, 2000, 0},
+};
+
+// -1 for a name that isn't a level.
+internal int
+find_ai_level(const char* name) {
+	for (int i = 0; i < AI_LEVEL_COUNT; i++) {
+		if (!strcmp(ai_levels[i].name, name)) return i;
+	}
+	return -1;
+}
+
+// Only for |a| < 2^31, which the callers clamp to.
+internal float
+ai_floor(float a) {
+	float t = (float)(int)a;
+	return t > a ? t - 1.f : t;
+}
+
+internal float
+ai_lane_ddp(const Ai_Params* params, int player, float paddle_p, float paddle_dp,
+	float ball_p_x, float ball_p_y, float ball_dp_x, float ball_dp_y, int score_1, int score_2) {
+	float aim = ball_p_y;
+	if (params->predict) {
+		// Distance and speed towards the paddle's face, positive when coming at it
+		float face_x = 80 - (player_half_size_x + ball_half_size);
+		float gap = player == 1 ? face_x - ball_p_x : ball_p_x + face_x;
+		float toward = player == 1 ? ball_dp_x : -ball_dp_x;
+		bool approaching = toward > 0 && gap >= 0;
+		float t = gap / (approaching ? toward : 1.f);
+
+		// The line unfolded repeats every 4 * reach: up to the top wall, down
+		// through the arena to the bottom one and back.
+		float reach = arena_half_size_y - ball_half_size;
+		float y = ball_p_y + ball_dp_y * t;
+		y = y > 1e6f ? 1e6f : y;
+		y = y < -1e6f ? -1e6f : y;
+		float u = y + reach;
+		u = u - ai_floor(u * (1.f / (4.f * reach))) * (4.f * reach);
+		float folded = u < 2.f * reach ? u - reach : 3.f * reach - u;
+		aim = approaching ? folded : 0.f;
+	}
+	if (params->error) {
+		float h = fabsf(ball_dp_y) * .1031f + (float)score_1 * .618034f + (float)score_2 * .381966f;
+		h = h - ai_floor(h);
+		aim = aim + (h * 2.f - 1.f) * (params->error * player_half_size_y);
+	}
+
+	float ddp = (aim - paddle_p) * params->gain;
+	if (params->damping) ddp = ddp - paddle_dp * params->damping;
+	ddp = ddp > params->max_ddp ? params->max_ddp : ddp;
+	ddp = ddp < -params->max_ddp ? -params->max_ddp : ddp;
+	return ddp;
+}
+
+internal float
+ai_ddp(Match* m, int player, Ai_Level level) {
+	float paddle_p = player == 1 ? m->player_1_p : m->player_2_p;
+	float paddle_dp = player == 1 ? m->player_1_dp : m->player_2_dp;
+	return ai_lane_ddp(&ai_levels[level], player, paddle_p, paddle_dp,
+		m->ball_p_x, m->ball_p_y, m->ball_dp_x, m->ball_dp_y, m->player_1_score, m->player_2_score);
+}
+
+#if MATCH_BATCH_SSE2
+
+inline __m128
+ai_floor_4(__m128 a) {
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.f)));
+}
+
+// ai_lane_ddp for matches [i, i + 4).
+inline void
+ai_ddp_4(Match_Batch* b, int i, const Ai_Params* params, int player, float* ddp_lanes) {
+	__m128 paddle_p = _mm_loadu_ps((player == 1 ? b->player_1_p : b->player_2_p) + i);
+	__m128 ball_p_y = _mm_loadu_ps(b->ball_p_y + i);
+	__m128 ball_dp_y = _mm_loadu_ps(b->ball_dp_y + i);
+
+	__m128 aim = ball_p_y;
+	if (params->predict) {
+		__m128 zero = _mm_setzero_ps();
+		__m128 ball_p_x = _mm_loadu_ps(b->ball_p_x + i);
+		__m128 ball_dp_x = _mm_loadu_ps(b->ball_dp_x + i);
+		__m128 face_x = _mm_set1_ps(80 - (player_half_size_x + ball_half_size));
+		__m128 gap = player == 1 ? _mm_sub_ps(face_x, ball_p_x) : _mm_add_ps(ball_p_x, face_x);
+		__m128 toward = player == 1 ? ball_dp_x : _mm_sub_ps(zero, ball_dp_x);
+		__m128 approaching = _mm_and_ps(_mm_cmpgt_ps(toward, zero), _mm_cmpge_ps(gap, zero));
+		__m128 t = _mm_div_ps(gap, select_ps(approaching, toward, _mm_set1_ps(1.f)));
+
+		float reach = arena_half_size_y - ball_half_size;
+		__m128 y = _mm_add_ps(ball_p_y, _mm_mul_ps(ball_dp_y, t));
+		y = select_ps(_mm_cmpgt_ps(y, _mm_set1_ps(1e6f)), _mm_set1_ps(1e6f), y);
+		y = select_ps(_mm_cmplt_ps(y, _mm_set1_ps(-1e6f)), _mm_set1_ps(-1e6f), y);
+		__m128 u = _mm_add_ps(y, _mm_set1_ps(reach));
+		u = _mm_sub_ps(u, _mm_mul_ps(ai_floor_4(_mm_mul_ps(u, _mm_set1_ps(1.f / (4.f * reach)))), _mm_set1_ps(4.f * reach)));
+		__m128 folded = select_ps(_mm_cmplt_ps(u, _mm_set1_ps(2.f * reach)),
+			_mm_sub_ps(u, _mm_set1_ps(reach)), _mm_sub_ps(_mm_set1_ps(3.f * reach), u));
+		aim = _mm_and_ps(approaching, folded);
+	}
+	if (params->error) {
+		__m128 score_1 = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i*)(b->player_1_score + i)));
+		__m128 score_2 = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i*)(b->player_2_score + i)));
+		__m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_ps(ball_dp_y), _mm_set1_ps(.1031f)),
+			_mm_mul_ps(score_1, _mm_set1_ps(.618034f))), _mm_mul_ps(score_2, _mm_set1_ps(.381966f)));
+		h = _mm_sub_ps(h, ai_floor_4(h));
+		__m128 miss = _mm_sub_ps(_mm_mul_ps(h, _mm_set1_ps(2.f)), _mm_set1_ps(1.f));
+		aim = _mm_add_ps(aim, _mm_mul_ps(miss, _mm_set1_ps(params->error * player_half_size_y)));
+	}
+
+	__m128 ddp = _mm_mul_ps(_mm_sub_ps(aim, paddle_p), _mm_set1_ps(params->gain));
+	if (params->damping) {
+		__m128 paddle_dp = _mm_loadu_ps((player == 1 ? b->player_1_dp : b->player_2_dp) + i);
+		ddp = _mm_sub_ps(ddp, _mm_mul_ps(paddle_dp, _mm_set1_ps(params->damping)));
+	}
+	__m128 max_ddp = _mm_set1_ps(params->max_ddp);
+	__m128 min_ddp = _mm_set1_ps(-params->max_ddp);
+	ddp = select_ps(_mm_cmpgt_ps(ddp, max_ddp), max_ddp, ddp);
+	ddp = select_ps(_mm_cmplt_ps(ddp, min_ddp), min_ddp, ddp);
+	_mm_storeu_ps(ddp_lanes, ddp);
+}
+
+#endif
+
+// ai_lane_ddp for every match of the batch, into ddp[0, batch->count). Takes
+// any params, for tuning them; ai_batch_ddp is the same for a level.
+internal void
+ai_batch_params_ddp(Match_Batch* batch, int player, const Ai_Params* params, float* ddp) {
+	int i = 0;
+#if MATCH_BATCH_SSE2
+	for (; i + 4 <= batch->count; i += 4) ai_ddp_4(batch, i, params, player, ddp + i);
+#endif
+	for (; i < batch->count; i++) {
+		float paddle_p = player == 1 ? batch->player_1_p[i] : batch->player_2_p[i];
+		float paddle_dp = player == 1 ? batch->player_1_dp[i] : batch->player_2_dp[i];
+		ddp[i] = ai_lane_ddp(params, player, paddle_p, paddle_dp, batch->ball_p_x[i], batch->ball_p_y[i],
+			batch->ball_dp_x[i], batch->ball_dp_y[i], batch->player_1_score[i], batch->player_2_score[i]);
+	}
+}
+
+internal void
+ai_batch_ddp(Match_Batch* batch, int player, Ai_Level level, float* ddp) {
+	ai_batch_params_ddp(batch, player, &ai_levels[level], ddp);
+}
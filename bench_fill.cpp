@@ -0,0 +1,83 @@
+// Microbenchmark for the span fill kernels: clear_screen and draw_rect_in_pixels
+// at 4K for every kernel the CPU supports. Build as its own console program:
+//   cl /O2 bench_fill.cpp        or        g++ -O2 bench_fill.cpp -o bench_fill
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "platform_common.cpp"
+#include "profiler.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "pixel_kernels.cpp"
+#include "renderer.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+
+internal double
+seconds_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs for at least min_seconds and returns written GB/s.
+template <typename F> internal double
+measure(F&& f, double bytes_per_call, double min_seconds = .25) {
+	f();
+	int calls = 0;
+	double begin = seconds_now(), end;
+	do {
+		for (int i = 0; i < 8; i++) f();
+		calls += 8;
+		end = seconds_now();
+	} while (end - begin < min_seconds);
+	return bytes_per_call * calls / (end - begin) / 1e9;
+}
+
+int main() {
+	render_state.width = 3840;
+	render_state.height = 2160;
+	render_state.pitch = render_state.width;
+
+	// Page aligned like the VirtualAlloc'd framebuffer.
+	size_t size = (size_t)render_state.width * render_state.height * sizeof(u32);
+	void* block = malloc(size + 4096);
+	render_state.memory = (void*)(((size_t)block + 4095) & ~(size_t)4095);
+
+	Span_Fill_Kernel* best = init_span_fill();
+	printf("framebuffer %dx%d, startup kernel: %s\n\n", render_state.width, render_state.height, best->name);
+
+	int widths[] = { 4, 16, 64, 256, 1024, 3840 };
+	int rect_height = 256;
+
+	printf("%-8s %10s", "kernel", "clear");
+	for (int w : widths) printf("   rect %4d", w);
+	printf("     (GB/s)\n");
+
+	for (int k = 0; k < SPAN_FILL_KERNEL_COUNT; k++) {
+		Span_Fill_Kernel* kernel = &span_fill_kernels[k];
+		if (!kernel->supported) continue;
+		use_span_fill_kernel(kernel);
+
+		double clear = measure([] { clear_screen(0xffaa33); }, (double)size);
+		printf("%-8s %10.2f", kernel->name, clear);
+
+		for (int w : widths) {
+			// Odd x0 so every row starts unaligned.
+			int x0 = w < render_state.width ? 3 : 0;
+			double gbs = measure([=] { draw_rect_in_pixels(x0, 100, x0 + w, 100 + rect_height, 0xff0000); },
+				(double)w * rect_height * sizeof(u32));
+			printf("   %9.2f", gbs);
+		}
+		printf("\n");
+	}
+
+	use_span_fill_kernel(best);
+	free(block);
+	return 0;
+}
@@ -0,0 +1,153 @@
+// Google Benchmark suite for the hot paths: clear_screen and
+// draw_rect_in_pixels at 4K (like bench_fill.cpp, with the kernel the startup
+// picked), draw_text and draw_number through the command buffer, one gameplay
+// frame of render_game, and the simulation's simulate_player and ball step.
+// Draws skip dirty tracking, so only the push and the rasterize are timed.
+// Built by CMake as pong_bench when Google Benchmark is installed; by hand:
+//   g++ -O2 -pthread bench_suite.cpp -o pong_bench -lbenchmark
+// Usage: pong_bench [--benchmark_filter=REGEX] and the rest of Google Benchmark's flags
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// benchmark.h has a namespace called internal, so the benchmarks are
+// registered in main instead of with its macros
+#pragma push_macro("internal")
+#undef internal
+#include <benchmark/benchmark.h>
+#pragma pop_macro("internal")
+
+#include "platform_common.cpp"
+#include "profiler.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "frame_buffers.cpp"
+#include "pixel_kernels.cpp"
+#include "renderer.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+#include "profiler_overlay.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+#include "effects.cpp"
+#include "gamemovement.cpp"
+
+internal void
+bench_clear_screen(benchmark::State& state) {
+	for (auto _ : state) {
+		clear_screen(0xffaa33);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * (s64)render_state.pitch * render_state.height * sizeof(u32));
+}
+
+// Odd x0 so every row starts unaligned, as in bench_fill.cpp.
+internal void
+bench_draw_rect_in_pixels(benchmark::State& state) {
+	int width = (int)state.range(0);
+	int x0 = width < render_state.width ? 3 : 0;
+	for (auto _ : state) {
+		draw_rect_in_pixels(x0, 100, x0 + width, 356, 0xff0000);
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * (s64)width * 256 * sizeof(u32));
+}
+
+// The menu's longest line, at sizes in hundredths.
+internal void
+bench_draw_text(benchmark::State& state) {
+	float size = state.range(0) / 100.f;
+	for (auto _ : state) {
+		draw_text("WATCH THE STEP BY STEP TUTORIAL ON", -73, 22, size, 0xffffff);
+		render_flush();
+	}
+}
+
+internal void
+bench_draw_number(benchmark::State& state) {
+	int number = (int)state.range(0);
+	for (auto _ : state) {
+		draw_number(number, -10, 40, 1.f, 0xbbffbb);
+		render_flush();
+	}
+}
+
+// A whole frame while the ball is in play, with dirty rects as in the game.
+internal void
+bench_render_game(benchmark::State& state) {
+	Game_State game = {};
+	game.current_gamemode = GM_GAMEPLAY;
+	init_match(&game.match);
+	dirty.suspended--;
+	invalidate_frame();
+	for (auto _ : state) {
+		simulate_match(&game.match, 0, 0, SIM_DT);
+		render_game(&game, .5f);
+	}
+	dirty.suspended++;
+}
+
+internal void
+bench_simulate_player(benchmark::State& state) {
+	float p = 0, dp = 0;
+	int tick = 0;
+	for (auto _ : state) {
+		// Up for a while, then down, so both walls get hit
+		simulate_player(&p, &dp, (tick++ & 256) ? 2000.f : -2000.f, SIM_DT);
+		benchmark::DoNotOptimize(p);
+	}
+}
+
+// simulate_match with the paddles still: nearly all of it is the ball's sweep.
+internal void
+bench_ball_step(benchmark::State& state) {
+	Match match;
+	init_match(&match);
+	match.ball_dp_y = 70;
+	for (auto _ : state) {
+		simulate_match(&match, 0, 0, SIM_DT);
+		benchmark::DoNotOptimize(match.ball_p_x);
+	}
+}
+
+int main(int argc, char** argv) {
+	render_state.width = 3840;
+	render_state.height = 2160;
+	render_state.pitch = render_state.width;
+
+	// Page aligned like the VirtualAlloc'd framebuffer.
+	size_t size = (size_t)render_state.width * render_state.height * sizeof(u32);
+	void* block = malloc(size + 4096);
+	if (!block) return 1;
+	render_state.memory = (void*)(((size_t)block + 4095) & ~(size_t)4095);
+
+	init_profiler();
+	Span_Fill_Kernel* kernel = init_span_fill();
+	rebuild_viewport_transform();
+	rebuild_glyph_atlas();
+	clear_screen(0);
+	dirty.suspended++;
+	benchmark::AddCustomContext("span_fill", kernel->name);
+
+	benchmark::RegisterBenchmark("clear_screen", bench_clear_screen);
+	benchmark::RegisterBenchmark("draw_rect_in_pixels", bench_draw_rect_in_pixels)->Arg(4)->Arg(16)->Arg(64)->Arg(256)->Arg(1024)->Arg(3840);
+	benchmark::RegisterBenchmark("draw_text", bench_draw_text)->Arg(75)->Arg(100)->Arg(200);
+	benchmark::RegisterBenchmark("draw_number", bench_draw_number)->Arg(7)->Arg(1234);
+	benchmark::RegisterBenchmark("render_game", bench_render_game);
+	benchmark::RegisterBenchmark("simulate_player", bench_simulate_player);
+	benchmark::RegisterBenchmark("ball_step", bench_ball_step);
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	free(block);
+	return 0;
+}
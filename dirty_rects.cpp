@@ -0,0 +1,184 @@
+// Dirty rectangle tracking. Every draw outside the background records its pixel
+// bounds. Next frame only those bounds get the background restored (see
+// render_begin_frame), and the platform only blits the union of last frame's
+// and this frame's bounds.
+
+struct Pixel_Rect {
+	int x0, y0, x1, y1;
+};
+
+#define MAX_DIRTY_RECTS 32
+
+struct Dirty_List {
+	Pixel_Rect rects[MAX_DIRTY_RECTS];
+	int count;
+};
+
+struct Dirty_State {
+	Dirty_List previous;
+	Dirty_List current;
+	Dirty_List presented; // Blitted this frame, but not restored next frame
+	Dirty_List blit;
+
+	bool full_redraw;
+	int suspended; // Background draws and grouped draws are not recorded one by one
+	bool grouping;
+	Pixel_Rect group;
+};
+
+global_variable Dirty_State dirty = { {}, {}, {}, {}, true };
+
+internal bool
+rect_is_empty(Pixel_Rect r) {
+	return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+internal Pixel_Rect
+rect_union(Pixel_Rect a, Pixel_Rect b) {
+	Pixel_Rect result;
+	result.x0 = a.x0 < b.x0 ? a.x0 : b.x0;
+	result.y0 = a.y0 < b.y0 ? a.y0 : b.y0;
+	result.x1 = a.x1 > b.x1 ? a.x1 : b.x1;
+	result.y1 = a.y1 > b.y1 ? a.y1 : b.y1;
+	return result;
+}
+
+internal Pixel_Rect
+rect_intersect(Pixel_Rect a, Pixel_Rect b) {
+	Pixel_Rect result;
+	result.x0 = a.x0 > b.x0 ? a.x0 : b.x0;
+	result.y0 = a.y0 > b.y0 ? a.y0 : b.y0;
+	result.x1 = a.x1 < b.x1 ? a.x1 : b.x1;
+	result.y1 = a.y1 < b.y1 ? a.y1 : b.y1;
+	return result;
+}
+
+internal bool
+rects_touch(Pixel_Rect a, Pixel_Rect b) {
+	return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+internal s64
+rect_area(Pixel_Rect r) {
+	return (s64)(r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+internal Pixel_Rect
+screen_rect() {
+	Pixel_Rect result = { 0, 0, render_state.width, render_state.height };
+	return result;
+}
+
+internal Pixel_Rect
+clip_to_screen(Pixel_Rect r) {
+	r.x0 = clamp(0, r.x0, render_state.width);
+	r.x1 = clamp(0, r.x1, render_state.width);
+	r.y0 = clamp(0, r.y0, render_state.height);
+	r.y1 = clamp(0, r.y1, render_state.height);
+	return r;
+}
+
+// Overlapping and touching rects get merged. When the list is full the rect is
+// merged into whichever entry grows the least.
+internal void
+dirty_list_add(Dirty_List* list, Pixel_Rect r) {
+	r = clip_to_screen(r);
+	if (rect_is_empty(r)) return;
+
+	for (;;) {
+		bool merged = false;
+		for (int i = 0; i < list->count; i++) {
+			if (rects_touch(list->rects[i], r)) {
+				r = rect_union(r, list->rects[i]);
+				list->rects[i] = list->rects[--list->count];
+				merged = true;
+				break;
+			}
+		}
+		if (!merged) break;
+	}
+
+	if (list->count == MAX_DIRTY_RECTS) {
+		int best = 0;
+		s64 best_growth = 0;
+		for (int i = 0; i < list->count; i++) {
+			Pixel_Rect u = rect_union(list->rects[i], r);
+			s64 growth = rect_area(u) - rect_area(list->rects[i]);
+			if (i == 0 || growth < best_growth) {
+				best = i;
+				best_growth = growth;
+			}
+		}
+		r = rect_union(list->rects[best], r);
+		list->rects[best] = list->rects[--list->count];
+		dirty_list_add(list, r);
+		return;
+	}
+
+	list->rects[list->count++] = r;
+}
+
+internal void
+dirty_record(int x0, int y0, int x1, int y1) {
+	Pixel_Rect r = { x0, y0, x1, y1 };
+	if (dirty.grouping) {
+		dirty.group = rect_is_empty(dirty.group) ? r : rect_union(dirty.group, r);
+	} else if (!dirty.suspended) {
+		dirty_list_add(&dirty.current, r);
+	}
+}
+
+// draw_text and draw_number record one rect for the whole string instead of one per cell.
+internal void
+dirty_begin_group() {
+	dirty.grouping = true;
+	dirty.group = {};
+}
+
+internal void
+dirty_end_group() {
+	dirty.grouping = false;
+	if (!dirty.suspended && !rect_is_empty(dirty.group)) dirty_list_add(&dirty.current, dirty.group);
+}
+
+// Call when the framebuffer contents can't be trusted anymore (resize, WM_PAINT, ...).
+internal void
+invalidate_frame() {
+	dirty.full_redraw = true;
+}
+
+// For pixels that stay valid on screen after this frame, like the cached score widgets.
+internal void
+dirty_record_present(Pixel_Rect r) {
+	dirty_list_add(&dirty.presented, r);
+}
+
+internal bool
+dirty_previous_touches(Pixel_Rect r) {
+	for (int i = 0; i < dirty.previous.count; i++) {
+		if (!rect_is_empty(rect_intersect(dirty.previous.rects[i], r))) return true;
+	}
+	return false;
+}
+
+internal void
+dirty_begin_frame() {
+	dirty.previous = dirty.current;
+	dirty.current.count = 0;
+	dirty.presented.count = 0;
+}
+
+// Builds the list of rects the platform has to present this frame.
+internal void
+dirty_end_frame() {
+	dirty.blit.count = 0;
+	if (dirty.full_redraw) {
+		dirty_list_add(&dirty.blit, screen_rect());
+		dirty.full_redraw = false;
+		return;
+	}
+
+	for (int i = 0; i < dirty.previous.count; i++) dirty_list_add(&dirty.blit, dirty.previous.rects[i]);
+	for (int i = 0; i < dirty.current.count; i++) dirty_list_add(&dirty.blit, dirty.current.rects[i]);
+	for (int i = 0; i < dirty.presented.count; i++) dirty_list_add(&dirty.blit, dirty.presented.rects[i]);
+}
@@ -0,0 +1,243 @@
+// Hit sparks, ball trails and score flashes. Particles live in one fixed pool
+// of SoA arrays carved out of a single block by init_effects; spawning takes
+// the next free slot and a dead particle is swapped with the last live one, so
+// nothing is allocated after startup and the live ones stay packed. effects_tick
+// runs with every live simulation tick, spawns from the tick's Match_Events and
+// steps every particle, four per SSE2 lane group. draw_effects turns them all
+// into one Rect_Batch, so the command buffer sees a single draw.
+// Effects are only looks: nothing in Game_State depends on them, replays and
+// rollbacks don't record them, and the headless tools never call init_effects.
+
+#include <stdlib.h>
+#include <math.h>
+
+#define MAX_PARTICLES (128 * 1024)
+#define PARTICLE_GRAVITY -60.f // Units per second squared
+#define PARTICLE_DRAG .995f // Of the velocity left after a tick
+
+struct Particles {
+	int count, capacity;
+
+	float* p_x;
+	float* p_y;
+	float* dp_x;
+	float* dp_y;
+	float* life; // Seconds left
+	float* fade; // 1 / the lifetime, life * fade goes from 1 to 0
+	float* half_size;
+	u32* color;
+
+	void* memory;
+};
+
+#define PARTICLE_ARRAYS 8
+
+struct Effects {
+	Particles particles;
+	u32 random; // xorshift32, never 0
+	float flash; // Seconds left of the score flash
+	float flash_x; // Which half of the arena it lights up
+
+	World_Rect* world_rects; // draw_effects' scratch, capacity of them
+	Rect_Batch batch;
+};
+
+global_variable Effects effects;
+
+// Without it every spawn is dropped, which is what the tools that render no
+// frames get.
+internal bool
+init_effects(int capacity) {
+	Particles* p = &effects.particles;
+	size_t stride = ((size_t)capacity * 4 + 63) & ~(size_t)63;
+	u8* memory = (u8*)malloc(stride * PARTICLE_ARRAYS + 63);
+	effects.world_rects = (World_Rect*)malloc((size_t)capacity * sizeof(World_Rect));
+	effects.batch.rects = (Pixel_Rect*)malloc((size_t)capacity * sizeof(Pixel_Rect));
+	effects.batch.colors = (u32*)malloc((size_t)capacity * sizeof(u32));
+	if (!memory || !effects.world_rects || !effects.batch.rects || !effects.batch.colors) return false;
+
+	u8* base = (u8*)(((size_t)memory + 63) & ~(size_t)63);
+	p->memory = memory;
+	p->capacity = capacity;
+	p->count = 0;
+	p->p_x = (float*)(base + stride * 0);
+	p->p_y = (float*)(base + stride * 1);
+	p->dp_x = (float*)(base + stride * 2);
+	p->dp_y = (float*)(base + stride * 3);
+	p->life = (float*)(base + stride * 4);
+	p->fade = (float*)(base + stride * 5);
+	p->half_size = (float*)(base + stride * 6);
+	p->color = (u32*)(base + stride * 7);
+	effects.random = 0x9e3779b9;
+
+	// The cells of a 4K frame and four per particle up front, so the batch
+	// only grows for bigger screens.
+	reserve(&effects.batch.cell_first, &effects.batch.cell_capacity, (3840 / RECT_BATCH_CELL) * (2160 / RECT_BATCH_CELL) + 1);
+	reserve(&effects.batch.entries, &effects.batch.entry_capacity, capacity * 4);
+	return true;
+}
+
+// -1 to 1.
+internal float
+effects_random() {
+	u32 x = effects.random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	effects.random = x;
+	return (float)(s32)x * (1.f / 2147483648.f);
+}
+
+internal void
+spawn_particle(float x, float y, float dp_x, float dp_y, float lifetime, float half_size, u32 color) {
+	Particles* p = &effects.particles;
+	if (p->count == p->capacity) return;
+	int i = p->count++;
+	p->p_x[i] = x;
+	p->p_y[i] = y;
+	p->dp_x[i] = dp_x;
+	p->dp_y[i] = dp_y;
+	p->life[i] = lifetime;
+	p->fade[i] = 1.f / lifetime;
+	p->half_size[i] = half_size;
+	p->color[i] = color;
+}
+
+// Sparks fly off the paddle along the ball's new direction, spread out.
+internal void
+spawn_hit_sparks(Match_Event* e) {
+	float speed = sqrtf(e->dp_x * e->dp_x + e->dp_y * e->dp_y);
+	float dir_x = speed > 0 ? e->dp_x / speed : 0, dir_y = speed > 0 ? e->dp_y / speed : 0;
+	for (int i = 0; i < 96; i++) {
+		float v = 20.f + 60.f * (effects_random() * .5f + .5f);
+		float spread = effects_random() * 1.2f;
+		float sx = dir_x - dir_y * spread, sy = dir_y + dir_x * spread;
+		spawn_particle(e->x, e->y, sx * v, sy * v, .25f + .2f * effects_random(), .3f, 0xffee88);
+	}
+}
+
+// A fountain up the goal line and a flash over the scorer's half.
+internal void
+spawn_score_flash(Match_Event* e) {
+	float x = e->x;
+	float inward = x > 0 ? -1.f : 1.f;
+	for (int i = 0; i < 1024; i++) {
+		float y = effects_random() * arena_half_size_y;
+		float v = 10.f + 40.f * (effects_random() * .5f + .5f);
+		spawn_particle(x, y, inward * v, 30.f * effects_random(), .6f + .3f * effects_random(), .5f, 0xbbffbb);
+	}
+	effects.flash = .25f;
+	effects.flash_x = -inward; // The ball went past this side, the other one scored
+}
+
+internal void
+update_particles(float dt) {
+	Particles* p = &effects.particles;
+	int i = 0;
+#if MATCH_BATCH_SSE2
+	__m128 dt_4 = _mm_set1_ps(dt);
+	__m128 drag = _mm_set1_ps(PARTICLE_DRAG);
+	__m128 gravity = _mm_set1_ps(PARTICLE_GRAVITY * dt);
+	for (; i + 4 <= p->count; i += 4) {
+		__m128 dp_x = _mm_mul_ps(_mm_load_ps(p->dp_x + i), drag);
+		__m128 dp_y = _mm_mul_ps(_mm_add_ps(_mm_load_ps(p->dp_y + i), gravity), drag);
+		_mm_store_ps(p->p_x + i, _mm_add_ps(_mm_load_ps(p->p_x + i), _mm_mul_ps(dp_x, dt_4)));
+		_mm_store_ps(p->p_y + i, _mm_add_ps(_mm_load_ps(p->p_y + i), _mm_mul_ps(dp_y, dt_4)));
+		_mm_store_ps(p->dp_x + i, dp_x);
+		_mm_store_ps(p->dp_y + i, dp_y);
+		_mm_store_ps(p->life + i, _mm_sub_ps(_mm_load_ps(p->life + i), dt_4));
+	}
+#endif
+	for (; i < p->count; i++) {
+		p->dp_x[i] = p->dp_x[i] * PARTICLE_DRAG;
+		p->dp_y[i] = (p->dp_y[i] + PARTICLE_GRAVITY * dt) * PARTICLE_DRAG;
+		p->p_x[i] = p->p_x[i] + p->dp_x[i] * dt;
+		p->p_y[i] = p->p_y[i] + p->dp_y[i] * dt;
+		p->life[i] = p->life[i] - dt;
+	}
+
+	// Back to front, so the one swapped in has already been looked at
+	for (i = p->count - 1; i >= 0; i--) {
+		if (p->life[i] > 0) continue;
+		int last = --p->count;
+		p->p_x[i] = p->p_x[last];
+		p->p_y[i] = p->p_y[last];
+		p->dp_x[i] = p->dp_x[last];
+		p->dp_y[i] = p->dp_y[last];
+		p->life[i] = p->life[last];
+		p->fade[i] = p->fade[last];
+		p->half_size[i] = p->half_size[last];
+		p->color[i] = p->color[last];
+	}
+}
+
+// After every live tick, with what simulate_game reported for it. trail is the
+// match whose ball leaves a trail, 0 in the menu.
+internal void
+effects_tick(Match_Events* events, Match* trail, float dt) {
+	if (!effects.particles.capacity) return;
+	for (int i = 0; i < events->count; i++) {
+		Match_Event* e = &events->events[i];
+		if (e->hit == HIT_PLAYER_1 || e->hit == HIT_PLAYER_2) spawn_hit_sparks(e);
+		else spawn_score_flash(e);
+	}
+	events->count = 0;
+
+	update_particles(dt);
+
+	if (trail) {
+		// Starts under the ball and drifts apart
+		Match* m = trail;
+		for (int i = 0; i < 2; i++) {
+			spawn_particle(m->ball_p_x + effects_random() * ball_half_size, m->ball_p_y + effects_random() * ball_half_size,
+				effects_random() * 4.f, effects_random() * 4.f - PARTICLE_GRAVITY * .15f, .2f, .4f, 0xffffff);
+		}
+	}
+	effects.flash -= dt;
+}
+
+// alpha is how far the frame is between the last two ticks. Particles are
+// drawn where they would be at that point of the last tick's motion.
+internal void
+draw_effects(float alpha) {
+	Particles* p = &effects.particles;
+	if (effects.flash > 0) {
+		set_draw_alpha((u32)(effects.flash * 4.f * 96.f));
+		draw_rect(effects.flash_x * arena_half_size_x * .5f, 0, arena_half_size_x * .5f, arena_half_size_y, 0xffffff);
+		set_draw_alpha(255);
+	}
+	if (!p->count) return;
+
+	float back = (alpha - 1.f) * SIM_DT;
+	int i = 0;
+#if MATCH_BATCH_SSE2
+	// Built four at a time and transposed into World_Rects
+	__m128 back_4 = _mm_set1_ps(back);
+	__m128 full = _mm_set1_ps(255.f);
+	for (; i + 4 <= p->count; i += 4) {
+		__m128 x = _mm_add_ps(_mm_load_ps(p->p_x + i), _mm_mul_ps(_mm_load_ps(p->dp_x + i), back_4));
+		__m128 y = _mm_add_ps(_mm_load_ps(p->p_y + i), _mm_mul_ps(_mm_load_ps(p->dp_y + i), back_4));
+		__m128 half_x = _mm_load_ps(p->half_size + i);
+		__m128 half_y = half_x;
+		_MM_TRANSPOSE4_PS(x, y, half_x, half_y);
+		_mm_storeu_ps(&effects.world_rects[i + 0].x, x);
+		_mm_storeu_ps(&effects.world_rects[i + 1].x, y);
+		_mm_storeu_ps(&effects.world_rects[i + 2].x, half_x);
+		_mm_storeu_ps(&effects.world_rects[i + 3].x, half_y);
+
+		__m128i a = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_mul_ps(_mm_load_ps(p->life + i), _mm_load_ps(p->fade + i)), full), full));
+		__m128i color = _mm_or_si128(_mm_load_si128((__m128i*)(p->color + i)), _mm_slli_epi32(a, 24));
+		_mm_storeu_si128((__m128i*)(effects.batch.colors + i), color);
+	}
+#endif
+	for (; i < p->count; i++) {
+		effects.world_rects[i] = { p->p_x[i] + p->dp_x[i] * back, p->p_y[i] + p->dp_y[i] * back, p->half_size[i], p->half_size[i] };
+		float a = p->life[i] * p->fade[i] * 255.f;
+		effects.batch.colors[i] = p->color[i] | (u32)(a < 255.f ? a : 255.f) << 24;
+	}
+
+	world_rects_to_pixels(effects.world_rects, effects.batch.rects, p->count);
+	effects.batch.count = p->count;
+	bin_rect_batch(&effects.batch);
+	push_rect_batch(&effects.batch);
+}
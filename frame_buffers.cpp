@@ -0,0 +1,286 @@
+// Double or triple buffered presentation. The game renders frame f into buffer
+// f % count while a present thread pushes earlier frames to the screen. Frames
+// are handed over through a single producer, single consumer ring of frame
+// numbers: the game only writes frames_pushed, the present thread only writes
+// frames_presented. The mutex is only there to park a thread that has nothing
+// to do, the handoff itself never waits on it.
+//
+// The renderer only redraws what changed since the last frame, so before frame
+// f is rendered its buffer, which still holds frame f - count, is brought up to
+// date by copying every rect presented since then from the buffer of frame f - 1.
+// Frames are never dropped: a game that gets count - 1 frames ahead waits.
+//
+// The frame can be smaller than the window (see frame_buffers_layout); the
+// presenter then scales it up with nearest filtering onto the viewport.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string.h>
+
+#define MAX_FRAME_BUFFERS 3
+
+// Rows start on a cache line, and a 64 pixel tile row is whole cache lines.
+#define FRAME_ROW_ALIGN 16 // Pixels
+
+enum Upscale_Mode {
+	UPSCALE_INTEGER, // Largest whole multiple that fits, borders around it
+	UPSCALE_STRETCH, // Fills the window, pixels may differ in size by one
+};
+
+struct Present_Frame {
+	int width, height, pitch;
+	int window_width, window_height;
+	Pixel_Rect viewport; // Where the frame lands in the window, bottom row first
+	bool full_redraw; // Everything outside the viewport has to be cleared too
+	Dirty_List rects;
+	double input_time; // When the input this frame saw was read
+	double render_time; // When rendering finished
+};
+
+// Called on the present thread. memory is frame->height rows of frame->pitch pixels, bottom row first.
+typedef void Present_Rects(void* memory, Present_Frame* frame, void* context);
+
+struct Frame_Buffers {
+	int count;
+	void* memory[MAX_FRAME_BUFFERS];
+	Present_Frame frames[MAX_FRAME_BUFFERS];
+	Dirty_List history[MAX_FRAME_BUFFERS]; // Blit rects of the frame last rendered into each buffer
+	int window_width, window_height;
+	Pixel_Rect viewport;
+
+	std::atomic<u64> frames_pushed;
+	std::atomic<u64> frames_presented;
+	int sleepers; // Under mutex
+	bool quit;
+	std::mutex mutex;
+	std::condition_variable wake;
+
+	std::thread thread;
+	Present_Rects* present;
+	void* context;
+	Present_Rects* on_presented; // Optional, after present and before the buffer is reused
+	void* on_presented_context;
+
+	// Written by the present thread, in seconds
+	std::atomic<double> last_present_time;
+	std::atomic<double> input_latency; // Input read to present done, of the last presented frame
+	std::atomic<double> present_duration;
+};
+
+global_variable Frame_Buffers frame_buffers;
+
+internal double
+present_clock() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal void
+frame_buffers_notify() {
+	std::lock_guard<std::mutex> lock(frame_buffers.mutex);
+	if (frame_buffers.sleepers) frame_buffers.wake.notify_all();
+}
+
+template <typename F> internal void
+frame_buffers_wait(F ready) {
+	if (ready()) return;
+	std::unique_lock<std::mutex> lock(frame_buffers.mutex);
+	frame_buffers.sleepers++;
+	frame_buffers.wake.wait(lock, [&] { return frame_buffers.quit || ready(); });
+	frame_buffers.sleepers--;
+}
+
+internal void
+present_thread() {
+	Frame_Buffers* fb = &frame_buffers;
+	profile_thread_name("PRESENT");
+	for (;;) {
+		u64 frame = fb->frames_presented.load(std::memory_order_relaxed);
+		frame_buffers_wait([&] { return fb->frames_pushed.load(std::memory_order_acquire) > frame; });
+		if (fb->frames_pushed.load(std::memory_order_acquire) <= frame) return; // quit
+
+		int buffer = (int)(frame % fb->count);
+		Present_Frame* f = &fb->frames[buffer];
+		double begin = present_clock();
+		{
+			PROFILE_SCOPE("PRESENT");
+			fb->present(fb->memory[buffer], f, fb->context);
+		}
+		double end = present_clock();
+		if (fb->on_presented) fb->on_presented(fb->memory[buffer], f, fb->on_presented_context);
+
+		fb->present_duration.store(end - begin, std::memory_order_relaxed);
+		fb->input_latency.store(end - f->input_time, std::memory_order_relaxed);
+		fb->last_present_time.store(end, std::memory_order_relaxed);
+
+		fb->frames_presented.store(frame + 1, std::memory_order_release);
+		frame_buffers_notify();
+	}
+}
+
+// count is clamped to [1, MAX_FRAME_BUFFERS]; 1 presents on the calling thread.
+// Allocate the buffers afterwards (see frame_buffers_resized).
+internal void
+init_frame_buffers(int count, Present_Rects* present, void* context) {
+	if (count < 1) count = 1;
+	if (count > MAX_FRAME_BUFFERS) count = MAX_FRAME_BUFFERS;
+	frame_buffers.count = count;
+	frame_buffers.present = present;
+	frame_buffers.context = context;
+	if (count > 1) frame_buffers.thread = std::thread(present_thread);
+}
+
+// Also hands every frame to callback once it is presented, on the same thread.
+// Set before the first frame.
+internal void
+frame_buffers_on_presented(Present_Rects* callback, void* context) {
+	frame_buffers.on_presented = callback;
+	frame_buffers.on_presented_context = context;
+}
+
+// Waits until nothing is queued or being presented, before the buffers get freed.
+internal void
+frame_buffers_drain() {
+	Frame_Buffers* fb = &frame_buffers;
+	frame_buffers_wait([&] {
+		return fb->frames_presented.load(std::memory_order_acquire) == fb->frames_pushed.load(std::memory_order_relaxed);
+	});
+}
+
+internal int
+frame_pitch(int width) {
+	return (width + FRAME_ROW_ALIGN - 1) & ~(FRAME_ROW_ALIGN - 1);
+}
+
+// Picks the frame size for a window and where the frame goes in it. render_height
+// 0, or one at least as tall as the window, renders at window resolution.
+// Call after frame_buffers_drain; every buffer needs render_state.pitch *
+// height pixels afterwards, 64 byte aligned.
+internal void
+frame_buffers_layout(int window_width, int window_height, int render_height, Upscale_Mode mode) {
+	if (window_width < 1) window_width = 1;
+	if (window_height < 1) window_height = 1;
+	frame_buffers.window_width = window_width;
+	frame_buffers.window_height = window_height;
+
+	if (render_height <= 0 || render_height >= window_height) {
+		render_state.width = window_width;
+		render_state.height = window_height;
+		frame_buffers.viewport = { 0, 0, window_width, window_height };
+		render_state.pitch = frame_pitch(render_state.width);
+		return;
+	}
+
+	if (mode == UPSCALE_INTEGER) {
+		// The width gets as many pixels as fit at the same scale, so only a
+		// sliver of border is left on the sides.
+		int scale = window_height / render_height;
+		render_state.width = window_width / scale;
+		render_state.height = render_height;
+		int w = render_state.width * scale, h = render_state.height * scale;
+		int x = (window_width - w) / 2, y = (window_height - h) / 2;
+		frame_buffers.viewport = { x, y, x + w, y + h };
+	} else {
+		render_state.height = render_height;
+		render_state.width = (int)((s64)window_width * render_height / window_height);
+		if (render_state.width < 1) render_state.width = 1;
+		frame_buffers.viewport = { 0, 0, window_width, window_height };
+	}
+	render_state.pitch = frame_pitch(render_state.width);
+}
+
+// After the buffers were reallocated. Nothing in them can be trusted anymore.
+internal void
+frame_buffers_resized() {
+	for (int i = 0; i < frame_buffers.count; i++) frame_buffers.history[i].count = 0;
+	render_state.memory = frame_buffers.memory[frame_buffers.frames_pushed.load(std::memory_order_relaxed) % frame_buffers.count];
+	invalidate_frame();
+}
+
+// Points render_state at the next buffer, once the present thread is done with
+// it, and copies in what changed since that buffer was last rendered.
+internal void
+frame_buffers_begin_frame() {
+	Frame_Buffers* fb = &frame_buffers;
+	u64 frame = fb->frames_pushed.load(std::memory_order_relaxed);
+	int buffer = (int)(frame % fb->count);
+	if (frame >= (u64)fb->count) {
+		PROFILE_SCOPE("WAIT");
+		frame_buffers_wait([&] { return fb->frames_presented.load(std::memory_order_acquire) + fb->count > frame; });
+	}
+	render_state.memory = fb->memory[buffer];
+	fb->frames[buffer].full_redraw = dirty.full_redraw;
+	if (fb->count == 1 || dirty.full_redraw) return;
+
+	// Rects of frames f - count + 1 to f - 1, all in the buffer of frame f - 1.
+	// Both threads only read that buffer now.
+	Dirty_List stale = {};
+	for (int i = 1; i < fb->count; i++) {
+		Dirty_List* history = &fb->history[(frame + i) % fb->count];
+		for (int j = 0; j < history->count; j++) dirty_list_add(&stale, history->rects[j]);
+	}
+
+	u8* src = (u8*)fb->memory[(frame + fb->count - 1) % fb->count];
+	u8* dest = (u8*)render_state.memory;
+	int size = pixel_size(render_state.format);
+	for (int i = 0; i < stale.count; i++) {
+		Pixel_Rect r = stale.rects[i];
+		for (int y = r.y0; y < r.y1; y++) {
+			s64 offset = (r.x0 + (s64)y * render_state.pitch) * size;
+			memcpy(dest + offset, src + offset, (r.x1 - r.x0) * size);
+		}
+	}
+}
+
+// Queues the frame just rendered with its dirty.blit rects. input_time is
+// present_clock() when the input for the frame was read.
+internal void
+frame_buffers_end_frame(double input_time) {
+	Frame_Buffers* fb = &frame_buffers;
+	u64 frame = fb->frames_pushed.load(std::memory_order_relaxed);
+	int buffer = (int)(frame % fb->count);
+
+	Present_Frame* f = &fb->frames[buffer];
+	f->width = render_state.width;
+	f->height = render_state.height;
+	f->pitch = render_state.pitch;
+	f->window_width = fb->window_width;
+	f->window_height = fb->window_height;
+	f->viewport = fb->viewport;
+	f->rects = dirty.blit;
+	f->input_time = input_time;
+	f->render_time = present_clock();
+	fb->history[buffer] = dirty.blit;
+
+	if (fb->count == 1) {
+		{
+			PROFILE_SCOPE("PRESENT");
+			fb->present(fb->memory[0], f, fb->context);
+		}
+		double end = present_clock();
+		if (fb->on_presented) fb->on_presented(fb->memory[0], f, fb->on_presented_context);
+		fb->present_duration.store(end - f->render_time, std::memory_order_relaxed);
+		fb->input_latency.store(end - input_time, std::memory_order_relaxed);
+		fb->last_present_time.store(end, std::memory_order_relaxed);
+		fb->frames_pushed.store(frame + 1, std::memory_order_relaxed);
+		fb->frames_presented.store(frame + 1, std::memory_order_relaxed);
+		return;
+	}
+
+	fb->frames_pushed.store(frame + 1, std::memory_order_release);
+	frame_buffers_notify();
+}
+
+internal void
+shutdown_frame_buffers() {
+	if (frame_buffers.count <= 1) return;
+	frame_buffers_drain();
+	{
+		std::lock_guard<std::mutex> lock(frame_buffers.mutex);
+		frame_buffers.quit = true;
+		frame_buffers.wake.notify_all();
+	}
+	frame_buffers.thread.join();
+}
@@ -0,0 +1,215 @@
+// Golden frame checksums. Plays a scripted session through simulate_game and
+// render_game into memory and prints an FNV-1a hash of every frame, so any
+// change to the simulation or the renderer that moves a single pixel shows up.
+// The script is fixed: a few menu moves, then single player against the AI
+// with player 2's keys held from a fixed seed, effects on. Frames come at
+// FRAME_CHECK_HZ, which doesn't divide SIM_HZ, so interpolated frames are
+// covered too.
+// -write FILE saves the hashes, -golden FILE compares against such a file and
+// stops at the first frame that differs. -full redraws everything every frame,
+// -workers N rasterizes tiles on N threads (in deterministic mode) and
+// -buffers N renders through N frame buffers; every one of them has to give
+// the same hashes as a plain run, which is what the ctest cases check.
+// Build as its own console program:
+//   cl /O2 frame_check.cpp        or        g++ -O2 -pthread frame_check.cpp -o frame_check
+// Usage: frame_check [-frames N] [-size WxH] [-full] [-workers N] [-buffers N] [-write FILE | -golden FILE]
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "platform_common.cpp"
+#include "profiler.cpp"
+#include "input_events.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "frame_buffers.cpp"
+#include "pixel_kernels.cpp"
+#include "renderer.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+#include "profiler_overlay.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+#include "effects.cpp"
+#include "gamemovement.cpp"
+
+#define FRAME_CHECK_HZ 50
+#define FRAME_CHECK_SEED 0x2545f491
+
+// The presenter's side is somebody else's problem, the hash is taken from the buffer.
+internal void
+discard_present(void* memory, Present_Frame* frame, void* context) {
+}
+
+internal u64
+frame_hash() {
+	u64 hash = 1469598103934665603ull;
+	int size = pixel_size(render_state.format);
+	for (int y = 0; y < render_state.height; y++) {
+		u8* row = (u8*)render_state.memory + (s64)y * render_state.pitch * size;
+		for (int i = 0; i < render_state.width * size; i++) {
+			hash ^= row[i];
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+internal void
+script_push(double time, int button, bool is_down) {
+	Input_Event event;
+	event.time = time;
+	event.button = (u8)button;
+	event.is_down = is_down;
+	input_queue_push(&input_queue, event);
+}
+
+// The buttons frame f presses and releases, at times within the frame.
+internal void
+script_frame(int frame, u32* random, double begin, double length) {
+	struct Script_Step { int frame; int button; bool is_down; };
+	static const Script_Step menu[] = {
+		{ 10, BUTTON_RIGHT, true }, { 12, BUTTON_RIGHT, false },
+		{ 20, BUTTON_LEFT, true }, { 21, BUTTON_LEFT, false },
+		{ 30, BUTTON_ENTER, true }, { 32, BUTTON_ENTER, false },
+	};
+	for (int i = 0; i < (int)(sizeof(menu) / sizeof(menu[0])); i++) {
+		if (menu[i].frame != frame) continue;
+		script_push(begin + length * .5, menu[i].button, menu[i].is_down);
+	}
+	if (frame <= 32) return;
+
+	// Player 2 holds W or S or nothing, changing its mind now and then
+	static int held = -1;
+	u32 x = *random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*random = x;
+	if (x % 6) return;
+	int next = (x >> 8) % 3 == 0 ? -1 : ((x >> 8) % 3 == 1 ? BUTTON_W : BUTTON_S);
+	double time = begin + length * ((x >> 16) % 256) / 256.;
+	if (held >= 0) script_push(time, held, false);
+	if (next >= 0) script_push(time, next, true);
+	held = next;
+}
+
+int main(int argc, char** argv) {
+	int frames = 1200, width = 960, height = 540, workers = -1, buffers = 1;
+	bool full = false;
+	const char* write_path = 0;
+	const char* golden_path = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-frames") && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-size") && i + 1 < argc) sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (!strcmp(argv[i], "-full")) full = true;
+		else if (!strcmp(argv[i], "-workers") && i + 1 < argc) workers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-buffers") && i + 1 < argc) buffers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-write") && i + 1 < argc) write_path = argv[++i];
+		else if (!strcmp(argv[i], "-golden") && i + 1 < argc) golden_path = argv[++i];
+		else {
+			fprintf(stderr, "usage: %s [-frames N] [-size WxH] [-full] [-workers N] [-buffers N] [-write FILE | -golden FILE]\n", argv[0]);
+			return 1;
+		}
+	}
+	buffers = clamp(1, buffers, MAX_FRAME_BUFFERS);
+	if (frames < 1 || width < 1 || height < 1) {
+		fprintf(stderr, "nothing to render\n");
+		return 1;
+	}
+
+	FILE* golden = 0;
+	if (golden_path && !(golden = fopen(golden_path, "r"))) {
+		fprintf(stderr, "can't read %s\n", golden_path);
+		return 1;
+	}
+	FILE* out = stdout;
+	if (write_path && !(out = fopen(write_path, "w"))) {
+		fprintf(stderr, "can't write %s\n", write_path);
+		return 1;
+	}
+
+	init_profiler();
+	init_span_fill();
+	if (workers >= 0) init_render_workers(workers, true);
+	init_effects(MAX_PARTICLES);
+
+	init_frame_buffers(buffers, discard_present, 0);
+	frame_buffers_layout(width, height, 0, UPSCALE_INTEGER);
+	size_t buffer_size = (size_t)render_state.pitch * render_state.height * sizeof(u32);
+	void* blocks[MAX_FRAME_BUFFERS];
+	for (int i = 0; i < buffers; i++) {
+		blocks[i] = calloc(1, buffer_size + 63);
+		if (!blocks[i]) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		frame_buffers.memory[i] = (void*)(((size_t)blocks[i] + 63) & ~(size_t)63);
+	}
+	frame_buffers_resized();
+	rebuild_viewport_transform();
+	rebuild_glyph_atlas();
+
+	Game_State game = {};
+	Input input = {};
+	u32 random = FRAME_CHECK_SEED;
+	float accumulator = 0;
+	double frame_time = 1. / FRAME_CHECK_HZ;
+	int result = 0;
+
+	for (int frame = 0; frame < frames; frame++) {
+		// Like game_loop_frame, with the clock replaced by the frame count
+		double begin = frame * frame_time;
+		script_frame(frame, &random, begin, frame_time);
+		accumulator += (float)frame_time;
+		int tick_count = 0;
+		for (float a = accumulator; a >= SIM_DT; a -= SIM_DT) tick_count++;
+		for (int tick = 0; tick < tick_count; tick++) {
+			input_begin_tick(&input, &input_queue, begin + frame_time * tick / tick_count, begin + frame_time * (tick + 1) / tick_count);
+			Match_Events events;
+			events.count = 0;
+			simulate_game(&game, &input, SIM_DT, &events);
+			effects_tick(&events, game.current_gamemode == GM_GAMEPLAY ? &game.match : 0, SIM_DT);
+			accumulator -= SIM_DT;
+		}
+
+		if (full) invalidate_frame();
+		frame_buffers_begin_frame();
+		render_game(&game, accumulator / SIM_DT);
+		u64 hash = frame_hash();
+		frame_buffers_end_frame(begin);
+
+		if (golden) {
+			int golden_frame;
+			unsigned long long golden_hash;
+			if (fscanf(golden, "%d %llx", &golden_frame, &golden_hash) != 2 || golden_frame != frame) {
+				fprintf(stderr, "%s has no frame %d\n", golden_path, frame);
+				result = 1;
+				break;
+			}
+			if (golden_hash != hash) {
+				fprintf(stderr, "frame %d differs: %016llx, golden %016llx\n", frame, (unsigned long long)hash, golden_hash);
+				result = 1;
+				break;
+			}
+		} else {
+			fprintf(out, "%d %016llx\n", frame, (unsigned long long)hash);
+		}
+	}
+	if (golden && !result) printf("%d frames match %s\n", frames, golden_path);
+	printf("final score %d - %d\n", game.match.player_1_score, game.match.player_2_score);
+
+	shutdown_frame_buffers();
+	if (workers >= 0) shutdown_render_workers();
+	if (golden) fclose(golden);
+	if (out != stdout) fclose(out);
+	return result;
+}
@@ -0,0 +1,176 @@
+// Finished frames in a named shared memory ring, for encoders and stream
+// tools that would otherwise grab the screen. The present thread writes each
+// presented frame into the next of FRAME_EXPORT_SLOTS slots, only copying the
+// rects that changed since that slot last held a frame, and never waits for a
+// reader. Readers use the pixels where they are.
+//
+// Layout, all little endian: a Frame_Export_Header at offset 0, then the slots'
+// pixels at slots[i].offset. Pixels are 0x00RRGGBB words, height rows of pitch
+// pixels, bottom row first. Frame n goes to slot n % slot_count; the fence is
+// the slot's sequence, 2n + 1 while frame n is written and 2n + 2 once it is
+// done. To read the newest frame:
+//   1. latest = header.latest. 0 means nothing was exported yet, otherwise
+//      frame n = latest - 1 is in slot n % slot_count.
+//   2. s = slot.sequence. Anything but 2n + 2 means it is being replaced; go to 1.
+//   3. Use width, height, pitch and the pixels in place.
+//   4. If slot.sequence is still s the pixels were intact the whole time.
+// A slot is written again slot_count - 1 frames later, which is how long a
+// reader has for step 3.
+
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_EXPORT_MAGIC 0x50584546 // "FEXP"
+#define FRAME_EXPORT_VERSION 1
+#define FRAME_EXPORT_SLOTS 4
+#define FRAME_EXPORT_ALIGN 4096
+
+struct Frame_Export_Slot {
+	std::atomic<u64> sequence;
+	u64 offset; // Of the pixels, from the start of the mapping
+	u32 width, height, pitch;
+	u32 reserved;
+	double input_time, render_time; // Seconds on the steady clock, see present_clock
+};
+
+struct Frame_Export_Header {
+	u32 magic, version;
+	u32 slot_count;
+	u32 reserved;
+	u64 slot_size; // Bytes of pixels a slot has room for
+	std::atomic<u64> latest; // Frames exported, the newest is latest - 1
+	std::atomic<u64> skipped; // Frames that didn't fit a slot
+	Frame_Export_Slot slots[FRAME_EXPORT_SLOTS];
+};
+
+// Present thread only, after init.
+struct Frame_Export {
+	Frame_Export_Header* header;
+	u8* base;
+	u64 frames;
+	bool stale[FRAME_EXPORT_SLOTS]; // The slot has to be written whole
+	Dirty_List history[FRAME_EXPORT_SLOTS]; // Blit rects of the frame last written into each slot
+};
+
+global_variable Frame_Export frame_export;
+
+internal size_t
+frame_export_size(size_t slot_size) {
+	slot_size = (slot_size + FRAME_EXPORT_ALIGN - 1) & ~(size_t)(FRAME_EXPORT_ALIGN - 1);
+	size_t header_size = (sizeof(Frame_Export_Header) + FRAME_EXPORT_ALIGN - 1) & ~(size_t)(FRAME_EXPORT_ALIGN - 1);
+	return header_size + slot_size * FRAME_EXPORT_SLOTS;
+}
+
+// memory is a zeroed mapping of frame_export_size(slot_size) bytes.
+internal void
+init_frame_export(void* memory, size_t slot_size) {
+	slot_size = (slot_size + FRAME_EXPORT_ALIGN - 1) & ~(size_t)(FRAME_EXPORT_ALIGN - 1);
+	frame_export.base = (u8*)memory;
+	frame_export.header = (Frame_Export_Header*)memory;
+	Frame_Export_Header* header = frame_export.header;
+	header->slot_count = FRAME_EXPORT_SLOTS;
+	header->slot_size = slot_size;
+	size_t offset = frame_export_size(slot_size) - slot_size * FRAME_EXPORT_SLOTS;
+	for (int i = 0; i < FRAME_EXPORT_SLOTS; i++) {
+		header->slots[i].offset = offset + slot_size * i;
+		frame_export.stale[i] = true;
+	}
+	header->version = FRAME_EXPORT_VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = FRAME_EXPORT_MAGIC;
+}
+
+// Runs after every present (see frame_buffers_on_presented).
+internal void
+frame_export_present(void* memory, Present_Frame* frame, void* context) {
+	Frame_Export* e = (Frame_Export*)context;
+	Frame_Export_Header* header = e->header;
+	PROFILE_SCOPE("EXPORT");
+
+	u64 n = e->frames++;
+	int index = (int)(n % FRAME_EXPORT_SLOTS);
+	Frame_Export_Slot* slot = &header->slots[index];
+	e->history[index] = frame->rects;
+	if ((u64)frame->pitch * frame->height * sizeof(u32) > header->slot_size) {
+		for (int i = 0; i < FRAME_EXPORT_SLOTS; i++) e->stale[i] = true;
+		header->skipped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	if (slot->width != (u32)frame->width || slot->height != (u32)frame->height || slot->pitch != (u32)frame->pitch) e->stale[index] = true;
+
+	slot->sequence.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	u32* src = (u32*)memory;
+	u32* dest = (u32*)(e->base + slot->offset);
+	if (e->stale[index]) {
+		memcpy(dest, src, (size_t)frame->pitch * frame->height * sizeof(u32));
+		e->stale[index] = false;
+	} else {
+		// The slot holds frame n - FRAME_EXPORT_SLOTS; every frame since then is in the history.
+		for (int i = 0; i < FRAME_EXPORT_SLOTS; i++) {
+			Dirty_List* history = &e->history[i];
+			for (int j = 0; j < history->count; j++) {
+				Pixel_Rect r = history->rects[j];
+				for (int y = r.y0; y < r.y1; y++) {
+					int offset = r.x0 + y * frame->pitch;
+					memcpy(dest + offset, src + offset, (r.x1 - r.x0) * sizeof(u32));
+				}
+			}
+		}
+	}
+	slot->width = frame->width;
+	slot->height = frame->height;
+	slot->pitch = frame->pitch;
+	slot->input_time = frame->input_time;
+	slot->render_time = frame->render_time;
+
+	slot->sequence.store(2 * n + 2, std::memory_order_release);
+	header->latest.store(n + 1, std::memory_order_release);
+}
+
+global_variable void* local_frame_export; // init_local_frame_export's block
+
+// A ring only this process reads, for recording without -export.
+internal bool
+init_local_frame_export(size_t slot_size) {
+	void* memory = calloc(1, frame_export_size(slot_size));
+	if (!memory) return false;
+	local_frame_export = memory;
+	init_frame_export(memory, slot_size);
+	frame_buffers_on_presented(frame_export_present, &frame_export);
+	return true;
+}
+
+// After shutdown_video_recorder and shutdown_frame_buffers, once nothing reads
+// or writes the ring.
+internal void
+close_local_frame_export() {
+	if (!local_frame_export) return;
+	free(local_frame_export);
+	local_frame_export = 0;
+	frame_export.header = 0;
+	frame_export.base = 0;
+}
+
+// Reader side for in-process readers, the steps in the comment up top. Returns
+// the slot of the newest complete frame, or 0 when there is none right now.
+internal Frame_Export_Slot*
+frame_export_latest(Frame_Export_Header* header, u64* frame, u64* sequence) {
+	u64 latest = header->latest.load(std::memory_order_acquire);
+	if (!latest) return 0;
+	Frame_Export_Slot* slot = &header->slots[(latest - 1) % header->slot_count];
+	u64 s = slot->sequence.load(std::memory_order_acquire);
+	if (s != 2 * latest) return 0;
+	*frame = latest - 1;
+	*sequence = s;
+	return slot;
+}
+
+// True when the slot wasn't written since frame_export_latest returned it.
+internal bool
+frame_export_intact(Frame_Export_Slot* slot, u64 sequence) {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
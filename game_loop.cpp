@@ -0,0 +1,93 @@
+// The part of a frame that is the same on every platform: the fixed ticks, the
+// render and the handoff to the presenter. A platform reads its input into
+// input_queue, calls game_loop_frame, then paces itself. Everything the game
+// draws goes through render_state and frame_buffers, so a platform only
+// provides a Present_Rects and the buffer memory.
+// With a replay_log every tick goes into it, see replay.cpp. With a replay the
+// ticks take their buttons from it instead of the platform until it ends; the
+// live input still toggles the overlay. With a net session the ticks are the
+// online match's (see net_rollback.cpp), and it logs them once they're final.
+// Effects (effects.cpp) follow the ticks as they are first simulated; a
+// rollback doesn't take back the sparks of a predicted hit.
+
+struct Game_Loop {
+	Game_State game;
+	Input input;
+	double last_input_time; // Of the last frame that ran any ticks
+	float sim_accumulator;
+
+	Replay_Writer* replay_log;
+	Replay* replay;
+	Net_Session* net;
+};
+
+internal void
+init_game_loop(Game_Loop* loop) {
+	*loop = {};
+	loop->last_input_time = present_clock();
+}
+
+// delta_time is how long the last frame took, input_time is present_clock()
+// after the frame's input was queued.
+internal void
+game_loop_frame(Game_Loop* loop, float delta_time, double input_time) {
+	// Fixed ticks, the remainder is used to interpolate the render. The
+	// ticks share out the time since the last frame that ran any, and
+	// every tick gets the input events of its share.
+	loop->sim_accumulator += delta_time;
+	if (loop->net && !net_poll(loop->net, &loop->game)) {
+		// The peer is gone, the match goes on at this keyboard and so does the
+		// log, which close_net_session brought up to the last tick
+		close_net_session(loop->net);
+		loop->replay_log = loop->net->replay_log;
+		loop->net = 0;
+	}
+	{
+		PROFILE_SCOPE("SIMULATE");
+		int tick_count = 0;
+		for (float a = loop->sim_accumulator; a >= SIM_DT && tick_count < MAX_TICKS_PER_FRAME; a -= SIM_DT) tick_count++;
+		double span = input_time - loop->last_input_time;
+
+		for (int ticks = 0; loop->sim_accumulator >= SIM_DT; ticks++) {
+			if (ticks == MAX_TICKS_PER_FRAME) {
+				loop->sim_accumulator = 0.f;
+				break;
+			}
+
+			double begin = loop->last_input_time + span * ticks / tick_count;
+			double end = ticks + 1 == tick_count ? input_time : loop->last_input_time + span * (ticks + 1) / tick_count;
+			if (loop->net && !net_can_advance(loop->net)) {
+				// The tick's events stay queued for the next one
+				loop->sim_accumulator -= SIM_DT;
+				continue;
+			}
+			input_begin_tick(&loop->input, &input_queue, begin, end);
+			Match_Events events;
+			events.count = 0;
+			if (loop->net) {
+				net_tick(loop->net, &loop->game, &loop->input, &events);
+			} else {
+				Input* input = &loop->input;
+				if (loop->replay) {
+					if (replay_next_tick(loop->replay)) input = &loop->replay->input;
+					else loop->replay = 0;
+				}
+				if (loop->replay_log) replay_write_tick(loop->replay_log, &loop->game, input);
+				simulate_game(&loop->game, input, SIM_DT, &events);
+			}
+			effects_tick(&events, loop->game.current_gamemode == GM_GAMEPLAY ? &loop->game.match : 0, SIM_DT);
+			if (loop->input.buttons[BUTTON_F3].presses) profile_overlay.visible = !profile_overlay.visible;
+			loop->sim_accumulator -= SIM_DT;
+		}
+		if (tick_count) loop->last_input_time = input_time;
+		if (loop->net) net_send_inputs(loop->net);
+	}
+
+	// Render, then hand the frame to the presenter. Only what changed gets blitted.
+	{
+		PROFILE_SCOPE("RENDER");
+		frame_buffers_begin_frame();
+		render_game(&loop->game, loop->sim_accumulator / SIM_DT);
+	}
+	frame_buffers_end_frame(input_time);
+}
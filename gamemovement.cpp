@@ -1,147 +1,111 @@
 #define is_down(b) input->buttons[b].is_down
-#define pressed(b) (input->buttons[b].is_down && input->buttons[b].changed)
-#define released(b) (!input->buttons[b].is_down && input->buttons[b].changed)
+#define pressed(b) (input->buttons[b].presses > 0)
+#define released(b) (input->buttons[b].releases > 0)
+#define held(b) input->buttons[b].held
 
-float player_1_p, player_1_dp, player_2_p, player_2_dp;
-float arena_half_size_x = 85, arena_half_size_y = 45;
-float player_half_size_x = 2.5, player_half_size_y = 12;
-float ball_p_x, ball_p_y, ball_dp_x = 130, ball_dp_y, ball_half_size = 1;
-
-int player_1_score, player_2_score;
-
-internal void
-simulate_player(float *p, float *dp, float ddp, float dt) {
-	ddp -= *dp * 10.f;
-
-	*p = *p + *dp * dt + ddp * dt * dt * .5f;
-	*dp = *dp + ddp * dt;
-
-	if (*p + player_half_size_y > arena_half_size_y) {
-		*p = arena_half_size_y - player_half_size_y;
-		*dp = 0;
-	}
-	else if (*p - player_half_size_y < -arena_half_size_y) {
-		*p = -arena_half_size_y + player_half_size_y;
-		*dp = 0;
-	}
-}
-
-internal bool
-aabb_vs_aabb(float p1x, float p1y, float hs1x, float hs1y,
-	float p2x, float p2y, float hs2x, float hs2y) {
-	return (p1x + hs1x > p2x - hs2x &&
-		p1x - hs1x < p2x + hs2x &&
-		p1y + hs1y > p2y - hs2y &&
-		p1y + hs1y < p2y + hs2y);
-}
+global_variable Score_Widget player_1_score_widget, player_2_score_widget;
 
 enum Gamemode {
 	GM_MENU,
 	GM_GAMEPLAY,
 };
 
-Gamemode current_gamemode;
-int hot_button;
-bool enemy_is_ai;
+// Everything a tick reads and writes. Zeroed is the menu at startup. Replays
+// snapshot it as plain bytes, so keep pointers out of it.
+struct Game_State {
+	Gamemode current_gamemode;
+	int hot_button;
+	bool enemy_is_ai;
+	u8 ai_level; // An Ai_Level, replay_load_state checks it
+	Match match;
+};
 
+// Both end up in the static layer (see render_commands.cpp), the menu's with
+// the text that never changes.
 internal void
-simulate_game(Input* input, float dt) {
+draw_background() {
 	draw_rect(0, 0, arena_half_size_x, arena_half_size_y, 0xffaa33);
 	draw_arena_borders(arena_half_size_x, arena_half_size_y, 0xff5500);
+}
 
+internal void
+draw_menu_background() {
+	draw_background();
+	draw_text("PONG TUTORIAL", -73, 40, 2, 0xffffff);
+	draw_text("WATCH THE STEP BY STEP TUTORIAL ON", -73, 22, .75, 0xffffff);
+	draw_text("YOUTUBE.COM/DANZAIDAN", -73, 15, 1.22, 0xffffff);
+}
 
-	if (current_gamemode == GM_GAMEPLAY) {
+// One fixed simulation tick. Input edges (pressed/released) are seen by exactly one tick
+// and the paddles accelerate for as much of the tick as their keys were held.
+// events, if given, gets the tick's paddle hits and goals.
+internal void
+simulate_game(Game_State* game, Input* input, float dt, Match_Events* events = 0) {
+	if (game->current_gamemode == GM_GAMEPLAY) {
 		float player_1_ddp = 0.f;
-		if (!enemy_is_ai) {
-			if (is_down(BUTTON_UP)) player_1_ddp += 2000;
-			if (is_down(BUTTON_DOWN)) player_1_ddp -= 2000;
+		if (!game->enemy_is_ai) {
+			player_1_ddp += 2000 * held(BUTTON_UP);
+			player_1_ddp -= 2000 * held(BUTTON_DOWN);
 		} else {
-			//if (ball_p_y > player_1_p+2.f) player_1_ddp += 1300;
-			//if (ball_p_y < player_1_p-2.f) player_1_ddp -= 1300;
-			player_1_ddp = (ball_p_y - player_1_p) * 100;
-			if (player_1_ddp > 1300) player_1_ddp = 1300;
-			if (player_1_ddp < -1300) player_1_ddp = -1300;
+			player_1_ddp = ai_ddp(&game->match, 1, (Ai_Level)game->ai_level);
 		}
 
 		float player_2_ddp = 0.f;
-		if (is_down(BUTTON_W)) player_2_ddp += 2000;
-		if (is_down(BUTTON_S)) player_2_ddp -= 2000;
-
-		simulate_player(&player_1_p, &player_1_dp, player_1_ddp, dt);
-		simulate_player(&player_2_p, &player_2_dp, player_2_ddp, dt);
-
-
-		// Simulate Ball
-		{
-			ball_p_x += ball_dp_x * dt;
-			ball_p_y += ball_dp_y * dt;
-
-			if (aabb_vs_aabb(ball_p_x, ball_p_y, ball_half_size, ball_half_size, 80, player_1_p, player_half_size_x, player_half_size_y)) {
-				ball_p_x = 80 - player_half_size_x - ball_half_size;
-				ball_dp_x *= -1;
-				ball_dp_y = (ball_p_y - player_1_p) * 2 + player_1_dp * .75f;
-			} else if (aabb_vs_aabb(ball_p_x, ball_p_y, ball_half_size, ball_half_size, -80, player_2_p, player_half_size_x, player_half_size_y)) {
-				ball_p_x = -80 + player_half_size_x + ball_half_size;
-				ball_dp_x *= -1;
-				ball_dp_y = (ball_p_y - player_2_p) * 2 + player_2_dp * .75f;
-			}
-
-			if (ball_p_y + ball_half_size > arena_half_size_y) {
-				ball_p_y = arena_half_size_y - ball_half_size;
-				ball_dp_y *= -1;
-			} else if (ball_p_y - ball_half_size < -arena_half_size_y) {
-				ball_p_y = -arena_half_size_y + ball_half_size;
-				ball_dp_y *= -1;
-			}
-
-			if (ball_p_x + ball_half_size > arena_half_size_x) {
-				ball_dp_x *= -1;
-				ball_dp_y = 0;
-				ball_p_x = 0;
-				ball_p_y = 0;
-				player_1_score++;
-			} else if (ball_p_x - ball_half_size < -arena_half_size_x) {
-				ball_dp_x *= -1;
-				ball_dp_y = 0;
-				ball_p_x = 0;
-				ball_p_y = 0;
-				player_2_score++;
-			}
-		}
+		player_2_ddp += 2000 * held(BUTTON_W);
+		player_2_ddp -= 2000 * held(BUTTON_S);
 
-		draw_number(player_1_score, -10, 40, 1.f, 0xbbffbb);
-		draw_number(player_2_score, 10, 40, 1.f, 0xbbffbb);
-
-		// Rendering
-		draw_rect(ball_p_x, ball_p_y, ball_half_size, ball_half_size, 0xffffff);
-
-		draw_rect(80, player_1_p, player_half_size_x, player_half_size_y, 0xff0000);
-		draw_rect(-80, player_2_p, player_half_size_x, player_half_size_y, 0xff0000);
+		simulate_match(&game->match, player_1_ddp, player_2_ddp, dt, events);
 
 	} else {
 
 		if (pressed(BUTTON_LEFT) || pressed(BUTTON_RIGHT)) {
-			hot_button = !hot_button;
+			game->hot_button = !game->hot_button;
 		}
 
-		
-
 		if (pressed(BUTTON_ENTER)) {
-			current_gamemode = GM_GAMEPLAY;
-			enemy_is_ai = hot_button ? 0 : 1;
+			game->current_gamemode = GM_GAMEPLAY;
+			game->enemy_is_ai = game->hot_button ? 0 : 1;
+			init_match(&game->match);
 		}
+	}
+}
+
+internal float
+lerp(float a, float b, float t) {
+	return a + (b - a) * t;
+}
+
+// alpha is how far the current frame is between the previous and the last tick.
+internal void
+render_game(Game_State* game, float alpha) {
+	render_begin_frame(game->current_gamemode == GM_GAMEPLAY ? draw_background : draw_menu_background);
+
+	if (game->current_gamemode == GM_GAMEPLAY) {
+		Match* m = &game->match;
+		set_draw_alpha(192); // The background shows through the score
+		draw_score(&player_1_score_widget, m->player_1_score, -10, 40, 1.f, 0xbbffbb);
+		draw_score(&player_2_score_widget, m->player_2_score, 10, 40, 1.f, 0xbbffbb);
+		set_draw_alpha(255);
 
-		if (hot_button == 0) {
+		// Rendering
+		draw_rect(lerp(m->prev_ball_p_x, m->ball_p_x, alpha), lerp(m->prev_ball_p_y, m->ball_p_y, alpha), ball_half_size, ball_half_size, 0xffffff);
+
+		draw_rect(80, lerp(m->prev_player_1_p, m->player_1_p, alpha), player_half_size_x, player_half_size_y, 0xff0000);
+		draw_rect(-80, lerp(m->prev_player_2_p, m->player_2_p, alpha), player_half_size_x, player_half_size_y, 0xff0000);
+
+	} else {
+
+		if (game->hot_button == 0) {
 			draw_text("SINGLE PLAYER", -80, -10, 1, 0xff0000);
 			draw_text("MULTIPLAYER", 20, -10, 1, 0xaaaaaa);
 		} else {
 			draw_text("SINGLE PLAYER", -80, -10, 1, 0xaaaaaa);
 			draw_text("MULTIPLAYER", 20, -10, 1, 0xff0000);
 		}
-
-		draw_text("PONG TUTORIAL", -73, 40, 2, 0xffffff);
-		draw_text("WATCH THE STEP BY STEP TUTORIAL ON", -73, 22, .75, 0xffffff);
-		draw_text("YOUTUBE.COM/DANZAIDAN", -73, 15, 1.22, 0xffffff);
-		
 	}
+
+	draw_effects(alpha);
+	draw_profiler_overlay();
+
+	render_end_frame();
 }
@@ -0,0 +1,148 @@
+// Glyph atlas for draw_text. The letters table is turned into one bitmask per
+// glyph row at compile time. For every text size in use the atlas keeps the
+// glyphs pre-scaled to the window: each glyph row becomes a pixel y range and a
+// few merged x runs, relative to the glyph origin. Drawing a glyph is then one
+// short fill per run and pixel row, with no float math.
+// rebuild_glyph_atlas empties it on WM_SIZE; sizes are scaled again on first use.
+
+#include <math.h>
+
+#define GLYPH_COUNT (int)(sizeof(letters) / sizeof(letters[0]))
+#define GLYPH_ROWS 7
+#define MAX_GLYPH_RUNS 3
+#define MAX_ATLAS_SIZES 16
+
+struct Glyph_Masks {
+	u8 rows[GLYPH_COUNT][GLYPH_ROWS]; // Bit i set when column i is filled
+};
+
+constexpr Glyph_Masks
+build_glyph_masks() {
+	Glyph_Masks result = {};
+	for (int g = 0; g < GLYPH_COUNT; g++) {
+		for (int r = 0; r < GLYPH_ROWS; r++) {
+			const char* row = letters[g][r];
+			for (int c = 0; row[c]; c++) {
+				if (row[c] == '0') result.rows[g][r] |= (u8)(1 << c);
+			}
+		}
+	}
+	return result;
+}
+
+constexpr Glyph_Masks glyph_masks = build_glyph_masks();
+static_assert(glyph_masks.rows[0][0] == 6 && glyph_masks.rows[0][3] == 15, "glyph masks out of sync with letters");
+
+struct Glyph_Row {
+	s16 y0, y1;
+	s16 run_x0[MAX_GLYPH_RUNS], run_x1[MAX_GLYPH_RUNS];
+	int run_count;
+};
+
+struct Scaled_Glyph {
+	Glyph_Row rows[GLYPH_ROWS];
+	Pixel_Rect bounds; // Relative to the origin
+};
+
+struct Glyph_Atlas_Entry {
+	float size;
+	Scaled_Glyph glyphs[GLYPH_COUNT];
+};
+
+struct Glyph_Atlas {
+	int count;
+	int next_evict;
+	Glyph_Atlas_Entry entries[MAX_ATLAS_SIZES];
+};
+
+global_variable Glyph_Atlas glyph_atlas;
+
+internal void
+rebuild_glyph_atlas() {
+	glyph_atlas.count = 0;
+	glyph_atlas.next_evict = 0;
+}
+
+internal void
+scale_glyphs(Glyph_Atlas_Entry* entry, float size) {
+	float k = viewport.pixels_per_unit;
+	float half_size = size * .5f;
+	entry->size = size;
+
+	for (int g = 0; g < GLYPH_COUNT; g++) {
+		Scaled_Glyph* glyph = &entry->glyphs[g];
+		glyph->bounds = {};
+
+		for (int r = 0; r < GLYPH_ROWS; r++) {
+			Glyph_Row* row = &glyph->rows[r];
+			row->y0 = (s16)floorf((-r * size - half_size) * k);
+			row->y1 = (s16)floorf((-r * size + half_size) * k);
+			row->run_count = 0;
+
+			// Neighbouring filled cells merge into one run.
+			u32 mask = glyph_masks.rows[g][r];
+			for (int c = 0; mask >> c; c++) {
+				if (!(mask & (1 << c))) continue;
+				int first = c;
+				while (mask & (1 << (c + 1))) c++;
+
+				row->run_x0[row->run_count] = (s16)floorf((first * size - half_size) * k);
+				row->run_x1[row->run_count] = (s16)floorf((c * size + half_size) * k);
+
+				Pixel_Rect run = { row->run_x0[row->run_count], row->y0, row->run_x1[row->run_count], row->y1 };
+				if (!rect_is_empty(run)) glyph->bounds = rect_is_empty(glyph->bounds) ? run : rect_union(glyph->bounds, run);
+				row->run_count++;
+			}
+		}
+	}
+}
+
+internal Glyph_Atlas_Entry*
+find_atlas_entry(float size) {
+	for (int i = 0; i < glyph_atlas.count; i++) {
+		if (glyph_atlas.entries[i].size == size) return &glyph_atlas.entries[i];
+	}
+	return 0;
+}
+
+// Once every entry is taken the oldest one is scaled over, so glyph commands
+// still queued for it have to be flushed before this is called.
+internal Glyph_Atlas_Entry*
+add_atlas_entry(float size) {
+	Glyph_Atlas_Entry* entry;
+	if (glyph_atlas.count < MAX_ATLAS_SIZES) {
+		entry = &glyph_atlas.entries[glyph_atlas.count++];
+	} else {
+		entry = &glyph_atlas.entries[glyph_atlas.next_evict];
+		glyph_atlas.next_evict = (glyph_atlas.next_evict + 1) % MAX_ATLAS_SIZES;
+	}
+	scale_glyphs(entry, size);
+	return entry;
+}
+
+// Glyph origin in pixels, snapped so every glyph of a size rasterizes the same way.
+internal void
+glyph_origin(float x, float y, int* ox, int* oy) {
+	*ox = world_edge_to_pixel(x, viewport.center_x);
+	*oy = world_edge_to_pixel(y, viewport.center_y);
+}
+
+internal void
+blit_glyph(Scaled_Glyph* glyph, int ox, int oy, Pixel_Rect clip, u32 color, u32 alpha) {
+	Fill_Rect* fill = fill_rect_kernels[blend_for_alpha(alpha)];
+	for (int r = 0; r < GLYPH_ROWS; r++) {
+		Glyph_Row* row = &glyph->rows[r];
+		int y0 = clamp(clip.y0, oy + row->y0, clip.y1);
+		int y1 = clamp(clip.y0, oy + row->y1, clip.y1);
+		if (y0 >= y1) continue;
+
+		for (int i = 0; i < row->run_count; i++) {
+			int x0 = clamp(clip.x0, ox + row->run_x0[i], clip.x1);
+			int x1 = clamp(clip.x0, ox + row->run_x1[i], clip.x1);
+			if (x0 >= x1) continue;
+
+			Pixel_Rect run = { x0, y0, x1, y1 };
+			fill(run, color, alpha);
+		}
+	}
+}
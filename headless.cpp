@@ -0,0 +1,200 @@
+// Headless gameplay runner: steps simulation.cpp without a window or
+// framebuffer, for physics and AI regression runs. Player 1 is the AI, player 2
+// is driven by the chosen input. -matches runs that many matches side by side
+// in a Match_Batch; -ticks counts the ticks of all of them together. Matches
+// are played to POINTS_PER_MATCH and the final scores are tallied. -ai picks
+// player 1's level from ai_opponent.cpp, -ai_2 player 2's for -input ai.
+// Build as its own console program:
+//   cl /O2 headless.cpp        or        g++ -O2 headless.cpp -o headless
+// Usage: headless [-ticks N] [-matches N] [-seed N] [-input random|script|ai] [-ai LEVEL] [-ai_2 LEVEL]
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+
+#define POINTS_PER_MATCH 11
+
+// Ticks are far shorter than a clock read, so they are timed in batches and
+// the percentiles are over the batch average.
+#define TICKS_PER_SAMPLE 256
+
+enum Input_Mode {
+	INPUT_RANDOM,
+	INPUT_SCRIPT,
+	INPUT_AI,
+};
+
+internal double
+seconds_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal u32
+xorshift32(u32* state) {
+	u32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// Same values the keyboard produces: W, S or nothing.
+struct Random_Input {
+	u32 state;
+	float ddp;
+	int hold;
+};
+
+internal float
+random_input(Random_Input* input) {
+	if (input->hold-- <= 0) {
+		u32 r = xorshift32(&input->state);
+		input->ddp = (r % 3 == 0) ? 2000.f : (r % 3 == 1) ? -2000.f : 0.f;
+		input->hold = (int)((r >> 8) % (SIM_HZ / 2));
+	}
+	return input->ddp;
+}
+
+// A fixed pattern, the same for every run.
+internal float
+script_input(s64 tick) {
+	int phase = (int)(tick % (SIM_HZ * 2));
+	if (phase < SIM_HZ / 2) return 2000.f;
+	if (phase < SIM_HZ) return 0.f;
+	if (phase < SIM_HZ * 3 / 2) return -2000.f;
+	return 0.f;
+}
+
+int main(int argc, char** argv) {
+	s64 ticks = 10000000;
+	int match_count = 1;
+	u32 seed = 1;
+	Input_Mode mode = INPUT_RANDOM;
+	int ai_level_1 = AI_CLASSIC, ai_level_2 = AI_CLASSIC;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-ticks") && i + 1 < argc) ticks = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-matches") && i + 1 < argc) match_count = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc) seed = (u32)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-input") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "random")) mode = INPUT_RANDOM;
+			else if (!strcmp(argv[i], "script")) mode = INPUT_SCRIPT;
+			else if (!strcmp(argv[i], "ai")) mode = INPUT_AI;
+			else {
+				fprintf(stderr, "unknown input %s\n", argv[i]);
+				return 1;
+			}
+		} else if ((!strcmp(argv[i], "-ai") || !strcmp(argv[i], "-ai_2")) && i + 1 < argc) {
+			int* level = argv[i][3] ? &ai_level_2 : &ai_level_1;
+			*level = find_ai_level(argv[++i]);
+			if (*level < 0) {
+				fprintf(stderr, "unknown ai level %s (classic, easy, medium or hard)\n", argv[i]);
+				return 1;
+			}
+		} else {
+			fprintf(stderr, "usage: %s [-ticks N] [-matches N] [-seed N] [-input random|script|ai] [-ai LEVEL] [-ai_2 LEVEL]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (match_count < 1) match_count = 1;
+	if (ticks < match_count) ticks = match_count;
+	s64 steps = (ticks + match_count - 1) / match_count;
+	ticks = steps * match_count;
+
+	Match_Batch batch;
+	std::vector<float> player_1_ddp(match_count), player_2_ddp(match_count);
+	std::vector<Random_Input> random(match_count);
+	if (!match_batch_alloc(&batch, match_count)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for (int m = 0; m < match_count; m++) {
+		random[m].state = seed + (u32)m * 0x9e3779b9;
+		if (!random[m].state) random[m].state = 1;
+	}
+
+	// results[a][b]: matches that ended a to b
+	static s64 results[POINTS_PER_MATCH + 1][POINTS_PER_MATCH + 1];
+	s64 matches = 0, points_1 = 0, points_2 = 0;
+	Match reset;
+	init_match(&reset);
+
+	s64 steps_per_sample = TICKS_PER_SAMPLE / match_count;
+	if (steps_per_sample < 1) steps_per_sample = 1;
+	std::vector<double> samples;
+	samples.reserve((size_t)(steps / steps_per_sample + 1));
+
+	double begin = seconds_now();
+	double sample_begin = begin;
+	for (s64 step = 0; step < steps; step++) {
+		ai_batch_ddp(&batch, 1, (Ai_Level)ai_level_1, player_1_ddp.data());
+		switch (mode) {
+			case INPUT_RANDOM: {
+				for (int m = 0; m < match_count; m++) player_2_ddp[m] = random_input(&random[m]);
+			} break;
+			case INPUT_SCRIPT: {
+				// Shifted per match so the matches don't all play the same
+				for (int m = 0; m < match_count; m++) player_2_ddp[m] = script_input(step + m * 61);
+			} break;
+			default: {
+				ai_batch_ddp(&batch, 2, (Ai_Level)ai_level_2, player_2_ddp.data());
+			} break;
+		}
+		simulate_match_batch(&batch, player_1_ddp.data(), player_2_ddp.data(), SIM_DT);
+
+		for (int m = 0; m < match_count; m++) {
+			int score_1 = batch.player_1_score[m], score_2 = batch.player_2_score[m];
+			if (score_1 >= POINTS_PER_MATCH || score_2 >= POINTS_PER_MATCH) {
+				results[score_1][score_2]++;
+				matches++;
+				points_1 += score_1;
+				points_2 += score_2;
+				match_batch_set(&batch, m, &reset);
+			}
+		}
+
+		if ((step + 1) % steps_per_sample == 0) {
+			double now = seconds_now();
+			samples.push_back((now - sample_begin) / (steps_per_sample * match_count));
+			sample_begin = now;
+		}
+	}
+	double elapsed = seconds_now() - begin;
+
+	for (int m = 0; m < match_count; m++) {
+		points_1 += batch.player_1_score[m];
+		points_2 += batch.player_2_score[m];
+	}
+
+	printf("ticks       %lld over %d matches (%.1f hours of play)\n", (long long)ticks, match_count, ticks / (double)SIM_HZ / 3600.);
+	printf("ticks/sec   %.0f\n", ticks / elapsed);
+	if (!samples.empty()) {
+		std::sort(samples.begin(), samples.end());
+		double p50 = samples[samples.size() / 2];
+		double p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+		printf("tick p50    %.1f ns\n", p50 * 1e9);
+		printf("tick p99    %.1f ns\n", p99 * 1e9);
+	}
+	printf("points      %lld - %lld\n", (long long)points_1, (long long)points_2);
+	printf("matches     %lld (first to %d)\n", (long long)matches, POINTS_PER_MATCH);
+	for (int a = 0; a <= POINTS_PER_MATCH; a++) {
+		for (int b = 0; b <= POINTS_PER_MATCH; b++) {
+			if (results[a][b]) printf("  %2d - %-2d  %lld\n", a, b, (long long)results[a][b]);
+		}
+	}
+	// Stays the same across runs with the same arguments; a change means the physics changed.
+	printf("final state %.4f %.4f %.4f %.4f\n", batch.player_1_p[0], batch.player_2_p[0], batch.ball_p_x[0], batch.ball_p_y[0]);
+
+	match_batch_free(&batch);
+	return 0;
+}
@@ -0,0 +1,109 @@
+// Timestamped input. The platform pushes presses and releases into an
+// Input_Queue as they happen, from whichever single thread reads the device.
+// The queue is a single producer, single consumer ring; neither side locks.
+//
+// The main loop spreads the events over the ticks it runs: a frame's ticks
+// stand for the wall time since the last frame, so the event at time t goes to
+// the tick that covers the same share of that span. input_begin_tick applies
+// the events up to the end of a tick and fills in Button_State and the tick's
+// event list. A tick that has nothing queued keeps the buttons as they were.
+
+#include <atomic>
+
+#define INPUT_QUEUE_SIZE 256 // Power of two
+
+struct Input_Queue {
+	Input_Event events[INPUT_QUEUE_SIZE];
+	std::atomic<u32> head; // Written by the consumer
+	std::atomic<u32> tail; // Written by the producer
+	std::atomic<u32> dropped;
+};
+
+global_variable Input_Queue input_queue;
+
+// Producer side. A full queue drops the event.
+internal void
+input_queue_push(Input_Queue* queue, Input_Event event) {
+	u32 tail = queue->tail.load(std::memory_order_relaxed);
+	if (tail - queue->head.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) {
+		queue->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	queue->events[tail & (INPUT_QUEUE_SIZE - 1)] = event;
+	queue->tail.store(tail + 1, std::memory_order_release);
+}
+
+// Consumer side. Takes the oldest event if it happened before time.
+internal bool
+input_queue_pop_before(Input_Queue* queue, double time, Input_Event* event) {
+	u32 head = queue->head.load(std::memory_order_relaxed);
+	if (head == queue->tail.load(std::memory_order_acquire)) return false;
+	Input_Event* next = &queue->events[head & (INPUT_QUEUE_SIZE - 1)];
+	if (next->time >= time) return false;
+	*event = *next;
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+// Applies the events queued before end to the tick covering [begin, end).
+// Events older than begin count as happening at begin.
+internal void
+input_begin_tick(Input* input, Input_Queue* queue, double begin, double end) {
+	bool was_down[BUTTON_COUNT];
+	double down_since[BUTTON_COUNT];
+	double held[BUTTON_COUNT];
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		Button_State* button = &input->buttons[i];
+		was_down[i] = button->is_down;
+		down_since[i] = begin;
+		held[i] = 0;
+		button->presses = button->releases = 0;
+	}
+	input->event_count = 0;
+
+	double span = end - begin;
+	Input_Event event;
+	while (input_queue_pop_before(queue, end, &event)) {
+		if (event.button >= BUTTON_COUNT) continue;
+		Button_State* button = &input->buttons[event.button];
+		if (button->is_down == event.is_down) continue; // Key repeat
+		double time = event.time > begin ? event.time : begin;
+
+		if (event.is_down) {
+			button->presses++;
+			down_since[event.button] = time;
+		} else {
+			button->releases++;
+			held[event.button] += time - down_since[event.button];
+		}
+		button->is_down = event.is_down;
+
+		if (input->event_count < MAX_TICK_EVENTS) {
+			event.time = span > 0 ? (time - begin) / span : 0;
+			input->events[input->event_count++] = event;
+		}
+	}
+
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		Button_State* button = &input->buttons[i];
+		if (button->is_down) held[i] += end - down_since[i];
+		button->held = span > 0 ? (float)(held[i] / span) : (button->is_down ? 1.f : 0.f);
+		if (button->held > 1.f) button->held = 1.f;
+		button->changed = button->is_down != was_down[i];
+	}
+}
+
+// Lets go of everything, when the window loses focus and releases would be
+// missed. The releases are queued like the device's own, so the tick they land
+// on counts them and marks the buttons changed; buttons that are already up
+// skip theirs the way key repeats do.
+internal void
+input_release_all(Input_Queue* queue, double time) {
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		Input_Event event;
+		event.time = time;
+		event.button = (u8)i;
+		event.is_down = false;
+		input_queue_push(queue, event);
+	}
+}
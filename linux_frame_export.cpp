@@ -0,0 +1,54 @@
+// The named mapping behind frame_export.cpp, in POSIX shared memory. Readers
+// open /dev/shm/pong_frames, or shm_open("/pong_frames", O_RDONLY, 0).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define LINUX_FRAME_EXPORT_NAME "/pong_frames"
+
+global_variable size_t frame_export_mapping_size;
+global_variable int frame_export_file = -1; // Holds the flock while we export
+
+// slot_size is the biggest frame in bytes. The exporting instance holds an
+// flock on the mapping for as long as it runs, so this fails when another one
+// already exports, and a mapping left behind by a crash has no lock and is
+// taken over.
+internal bool
+linux_init_frame_export(size_t slot_size) {
+	size_t size = frame_export_size(slot_size);
+	int file = shm_open(LINUX_FRAME_EXPORT_NAME, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (file < 0 && errno == EEXIST) file = shm_open(LINUX_FRAME_EXPORT_NAME, O_RDWR, 0);
+	if (file < 0) return false;
+	if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+		close(file);
+		return false;
+	}
+	// Truncating to 0 first zeroes what a previous run left
+	bool sized = ftruncate(file, 0) == 0 && ftruncate(file, (off_t)size) == 0;
+	void* memory = sized ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+	if (memory == MAP_FAILED) {
+		shm_unlink(LINUX_FRAME_EXPORT_NAME);
+		close(file);
+		return false;
+	}
+
+	frame_export_file = file;
+	frame_export_mapping_size = size;
+	init_frame_export(memory, slot_size);
+	frame_buffers_on_presented(frame_export_present, &frame_export);
+	return true;
+}
+
+// After shutdown_frame_buffers. Unlinked before the lock goes, so nobody takes
+// over a name that is about to disappear.
+internal void
+linux_shutdown_frame_export() {
+	if (!frame_export_mapping_size) return;
+	munmap(frame_export.header, frame_export_mapping_size);
+	shm_unlink(LINUX_FRAME_EXPORT_NAME);
+	close(frame_export_file);
+	frame_export_file = -1;
+}
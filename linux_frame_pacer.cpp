@@ -0,0 +1,65 @@
+// Frame limiter, the Linux side of win32_frame_pacer.cpp with the same calls.
+// clock_nanosleep sleeps on an absolute CLOCK_MONOTONIC deadline until shortly
+// before the next frame is due and the rest is spun. Deadlines advance by whole
+// periods; a frame that runs late starts a new schedule.
+
+#include <time.h>
+#include <errno.h>
+#include <emmintrin.h>
+
+struct Linux_Frame_Pacer {
+	s64 spin; // Nanoseconds before a deadline that are spun instead of slept
+	s64 next; // Deadline of the next frame, 0 when there is no schedule
+};
+
+global_variable Linux_Frame_Pacer frame_pacer;
+
+internal s64
+pacer_now() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (s64)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+internal void
+init_frame_pacer() {
+	// How late a wakeup can be with the default timer slack
+	frame_pacer.spin = 200000;
+}
+
+internal void
+shutdown_frame_pacer() {
+}
+
+// Forget the schedule, after a pause for example.
+internal void
+frame_pacer_reset() {
+	frame_pacer.next = 0;
+}
+
+// Returns when the next frame at hz is due. hz 0 doesn't wait.
+internal void
+frame_pacer_wait(float hz) {
+	Linux_Frame_Pacer* pacer = &frame_pacer;
+	if (hz <= 0) {
+		pacer->next = 0;
+		return;
+	}
+
+	PROFILE_SCOPE("PACE");
+	s64 period = (s64)(1e9 / hz);
+	s64 now = pacer_now();
+	if (!pacer->next || now - pacer->next > period) pacer->next = now;
+	s64 deadline = pacer->next + period;
+	pacer->next = deadline;
+
+	s64 wake = deadline - pacer->spin;
+	if (wake > now) {
+		timespec due;
+		due.tv_sec = (time_t)(wake / 1000000000);
+		due.tv_nsec = (long)(wake % 1000000000);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, 0) == EINTR) {}
+	}
+
+	while (pacer_now() < deadline) _mm_pause();
+}
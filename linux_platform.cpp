@@ -0,0 +1,187 @@
+// Linux platform layer. Runs the same game_loop_frame as win32_platform.cpp and
+// presents through X11 (linux_x11.cpp) or, with -terminal or no display, in
+// the terminal (linux_terminal.cpp). Takes the same flags as the Win32 build
+// where they apply: -buffers N, -hz N, -deterministic, -export, -record FILE,
+// -save_replay FILE, -replay FILE, -host [PORT], -join ADDRESS[:PORT],
+// -delay N, -ai LEVEL, -rgb565, -trace. Recordings are always .y4m here, there is no
+// encoder to hand them to, and -rgb565 only applies in the terminal.
+// Build:
+//   g++ -O2 -pthread linux_platform.cpp -o pong -lX11 -lXext -lncursesw
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+global_variable bool running = true;
+
+#include "platform_common.cpp"
+#include "profiler.cpp"
+#include "input_events.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "frame_buffers.cpp"
+#include "frame_export.cpp"
+#include "linux_frame_export.cpp"
+#include "yuv_convert.cpp"
+#include "video_record.cpp"
+#include "linux_frame_pacer.cpp"
+#include "linux_udp.cpp"
+#include "pixel_kernels.cpp"
+#include "renderer.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+#include "profiler_overlay.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+#include "effects.cpp"
+#include "gamemovement.cpp"
+#include "replay.cpp"
+#include "net_rollback.cpp"
+#include "game_loop.cpp"
+#include "linux_x11.cpp"
+#include "linux_terminal.cpp"
+
+int main(int argc, char** argv) {
+	// Flags are looked up the way the Win32 build does it, in one command line
+	// with a space after every argument.
+	char command_line[1024] = "";
+	for (int i = 1; i < argc; i++) {
+		if (strlen(command_line) + strlen(argv[i]) + 2 > sizeof(command_line)) break;
+		strcat(command_line, argv[i]);
+		strcat(command_line, " ");
+	}
+
+	init_profiler();
+	init_span_fill();
+	// -deterministic keeps rasterization on the main thread, for frame tests
+	init_render_workers(0, strstr(command_line, "-deterministic") != 0);
+
+	bool use_terminal = strstr(command_line, "-terminal") || !getenv("DISPLAY") || !x11_init(1280, 720);
+	if (use_terminal && !terminal_init()) {
+		fprintf(stderr, "no X display and no terminal\n");
+		return 1;
+	}
+
+	// -buffers 1 presents on the main thread, 2 or 3 on a present thread
+	int buffer_count = 2;
+	if (const char* arg = strstr(command_line, "-buffers ")) buffer_count = atoi(arg + 9);
+	if (use_terminal) {
+		// -rgb565 draws 16 bit frames (see pixel_kernels.cpp); X11 gets 32 bit ones
+		if (strstr(command_line, "-rgb565")) render_state.format = PIXEL_RGB565;
+		init_frame_buffers(1, terminal_present, 0);
+		terminal_resize_frame_buffers();
+	} else {
+		init_frame_buffers(buffer_count, x11_present, &x11);
+		x11_resize_frame_buffers();
+	}
+
+	// -export puts every presented frame in shared memory for encoders, see
+	// frame_export.cpp. -record FILE records them (see video_record.cpp). Both
+	// take XRGB8888 frames only.
+	int screen_width = 1920, screen_height = 1080;
+	if (!use_terminal) {
+		screen_width = WidthOfScreen(DefaultScreenOfDisplay(x11.display));
+		screen_height = HeightOfScreen(DefaultScreenOfDisplay(x11.display));
+	}
+	size_t export_slot_size = (size_t)frame_pitch(screen_width) * screen_height * sizeof(u32);
+	bool exportable = render_state.format == PIXEL_XRGB8888;
+	if (exportable && strstr(command_line, "-export")) linux_init_frame_export(export_slot_size);
+	if (const char* arg = exportable ? strstr(command_line, "-record ") : 0) {
+		char path[260];
+		if (sscanf(arg + 8, "%259s", path) == 1) init_video_recorder(path, open_y4m_sink, export_slot_size);
+	}
+
+	// No vsync on either, so frames are paced to -hz N; -hz 0 runs unlimited.
+	float target_hz = 60;
+	if (const char* arg = strstr(command_line, "-hz ")) target_hz = (float)atof(arg + 4);
+	init_frame_pacer();
+
+	Game_Loop loop;
+	init_game_loop(&loop);
+	init_effects(MAX_PARTICLES);
+
+	// -ai LEVEL picks how the single player opponent plays (see ai_opponent.cpp)
+	if (const char* arg = strstr(command_line, "-ai ")) {
+		char name[16];
+		int level = sscanf(arg + 4, "%15s", name) == 1 ? find_ai_level(name) : -1;
+		if (level >= 0) loop.game.ai_level = (u8)level;
+	}
+
+	// -save_replay FILE logs every tick's input, -replay FILE plays one back
+	// before handing over to the keyboard (see replay.cpp).
+	Replay_Writer replay_log = {};
+	Replay replay = {};
+	if (const char* arg = strstr(command_line, "-save_replay ")) {
+		char path[260];
+		if (sscanf(arg + 13, "%259s", path) == 1 && open_replay_writer(&replay_log, path)) loop.replay_log = &replay_log;
+	}
+	if (const char* arg = strstr(command_line, "-replay ")) {
+		char path[260];
+		if (sscanf(arg + 8, "%259s", path) == 1 && open_replay(&replay, path) && replay_seek(&replay, 0, &loop.game)) loop.replay = &replay;
+	}
+
+	// -host [PORT] waits for a second player, -join ADDRESS[:PORT] plays
+	// against one online, -delay N sets the host's input delay in ticks (see
+	// net_rollback.cpp). The online match is logged with -save_replay too.
+	Net_Session net = {};
+	if (const char* arg = strstr(command_line, "-host")) {
+		u16 port = NET_DEFAULT_PORT;
+		int delay = NET_DEFAULT_DELAY;
+		sscanf(arg + 5, "%hu", &port);
+		if (const char* delay_arg = strstr(command_line, "-delay ")) delay = atoi(delay_arg + 7);
+		if (net_host(&net, port, delay)) loop.net = &net;
+	} else if (const char* arg = strstr(command_line, "-join ")) {
+		char host_name[256];
+		u16 port = NET_DEFAULT_PORT;
+		if (sscanf(arg + 6, "%255[^: ]:%hu", host_name, &port) >= 1 && net_join(&net, host_name, port)) loop.net = &net;
+	}
+	if (loop.net) {
+		net.replay_log = loop.replay_log;
+		loop.replay_log = 0;
+		loop.replay = 0;
+	}
+
+	float delta_time = 0.016666f;
+	double frame_begin_time = present_clock();
+	while (running) {
+		bool focus_lost = false;
+		{
+			PROFILE_SCOPE("INPUT");
+			if (use_terminal) terminal_process_input();
+			else x11_process_events(&focus_lost);
+		}
+		// Before input_time, so the releases go to this frame's ticks
+		if (focus_lost) input_release_all(&input_queue, present_clock());
+		double input_time = present_clock();
+
+		game_loop_frame(&loop, delta_time, input_time);
+		frame_pacer_wait(target_hz);
+
+		double frame_end_time = present_clock();
+		delta_time = (float)(frame_end_time - frame_begin_time);
+		frame_begin_time = frame_end_time;
+		profiler_end_frame(delta_time);
+	}
+
+	if (loop.net) close_net_session(loop.net);
+	close_replay_writer(&replay_log);
+	close_replay(&replay);
+	shutdown_video_recorder();
+	shutdown_frame_pacer();
+	shutdown_frame_buffers();
+	linux_shutdown_frame_export();
+	close_local_frame_export();
+	shutdown_render_workers();
+	if (use_terminal) shutdown_terminal();
+	else shutdown_x11();
+
+	// -trace writes the last PROFILE_RING_EVENTS scopes of every thread as Chrome trace JSON
+	if (strstr(command_line, "-trace")) profiler_write_trace("trace.json");
+	return 0;
+}
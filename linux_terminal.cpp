@@ -0,0 +1,190 @@
+// Terminal presenter on ncurses, for consoles and ssh sessions. Every cell
+// shows two frame pixels with an upper half block, the top one as foreground
+// and the bottom one as background color, so the frame is the terminal's
+// columns by twice its rows. Pixels are reduced to the 16 (or 8) terminal
+// colors and a cell is only written when its pair of colors changed, and only
+// cells under the dirty rects are looked at. Without colors the half blocks
+// themselves tell lit from dark.
+// ncurses isn't thread safe and input comes from it too, so this presents on
+// the main thread with a single buffer.
+// Terminals report presses, not releases. A key counts as held until it stops
+// repeating: TERMINAL_FIRST_REPEAT after the press, TERMINAL_REPEAT after
+// every repeat.
+
+#include <locale.h>
+#define NCURSES_WIDECHAR 1 // add_wch and friends
+#include <ncurses.h>
+
+#define TERMINAL_FIRST_REPEAT .55 // Seconds, longer than the usual repeat delay
+#define TERMINAL_REPEAT .1
+
+struct Terminal {
+	int columns, rows;
+	int colors; // 16, 8, or 2 when there are none
+	u16* cells; // Top color in the high byte, bottom in the low; 0xffff is unknown
+	u32* memory;
+	double release_at[BUTTON_COUNT]; // 0 when the button is up
+};
+
+global_variable Terminal terminal;
+
+internal bool
+terminal_init() {
+	setlocale(LC_ALL, "");
+	if (!initscr()) return false;
+	cbreak();
+	noecho();
+	nodelay(stdscr, TRUE);
+	keypad(stdscr, TRUE);
+	curs_set(0);
+
+	terminal.colors = 2;
+	if (has_colors() && start_color() == OK) {
+		if (COLORS >= 16 && COLOR_PAIRS > 16 * 16) terminal.colors = 16;
+		else if (COLORS >= 8 && COLOR_PAIRS > 8 * 8) terminal.colors = 8;
+	}
+	if (terminal.colors > 2) {
+		for (int fg = 0; fg < terminal.colors; fg++) {
+			for (int bg = 0; bg < terminal.colors; bg++) init_pair((short)(1 + fg * terminal.colors + bg), (short)fg, (short)bg);
+		}
+	}
+	return true;
+}
+
+// curses color numbers have red, green and blue in bits 0 to 2, and 8 more for
+// the bright ones.
+internal int
+terminal_color(u32 pixel) {
+	u32 r = (pixel >> 16) & 0xff, g = (pixel >> 8) & 0xff, b = pixel & 0xff;
+	if (terminal.colors == 2) return (r * 2 + g * 5 + b) / 8 > 0x60;
+	int color = (r > 0x60) | (g > 0x60) << 1 | (b > 0x60) << 2;
+	if (terminal.colors == 16 && (r > 0xc0 || g > 0xc0 || b > 0xc0)) color += 8;
+	return color;
+}
+
+internal void
+terminal_resize_frame_buffers() {
+	getmaxyx(stdscr, terminal.rows, terminal.columns);
+	if (terminal.columns < 1) terminal.columns = 1;
+	if (terminal.rows < 1) terminal.rows = 1;
+	frame_buffers_layout(terminal.columns, terminal.rows * 2, 0, UPSCALE_INTEGER);
+
+	free(terminal.cells);
+	free(terminal.memory);
+	terminal.cells = (u16*)malloc((size_t)terminal.columns * terminal.rows * sizeof(u16));
+	terminal.memory = (u32*)aligned_alloc(64, (size_t)render_state.pitch * render_state.height * sizeof(u32));
+	if (!terminal.cells || !terminal.memory) {
+		render_state.width = render_state.height = 0;
+		running = false;
+	}
+	if (terminal.cells) memset(terminal.cells, 0xff, (size_t)terminal.columns * terminal.rows * sizeof(u16));
+	frame_buffers.memory[0] = terminal.memory;
+
+	clear();
+	frame_buffers_resized();
+	rebuild_viewport_transform();
+	rebuild_glyph_atlas();
+}
+
+// One copy per pixel format (see pixel_kernels.cpp), so the loop reads the
+// pixels without asking which kind they are.
+template <typename Format> internal void
+terminal_present_format(void* memory, Present_Frame* frame) {
+	typedef typename Format::Pixel Pixel;
+	Pixel* pixels = (Pixel*)memory;
+	int columns = frame->width < terminal.columns ? frame->width : terminal.columns;
+	int rows = frame->height / 2 < terminal.rows ? frame->height / 2 : terminal.rows;
+
+	for (int i = 0; i < frame->rects.count; i++) {
+		Pixel_Rect r = frame->rects.rects[i];
+		// Cell c from the bottom holds pixel rows 2c (bottom) and 2c + 1 (top).
+		int x1 = r.x1 < columns ? r.x1 : columns;
+		int c1 = (r.y1 + 1) / 2 < rows ? (r.y1 + 1) / 2 : rows;
+		for (int c = r.y0 / 2; c < c1; c++) {
+			Pixel* bottom = pixels + 2 * c * frame->pitch;
+			Pixel* top = bottom + frame->pitch;
+			int line = terminal.rows - 1 - c;
+			for (int x = r.x0; x < x1; x++) {
+				int fg = terminal_color(Format::unpack(top[x])), bg = terminal_color(Format::unpack(bottom[x]));
+				u16 cell = (u16)(fg << 8 | bg);
+				u16* cached = &terminal.cells[line * terminal.columns + x];
+				if (*cached == cell) continue;
+				*cached = cell;
+
+				cchar_t character;
+				wchar_t text[2] = { L'\x2580', 0 }; // Upper half block
+				short pair = 0;
+				if (terminal.colors > 2) pair = (short)(1 + fg * terminal.colors + bg);
+				else if (!fg) text[0] = bg ? L'\x2584' : L' '; // Lower half block
+				else if (bg) text[0] = L'\x2588'; // Full block
+				setcchar(&character, text, 0, pair, 0);
+				mvadd_wch(line, x, &character);
+			}
+		}
+	}
+}
+
+internal void
+terminal_present(void* memory, Present_Frame* frame, void* context) {
+	if (!terminal.cells) return;
+	if (render_state.format == PIXEL_RGB565) terminal_present_format<Format_RGB565>(memory, frame);
+	else terminal_present_format<Format_XRGB8888>(memory, frame);
+	refresh();
+}
+
+internal int
+terminal_button_for_key(int key) {
+	switch (key) {
+		case KEY_UP: return BUTTON_UP;
+		case KEY_DOWN: return BUTTON_DOWN;
+		case 'w': case 'W': return BUTTON_W;
+		case 's': case 'S': return BUTTON_S;
+		case KEY_LEFT: return BUTTON_LEFT;
+		case KEY_RIGHT: return BUTTON_RIGHT;
+		case '\n': case '\r': case KEY_ENTER: return BUTTON_ENTER;
+		case KEY_F(3): return BUTTON_F3;
+	}
+	return -1;
+}
+
+internal void
+terminal_push(int button, bool is_down, double time) {
+	Input_Event event;
+	event.time = time;
+	event.button = (u8)button;
+	event.is_down = is_down;
+	input_queue_push(&input_queue, event);
+}
+
+// Reads every key that is waiting. q quits; Escape alone can't be told from
+// the start of a key the terminfo entry doesn't know.
+internal void
+terminal_process_input() {
+	double now = present_clock();
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		if (terminal.release_at[i] && terminal.release_at[i] <= now) {
+			terminal_push(i, false, terminal.release_at[i]);
+			terminal.release_at[i] = 0;
+		}
+	}
+
+	for (int key; (key = getch()) != ERR;) {
+		if (key == 'q') running = false;
+		if (key == KEY_RESIZE) terminal_resize_frame_buffers();
+		int button = terminal_button_for_key(key);
+		if (button < 0) continue;
+		if (terminal.release_at[button]) {
+			terminal.release_at[button] = now + TERMINAL_REPEAT;
+		} else {
+			terminal_push(button, true, now);
+			terminal.release_at[button] = now + TERMINAL_FIRST_REPEAT;
+		}
+	}
+}
+
+internal void
+shutdown_terminal() {
+	endwin();
+	free(terminal.cells);
+	free(terminal.memory);
+}
@@ -0,0 +1,155 @@
+// Non-blocking UDP sockets for net_rollback.cpp.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+struct Net_Socket {
+	int fd;
+};
+
+// Port 0 takes any free port.
+internal bool
+open_net_socket(Net_Socket* s, u16 port) {
+	s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s->fd < 0) return false;
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(s->fd, (sockaddr*)&address, sizeof(address)) < 0 || fcntl(s->fd, F_SETFL, O_NONBLOCK) < 0) {
+		close(s->fd);
+		s->fd = -1;
+		return false;
+	}
+	return true;
+}
+
+// For sockets that take bursts, like the server's.
+internal void
+net_socket_set_buffers(Net_Socket* s, int bytes) {
+	setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+	setsockopt(s->fd, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes));
+}
+
+internal void
+close_net_socket(Net_Socket* s) {
+	if (s->fd >= 0) close(s->fd);
+	s->fd = -1;
+}
+
+internal void
+net_socket_send(Net_Socket* s, Net_Address to, void* data, int size) {
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(to.ip);
+	address.sin_port = htons(to.port);
+	sendto(s->fd, data, size, 0, (sockaddr*)&address, sizeof(address));
+}
+
+// Bytes of the next datagram, or -1 when none is waiting.
+internal int
+net_socket_receive(Net_Socket* s, Net_Address* from, void* buffer, int size) {
+	sockaddr_in address;
+	for (;;) {
+		socklen_t length = sizeof(address);
+		ssize_t result = recvfrom(s->fd, buffer, size, 0, (sockaddr*)&address, &length);
+		if (result < 0 && errno == EINTR) continue;
+		if (result < 0) return -1;
+		from->ip = ntohl(address.sin_addr.s_addr);
+		from->port = ntohs(address.sin_port);
+		return (int)result;
+	}
+}
+
+internal bool
+net_resolve(const char* name, u16 port, Net_Address* result) {
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* info;
+	if (getaddrinfo(name, 0, &hints, &info) != 0) return false;
+	result->ip = ntohl(((sockaddr_in*)info->ai_addr)->sin_addr.s_addr);
+	result->port = port;
+	freeaddrinfo(info);
+	return true;
+}
+
+// A datagram for the batch calls. data has room for size bytes; a receive
+// sets size to what arrived.
+struct Net_Datagram {
+	Net_Address address;
+	int size;
+	u8* data;
+};
+
+#define NET_BATCH 64 // Datagrams per system call
+
+// Queues all of them, NET_BATCH per sendmmsg. Returns how many went out.
+internal int
+net_socket_send_batch(Net_Socket* s, Net_Datagram* datagrams, int count) {
+	mmsghdr messages[NET_BATCH];
+	iovec vectors[NET_BATCH];
+	sockaddr_in addresses[NET_BATCH];
+	int sent = 0;
+	while (sent < count) {
+		int n = count - sent < NET_BATCH ? count - sent : NET_BATCH;
+		for (int i = 0; i < n; i++) {
+			Net_Datagram* d = &datagrams[sent + i];
+			addresses[i] = {};
+			addresses[i].sin_family = AF_INET;
+			addresses[i].sin_addr.s_addr = htonl(d->address.ip);
+			addresses[i].sin_port = htons(d->address.port);
+			vectors[i].iov_base = d->data;
+			vectors[i].iov_len = d->size;
+			messages[i] = {};
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+		int result = sendmmsg(s->fd, messages, n, 0);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) break; // A full send buffer drops the rest, like a lost packet
+		sent += result;
+	}
+	return sent;
+}
+
+// Up to count waiting datagrams, NET_BATCH per recvmmsg. Returns how many.
+internal int
+net_socket_receive_batch(Net_Socket* s, Net_Datagram* datagrams, int count) {
+	mmsghdr messages[NET_BATCH];
+	iovec vectors[NET_BATCH];
+	sockaddr_in addresses[NET_BATCH];
+	int received = 0;
+	while (received < count) {
+		int n = count - received < NET_BATCH ? count - received : NET_BATCH;
+		for (int i = 0; i < n; i++) {
+			Net_Datagram* d = &datagrams[received + i];
+			vectors[i].iov_base = d->data;
+			vectors[i].iov_len = d->size;
+			messages[i] = {};
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+		int result = recvmmsg(s->fd, messages, n, MSG_DONTWAIT, 0);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) break;
+		for (int i = 0; i < result; i++) {
+			Net_Datagram* d = &datagrams[received + i];
+			d->address.ip = ntohl(addresses[i].sin_addr.s_addr);
+			d->address.port = ntohs(addresses[i].sin_port);
+			d->size = (int)messages[i].msg_len;
+		}
+		received += result;
+		if (result < n) break;
+	}
+	return received;
+}
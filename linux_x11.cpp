@@ -0,0 +1,297 @@
+// X11 presenter. The frame buffers are MIT-SHM segments the X server reads
+// straight from, so a present copies nothing on our side; each dirty rect is
+// sent as XShmPutImage requests and XSync waits until the server has read them,
+// after which the buffer can be rendered into again. Without MIT-SHM (a remote
+// display) the same rects go through XPutImage over the socket.
+// The frame is stored bottom row first and X images are top row first, so
+// every row is its own request. The requests are small; the pixels stay put.
+// The server can't scale a put, so this presenter always renders at window
+// resolution and ignores -res.
+// The present thread has its own connection, the main thread's only handles
+// events. Both are only used by the other thread while the buffers are drained.
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+// XKBstr.h has a field called internal
+#pragma push_macro("internal")
+#undef internal
+#include <X11/XKBlib.h>
+#pragma pop_macro("internal")
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+
+struct X11_Window {
+	Display* display; // Events, main thread
+	Display* present_display;
+	Window window;
+	GC gc; // On present_display
+	Atom wm_delete_window;
+	Visual* visual;
+	int depth;
+	int width, height;
+
+	bool shm;
+	XShmSegmentInfo segments[MAX_FRAME_BUFFERS];
+	u8* memory[MAX_FRAME_BUFFERS]; // Without shm
+	XImage* images[MAX_FRAME_BUFFERS];
+	size_t reserved; // Per buffer
+};
+
+global_variable X11_Window x11;
+global_variable bool x11_attach_failed;
+
+// XShmAttach fails asynchronously when the server can't map the segment, which
+// would otherwise end the process.
+internal int
+x11_attach_error(Display* display, XErrorEvent* error) {
+	x11_attach_failed = true;
+	return 0;
+}
+
+internal bool
+x11_init(int width, int height) {
+	XInitThreads();
+	x11.display = XOpenDisplay(0);
+	if (!x11.display) return false;
+	x11.present_display = XOpenDisplay(DisplayString(x11.display));
+	if (!x11.present_display) {
+		XCloseDisplay(x11.display);
+		x11.display = 0;
+		return false;
+	}
+
+	// The renderer writes 0x00RRGGBB words, which is what a 24 bit TrueColor
+	// visual with these masks reads from a 32 bit ZPixmap.
+	int screen = DefaultScreen(x11.display);
+	XVisualInfo info;
+	if (!XMatchVisualInfo(x11.display, screen, 24, TrueColor, &info) ||
+		info.red_mask != 0xff0000 || info.green_mask != 0xff00 || info.blue_mask != 0xff) {
+		XCloseDisplay(x11.present_display);
+		XCloseDisplay(x11.display);
+		x11.display = x11.present_display = 0;
+		return false;
+	}
+	x11.visual = info.visual;
+	x11.depth = info.depth;
+
+	XSetWindowAttributes attributes = {};
+	attributes.colormap = XCreateColormap(x11.display, RootWindow(x11.display, screen), x11.visual, AllocNone);
+	attributes.background_pixel = 0;
+	attributes.event_mask = KeyPressMask | KeyReleaseMask | StructureNotifyMask | ExposureMask | FocusChangeMask;
+	x11.window = XCreateWindow(x11.display, RootWindow(x11.display, screen), 0, 0, width, height, 0, x11.depth, InputOutput, x11.visual,
+		CWColormap | CWBackPixel | CWEventMask, &attributes);
+	XStoreName(x11.display, x11.window, "Pong - Tutorial");
+	x11.wm_delete_window = XInternAtom(x11.display, "WM_DELETE_WINDOW", False);
+	XSetWMProtocols(x11.display, x11.window, &x11.wm_delete_window, 1);
+
+	// Fullscreen, like the Win32 window
+	Atom state = XInternAtom(x11.display, "_NET_WM_STATE", False);
+	Atom fullscreen = XInternAtom(x11.display, "_NET_WM_STATE_FULLSCREEN", False);
+	XChangeProperty(x11.display, x11.window, state, XA_ATOM, 32, PropModeReplace, (unsigned char*)&fullscreen, 1);
+
+	// Held keys repeat as presses only, without a release before each
+	XkbSetDetectableAutoRepeat(x11.display, True, 0);
+	XDefineCursor(x11.display, x11.window, None);
+	XMapWindow(x11.display, x11.window);
+	XSync(x11.display, False);
+
+	x11.gc = XCreateGC(x11.present_display, x11.window, 0, 0);
+	x11.shm = XShmQueryExtension(x11.present_display);
+	x11.width = width;
+	x11.height = height;
+	return true;
+}
+
+internal void
+x11_release_frame_memory() {
+	for (int i = 0; i < MAX_FRAME_BUFFERS; i++) {
+		if (x11.images[i]) {
+			if (!x11.shm) x11.images[i]->data = 0; // Not XDestroyImage's to free
+			XDestroyImage(x11.images[i]);
+			x11.images[i] = 0;
+		}
+		if (x11.segments[i].shmaddr) {
+			XShmDetach(x11.present_display, &x11.segments[i]);
+			shmdt(x11.segments[i].shmaddr);
+			x11.segments[i] = {};
+		}
+		if (x11.memory[i]) munmap(x11.memory[i], x11.reserved);
+		x11.memory[i] = 0;
+	}
+	XSync(x11.present_display, False);
+	x11.reserved = 0;
+}
+
+// Every buffer gets room for a frame as big as the screen once. Pages only get
+// memory when they are first written, so a small window doesn't cost a big
+// one's worth.
+internal bool
+x11_reserve_frame_memory(size_t size) {
+	Screen* screen = DefaultScreenOfDisplay(x11.display);
+	size_t screen_size = (size_t)frame_pitch(WidthOfScreen(screen)) * HeightOfScreen(screen) * sizeof(u32);
+	if (size < screen_size) size = screen_size;
+
+	for (int i = 0; i < frame_buffers.count; i++) {
+		if (x11.shm) {
+			XShmSegmentInfo* segment = &x11.segments[i];
+			segment->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+			if (segment->shmid < 0) return false;
+			segment->shmaddr = (char*)shmat(segment->shmid, 0, 0);
+			segment->readOnly = True;
+			x11_attach_failed = false;
+			XErrorHandler handler = XSetErrorHandler(x11_attach_error);
+			bool attached = segment->shmaddr != (char*)-1 && XShmAttach(x11.present_display, segment);
+			XSync(x11.present_display, False);
+			XSetErrorHandler(handler);
+			// Gone once both sides detach
+			shmctl(segment->shmid, IPC_RMID, 0);
+			if (!attached || x11_attach_failed) {
+				if (segment->shmaddr != (char*)-1) shmdt(segment->shmaddr);
+				*segment = {};
+				return false;
+			}
+			frame_buffers.memory[i] = segment->shmaddr;
+		} else {
+			void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (memory == MAP_FAILED) return false;
+			x11.memory[i] = (u8*)memory;
+			frame_buffers.memory[i] = memory;
+		}
+	}
+	x11.reserved = size;
+	return true;
+}
+
+internal void
+x11_resize_frame_buffers() {
+	// The present thread may still be reading the old buffers.
+	frame_buffers_drain();
+	frame_buffers_layout(x11.width, x11.height, 0, UPSCALE_INTEGER);
+
+	size_t size = (size_t)render_state.pitch * render_state.height * sizeof(u32);
+	if (size > x11.reserved) {
+		x11_release_frame_memory();
+		if (!x11_reserve_frame_memory(size) && x11.shm) {
+			// Segments ran out; the socket still works.
+			x11_release_frame_memory();
+			x11.shm = false;
+			x11_reserve_frame_memory(size);
+		}
+		if (!x11.reserved) {
+			// Out of address space. Nothing gets drawn while the loop winds down.
+			render_state.width = render_state.height = 0;
+			running = false;
+		}
+	}
+
+	// The images are only headers over the buffers, pitch pixels wide.
+	for (int i = 0; i < frame_buffers.count && x11.reserved; i++) {
+		if (x11.images[i]) {
+			if (!x11.shm) x11.images[i]->data = 0;
+			XDestroyImage(x11.images[i]);
+		}
+		if (x11.shm) {
+			x11.images[i] = XShmCreateImage(x11.present_display, x11.visual, x11.depth, ZPixmap, x11.segments[i].shmaddr,
+				&x11.segments[i], render_state.pitch, render_state.height);
+		} else {
+			x11.images[i] = XCreateImage(x11.present_display, x11.visual, x11.depth, ZPixmap, 0, (char*)x11.memory[i],
+				render_state.pitch, render_state.height, 32, render_state.pitch * sizeof(u32));
+		}
+	}
+
+	frame_buffers_resized();
+	rebuild_viewport_transform();
+	rebuild_glyph_atlas();
+}
+
+internal void
+x11_present(void* memory, Present_Frame* frame, void* context) {
+	X11_Window* w = (X11_Window*)context;
+	XImage* image = 0;
+	for (int i = 0; i < frame_buffers.count; i++) {
+		if (frame_buffers.memory[i] == memory) image = w->images[i];
+	}
+	if (!image) return;
+
+	for (int i = 0; i < frame->rects.count; i++) {
+		Pixel_Rect r = frame->rects.rects[i];
+		for (int y = r.y0; y < r.y1; y++) {
+			int dest_y = frame->window_height - 1 - y;
+			if (w->shm) XShmPutImage(w->present_display, w->window, w->gc, image, r.x0, y, r.x0, dest_y, r.x1 - r.x0, 1, False);
+			else XPutImage(w->present_display, w->window, w->gc, image, r.x0, y, r.x0, dest_y, r.x1 - r.x0, 1);
+		}
+	}
+	XSync(w->present_display, False);
+}
+
+internal int
+x11_button_for_key(KeySym key) {
+	switch (key) {
+		case XK_Up: return BUTTON_UP;
+		case XK_Down: return BUTTON_DOWN;
+		case XK_w: return BUTTON_W;
+		case XK_s: return BUTTON_S;
+		case XK_Left: return BUTTON_LEFT;
+		case XK_Right: return BUTTON_RIGHT;
+		case XK_Return: return BUTTON_ENTER;
+		case XK_F3: return BUTTON_F3;
+	}
+	return -1;
+}
+
+// Handles everything that is queued. Server timestamps are in milliseconds on
+// another clock, so events are stamped when they are read.
+internal void
+x11_process_events(bool* focus_lost) {
+	while (XPending(x11.display)) {
+		XEvent event;
+		XNextEvent(x11.display, &event);
+		switch (event.type) {
+			case KeyPress:
+			case KeyRelease: {
+				int button = x11_button_for_key(XLookupKeysym(&event.xkey, 0));
+				if (button < 0) break;
+				Input_Event input_event;
+				input_event.time = present_clock();
+				input_event.button = (u8)button;
+				input_event.is_down = event.type == KeyPress;
+				input_queue_push(&input_queue, input_event);
+			} break;
+
+			case ConfigureNotify: {
+				if (event.xconfigure.width != x11.width || event.xconfigure.height != x11.height) {
+					x11.width = event.xconfigure.width;
+					x11.height = event.xconfigure.height;
+					x11_resize_frame_buffers();
+				}
+			} break;
+
+			case Expose: {
+				// Parts of the window were uncovered, present the whole frame next time.
+				if (event.xexpose.count == 0) invalidate_frame();
+			} break;
+
+			case FocusOut: {
+				*focus_lost = true;
+			} break;
+
+			case ClientMessage: {
+				if ((Atom)event.xclient.data.l[0] == x11.wm_delete_window) running = false;
+			} break;
+		}
+	}
+}
+
+// After shutdown_frame_buffers.
+internal void
+shutdown_x11() {
+	x11_release_frame_memory();
+	XFreeGC(x11.present_display, x11.gc);
+	XCloseDisplay(x11.present_display);
+	XDestroyWindow(x11.display, x11.window);
+	XCloseDisplay(x11.display);
+}
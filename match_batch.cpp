@@ -0,0 +1,362 @@
+// Many matches stepped together. Match_Batch keeps every Match field in its own
+// array and simulate_match_batch steps four matches per SSE2 lane group: the
+// paddles, then up to MAX_BALL_BOUNCES ball contacts, all with selects instead
+// of branches. It is simulate_match done with the same operations in the same
+// order, so a match gives the same result in a batch as on its own. Leftover
+// matches, and builds without SSE2, run simulate_match directly.
+// Batches keep no previous positions, they are for matches nobody renders.
+
+#include <stdlib.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define MATCH_BATCH_SSE2 1
+#include <emmintrin.h>
+#else
+#define MATCH_BATCH_SSE2 0
+#endif
+
+struct Match_Batch {
+	int count;
+
+	float* player_1_p;
+	float* player_1_dp;
+	float* player_2_p;
+	float* player_2_dp;
+	float* ball_p_x;
+	float* ball_p_y;
+	float* ball_dp_x;
+	float* ball_dp_y;
+	int* player_1_score;
+	int* player_2_score;
+
+	void* memory;
+};
+
+#define MATCH_BATCH_ARRAYS 10
+
+internal void
+match_batch_set(Match_Batch* batch, int i, Match* match) {
+	batch->player_1_p[i] = match->player_1_p;
+	batch->player_1_dp[i] = match->player_1_dp;
+	batch->player_2_p[i] = match->player_2_p;
+	batch->player_2_dp[i] = match->player_2_dp;
+	batch->ball_p_x[i] = match->ball_p_x;
+	batch->ball_p_y[i] = match->ball_p_y;
+	batch->ball_dp_x[i] = match->ball_dp_x;
+	batch->ball_dp_y[i] = match->ball_dp_y;
+	batch->player_1_score[i] = match->player_1_score;
+	batch->player_2_score[i] = match->player_2_score;
+}
+
+// The previous positions come back equal to the current ones.
+internal void
+match_batch_get(Match_Batch* batch, int i, Match* match) {
+	match->player_1_p = match->prev_player_1_p = batch->player_1_p[i];
+	match->player_1_dp = batch->player_1_dp[i];
+	match->player_2_p = match->prev_player_2_p = batch->player_2_p[i];
+	match->player_2_dp = batch->player_2_dp[i];
+	match->ball_p_x = match->prev_ball_p_x = batch->ball_p_x[i];
+	match->ball_p_y = match->prev_ball_p_y = batch->ball_p_y[i];
+	match->ball_dp_x = batch->ball_dp_x[i];
+	match->ball_dp_y = batch->ball_dp_y[i];
+	match->player_1_score = batch->player_1_score[i];
+	match->player_2_score = batch->player_2_score[i];
+}
+
+// Every match starts like init_match.
+internal bool
+match_batch_alloc(Match_Batch* batch, int count) {
+	// Each array starts on its own cache line.
+	size_t stride = ((size_t)count * 4 + 63) & ~(size_t)63;
+	u8* memory = (u8*)malloc(stride * MATCH_BATCH_ARRAYS + 63);
+	if (!memory) return false;
+
+	u8* base = (u8*)(((size_t)memory + 63) & ~(size_t)63);
+	batch->memory = memory;
+	batch->count = count;
+	batch->player_1_p = (float*)(base + stride * 0);
+	batch->player_1_dp = (float*)(base + stride * 1);
+	batch->player_2_p = (float*)(base + stride * 2);
+	batch->player_2_dp = (float*)(base + stride * 3);
+	batch->ball_p_x = (float*)(base + stride * 4);
+	batch->ball_p_y = (float*)(base + stride * 5);
+	batch->ball_dp_x = (float*)(base + stride * 6);
+	batch->ball_dp_y = (float*)(base + stride * 7);
+	batch->player_1_score = (int*)(base + stride * 8);
+	batch->player_2_score = (int*)(base + stride * 9);
+
+	Match match;
+	init_match(&match);
+	for (int i = 0; i < count; i++) match_batch_set(batch, i, &match);
+	return true;
+}
+
+internal void
+match_batch_free(Match_Batch* batch) {
+	free(batch->memory);
+	*batch = {};
+}
+
+#if MATCH_BATCH_SSE2
+
+inline __m128
+select_ps(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128
+abs_ps(__m128 a) {
+	return _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+}
+
+// -1 where mask is set, 1 elsewhere.
+inline __m128
+sign_ps(__m128 mask) {
+	return select_ps(mask, _mm_set1_ps(-1.f), _mm_set1_ps(1.f));
+}
+
+struct Sweep_Hit_4 {
+	__m128 hit;
+	__m128 t;
+	__m128 normal_x, normal_y;
+};
+
+// sweep_aabb for four lanes, box 1 is the ball.
+inline Sweep_Hit_4
+sweep_aabb_4(__m128 p1x, __m128 p1y, __m128 hs1, __m128 dx, __m128 dy,
+	__m128 p2x, __m128 p2y, __m128 hs2x, __m128 hs2y) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.f);
+	__m128 ex = _mm_add_ps(hs1, hs2x);
+	__m128 ey = _mm_add_ps(hs1, hs2y);
+
+	__m128 overlap = _mm_and_ps(
+		_mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(p1x, hs1), _mm_sub_ps(p2x, hs2x)), _mm_cmplt_ps(_mm_sub_ps(p1x, hs1), _mm_add_ps(p2x, hs2x))),
+		_mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(p1y, hs1), _mm_sub_ps(p2y, hs2y)), _mm_cmplt_ps(_mm_sub_ps(p1y, hs1), _mm_add_ps(p2y, hs2y))));
+	__m128 distance_x = abs_ps(_mm_sub_ps(p1x, p2x));
+	__m128 distance_y = abs_ps(_mm_sub_ps(p1y, p2y));
+	__m128 least_x = _mm_cmple_ps(_mm_sub_ps(ex, distance_x), _mm_sub_ps(ey, distance_y));
+
+	__m128 moving_x = _mm_cmpneq_ps(dx, zero);
+	__m128 sdx = select_ps(moving_x, dx, one);
+	__m128 tx0 = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(p2x, ex), p1x), sdx);
+	__m128 tx1 = _mm_div_ps(_mm_sub_ps(_mm_add_ps(p2x, ex), p1x), sdx);
+	__m128 x_order = _mm_cmplt_ps(tx0, tx1);
+	__m128 entry_x = select_ps(moving_x, select_ps(x_order, tx0, tx1), _mm_set1_ps(-1e30f));
+	__m128 exit_x = select_ps(moving_x, select_ps(x_order, tx1, tx0), _mm_set1_ps(1e30f));
+	__m128 miss_x = _mm_andnot_ps(moving_x, _mm_cmpge_ps(distance_x, ex));
+
+	__m128 moving_y = _mm_cmpneq_ps(dy, zero);
+	__m128 sdy = select_ps(moving_y, dy, one);
+	__m128 ty0 = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(p2y, ey), p1y), sdy);
+	__m128 ty1 = _mm_div_ps(_mm_sub_ps(_mm_add_ps(p2y, ey), p1y), sdy);
+	__m128 y_order = _mm_cmplt_ps(ty0, ty1);
+	__m128 entry_y = select_ps(moving_y, select_ps(y_order, ty0, ty1), _mm_set1_ps(-1e30f));
+	__m128 exit_y = select_ps(moving_y, select_ps(y_order, ty1, ty0), _mm_set1_ps(1e30f));
+	__m128 miss_y = _mm_andnot_ps(moving_y, _mm_cmpge_ps(distance_y, ey));
+
+	__m128 along_x = _mm_cmpgt_ps(entry_x, entry_y);
+	__m128 entry = select_ps(along_x, entry_x, entry_y);
+	__m128 exit = select_ps(_mm_cmplt_ps(exit_x, exit_y), exit_x, exit_y);
+	__m128 miss = _mm_or_ps(_mm_or_ps(miss_x, miss_y),
+		_mm_or_ps(_mm_cmpgt_ps(entry, exit), _mm_or_ps(_mm_cmplt_ps(entry, zero), _mm_cmpgt_ps(entry, one))));
+	__m128 swept = _mm_andnot_ps(overlap, _mm_andnot_ps(miss, _mm_cmpeq_ps(zero, zero)));
+
+	__m128 use_x = select_ps(overlap, least_x, along_x);
+	__m128 normal_x = select_ps(overlap, sign_ps(_mm_cmplt_ps(p1x, p2x)), sign_ps(_mm_cmpgt_ps(dx, zero)));
+	__m128 normal_y = select_ps(overlap, sign_ps(_mm_cmplt_ps(p1y, p2y)), sign_ps(_mm_cmpgt_ps(dy, zero)));
+
+	Sweep_Hit_4 result;
+	result.hit = _mm_or_ps(overlap, swept);
+	result.t = _mm_and_ps(swept, entry);
+	result.normal_x = _mm_and_ps(result.hit, _mm_and_ps(use_x, normal_x));
+	result.normal_y = _mm_and_ps(result.hit, _mm_andnot_ps(use_x, normal_y));
+	return result;
+}
+
+// sweep_plane for four lanes. Returns the lanes that get there, with the time in *t.
+inline __m128
+sweep_plane_4(__m128 p, __m128 d, __m128 limit, __m128* t) {
+	__m128 zero = _mm_setzero_ps();
+	__m128 ahead = select_ps(_mm_cmpgt_ps(d, zero), _mm_cmplt_ps(p, limit), _mm_cmpgt_ps(p, limit));
+	__m128 moving = _mm_cmpneq_ps(d, zero);
+	__m128 time = _mm_div_ps(_mm_sub_ps(limit, p), select_ps(moving, d, _mm_set1_ps(1.f)));
+	*t = _mm_and_ps(ahead, time);
+	return _mm_andnot_ps(_mm_and_ps(ahead, _mm_cmpgt_ps(time, _mm_set1_ps(1.f))), moving);
+}
+
+// simulate_player for four lanes.
+inline void
+simulate_player_4(float* p_lanes, float* dp_lanes, const float* ddp_lanes, __m128 dt) {
+	__m128 p = _mm_loadu_ps(p_lanes);
+	__m128 dp = _mm_loadu_ps(dp_lanes);
+	__m128 ddp = _mm_sub_ps(_mm_loadu_ps(ddp_lanes), _mm_mul_ps(dp, _mm_set1_ps(10.f)));
+
+	p = _mm_add_ps(_mm_add_ps(p, _mm_mul_ps(dp, dt)), _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(ddp, dt), dt), _mm_set1_ps(.5f)));
+	dp = _mm_add_ps(dp, _mm_mul_ps(ddp, dt));
+
+	__m128 paddle_y = _mm_set1_ps(player_half_size_y);
+	__m128 top = _mm_cmpgt_ps(_mm_add_ps(p, paddle_y), _mm_set1_ps(arena_half_size_y));
+	__m128 bottom = _mm_andnot_ps(top, _mm_cmplt_ps(_mm_sub_ps(p, paddle_y), _mm_set1_ps(-arena_half_size_y)));
+	p = select_ps(top, _mm_set1_ps(arena_half_size_y - player_half_size_y), p);
+	p = select_ps(bottom, _mm_set1_ps(-arena_half_size_y + player_half_size_y), p);
+	dp = _mm_andnot_ps(_mm_or_ps(top, bottom), dp);
+
+	_mm_storeu_ps(p_lanes, p);
+	_mm_storeu_ps(dp_lanes, dp);
+}
+
+// One tick of matches [i, i + 4): the paddles, then every ball contact.
+internal void
+simulate_matches_4(Match_Batch* b, int i, const float* player_1_ddp, const float* player_2_ddp, float dt) {
+	__m128 dt4 = _mm_set1_ps(dt);
+	simulate_player_4(b->player_1_p + i, b->player_1_dp + i, player_1_ddp + i, dt4);
+	simulate_player_4(b->player_2_p + i, b->player_2_dp + i, player_2_ddp + i, dt4);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 sign = _mm_set1_ps(-0.f);
+	__m128 ball_size = _mm_set1_ps(ball_half_size);
+	__m128 paddle_x = _mm_set1_ps(player_half_size_x);
+	__m128 paddle_y = _mm_set1_ps(player_half_size_y);
+	__m128 arena_y = _mm_set1_ps(arena_half_size_y);
+	__m128 top_limit = _mm_set1_ps(arena_half_size_y - ball_half_size);
+	__m128 bottom_limit = _mm_set1_ps(-arena_half_size_y + ball_half_size);
+	__m128 right_limit = _mm_set1_ps(arena_half_size_x - ball_half_size);
+	__m128 left_limit = _mm_set1_ps(-arena_half_size_x + ball_half_size);
+	__m128 right_x = _mm_set1_ps(80.f);
+	__m128 left_x = _mm_set1_ps(-80.f);
+
+	__m128 p1 = _mm_loadu_ps(b->player_1_p + i), dp1 = _mm_loadu_ps(b->player_1_dp + i);
+	__m128 p2 = _mm_loadu_ps(b->player_2_p + i), dp2 = _mm_loadu_ps(b->player_2_dp + i);
+	__m128 px = _mm_loadu_ps(b->ball_p_x + i), py = _mm_loadu_ps(b->ball_p_y + i);
+	__m128 vx = _mm_loadu_ps(b->ball_dp_x + i), vy = _mm_loadu_ps(b->ball_dp_y + i);
+	__m128i score_1 = _mm_loadu_si128((__m128i*)(b->player_1_score + i));
+	__m128i score_2 = _mm_loadu_si128((__m128i*)(b->player_2_score + i));
+
+	__m128 remaining = dt4;
+	__m128 active = _mm_cmpgt_ps(remaining, zero);
+	for (int bounce = 0; bounce < MAX_BALL_BOUNCES && _mm_movemask_ps(active); bounce++) {
+		__m128 dx = _mm_mul_ps(vx, remaining);
+		__m128 dy = _mm_mul_ps(vy, remaining);
+
+		Sweep_Hit_4 paddle_1 = sweep_aabb_4(px, py, ball_size, dx, dy, right_x, p1, paddle_x, paddle_y);
+		Sweep_Hit_4 paddle_2 = sweep_aabb_4(px, py, ball_size, dx, dy, left_x, p2, paddle_x, paddle_y);
+
+		// Tested in simulate_match's order, against the earliest contact so far.
+		__m128 hit_t = _mm_set1_ps(1.f);
+		__m128 toward = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(vx, paddle_1.normal_x), _mm_mul_ps(_mm_sub_ps(vy, dp1), paddle_1.normal_y)), zero);
+		__m128 hit_1 = _mm_and_ps(_mm_and_ps(paddle_1.hit, _mm_cmple_ps(paddle_1.t, hit_t)), toward);
+		hit_t = select_ps(hit_1, paddle_1.t, hit_t);
+
+		toward = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(vx, paddle_2.normal_x), _mm_mul_ps(_mm_sub_ps(vy, dp2), paddle_2.normal_y)), zero);
+		__m128 hit_2 = _mm_and_ps(_mm_and_ps(paddle_2.hit, _mm_cmple_ps(paddle_2.t, hit_t)), toward);
+		hit_t = select_ps(hit_2, paddle_2.t, hit_t);
+
+		__m128 t;
+		__m128 hit_top = _mm_and_ps(sweep_plane_4(py, dy, top_limit, &t), _mm_cmpgt_ps(dy, zero));
+		hit_top = _mm_and_ps(hit_top, _mm_cmplt_ps(t, hit_t));
+		hit_t = select_ps(hit_top, t, hit_t);
+
+		__m128 hit_bottom = _mm_and_ps(sweep_plane_4(py, dy, bottom_limit, &t), _mm_cmplt_ps(dy, zero));
+		hit_bottom = _mm_and_ps(hit_bottom, _mm_cmplt_ps(t, hit_t));
+		hit_t = select_ps(hit_bottom, t, hit_t);
+
+		__m128 goal_1 = _mm_and_ps(sweep_plane_4(px, dx, right_limit, &t), _mm_cmpgt_ps(dx, zero));
+		goal_1 = _mm_and_ps(goal_1, _mm_cmplt_ps(t, hit_t));
+		hit_t = select_ps(goal_1, t, hit_t);
+
+		__m128 goal_2 = _mm_and_ps(sweep_plane_4(px, dx, left_limit, &t), _mm_cmplt_ps(dx, zero));
+		goal_2 = _mm_and_ps(goal_2, _mm_cmplt_ps(t, hit_t));
+		hit_t = select_ps(goal_2, t, hit_t);
+
+		// The last test that passed wins, like the overwrites in simulate_match.
+		goal_1 = _mm_andnot_ps(goal_2, goal_1);
+		__m128 later = _mm_or_ps(goal_1, goal_2);
+		hit_bottom = _mm_andnot_ps(later, hit_bottom);
+		later = _mm_or_ps(later, hit_bottom);
+		hit_top = _mm_andnot_ps(later, hit_top);
+		later = _mm_or_ps(later, hit_top);
+		hit_2 = _mm_andnot_ps(later, hit_2);
+		later = _mm_or_ps(later, hit_2);
+		hit_1 = _mm_andnot_ps(later, hit_1);
+
+		__m128 new_px = _mm_add_ps(px, _mm_mul_ps(dx, hit_t));
+		__m128 new_py = _mm_add_ps(py, _mm_mul_ps(dy, hit_t));
+		__m128 new_remaining = _mm_sub_ps(remaining, _mm_mul_ps(remaining, hit_t));
+		__m128 new_vx = vx, new_vy = vy;
+
+		// Paddles, as bounce_off_paddle.
+		__m128 on_paddle = _mm_or_ps(hit_1, hit_2);
+		__m128 contact_x = select_ps(hit_1, paddle_1.normal_x, paddle_2.normal_x);
+		__m128 contact_y = select_ps(hit_1, paddle_1.normal_y, paddle_2.normal_y);
+		__m128 wall_x = select_ps(hit_1, right_x, left_x);
+		__m128 paddle_p = select_ps(hit_1, p1, p2);
+		__m128 paddle_dp = select_ps(hit_1, dp1, dp2);
+
+		__m128 side = _mm_cmpneq_ps(contact_y, zero);
+		__m128 side_y = _mm_add_ps(paddle_p, _mm_mul_ps(contact_y, _mm_add_ps(paddle_y, ball_size)));
+		__m128 room = _mm_cmple_ps(_mm_add_ps(abs_ps(side_y), ball_size), arena_y);
+		__m128 normal_x = select_ps(side, sign_ps(_mm_cmpgt_ps(wall_x, zero)), contact_x);
+		__m128 lift = _mm_and_ps(on_paddle, _mm_and_ps(side, room));
+		__m128 face = _mm_andnot_ps(lift, on_paddle);
+
+		__m128 face_x = _mm_add_ps(wall_x, _mm_mul_ps(normal_x, _mm_add_ps(paddle_x, ball_size)));
+		__m128 face_vx = _mm_mul_ps(normal_x, abs_ps(vx));
+		__m128 face_vy = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(new_py, paddle_p), _mm_set1_ps(2.f)), _mm_mul_ps(paddle_dp, _mm_set1_ps(.75f)));
+		__m128 lift_vy = _mm_add_ps(_mm_mul_ps(contact_y, abs_ps(_mm_sub_ps(vy, paddle_dp))), paddle_dp);
+
+		new_px = select_ps(face, face_x, new_px);
+		new_vx = select_ps(face, face_vx, new_vx);
+		new_vy = select_ps(face, face_vy, new_vy);
+		new_py = select_ps(lift, side_y, new_py);
+		new_vy = select_ps(lift, lift_vy, new_vy);
+
+		// Walls.
+		__m128 wall = _mm_or_ps(hit_top, hit_bottom);
+		new_py = select_ps(hit_top, top_limit, new_py);
+		new_py = select_ps(hit_bottom, bottom_limit, new_py);
+		new_vy = select_ps(wall, _mm_xor_ps(new_vy, sign), new_vy);
+
+		// Goals.
+		__m128 goal = _mm_or_ps(goal_1, goal_2);
+		new_vx = select_ps(goal, _mm_xor_ps(new_vx, sign), new_vx);
+		new_vy = _mm_andnot_ps(goal, new_vy);
+		new_px = _mm_andnot_ps(goal, new_px);
+		new_py = _mm_andnot_ps(goal, new_py);
+
+		// No contact or a goal ends the tick.
+		new_remaining = _mm_and_ps(_mm_or_ps(on_paddle, wall), new_remaining);
+
+		px = select_ps(active, new_px, px);
+		py = select_ps(active, new_py, py);
+		vx = select_ps(active, new_vx, vx);
+		vy = select_ps(active, new_vy, vy);
+		remaining = select_ps(active, new_remaining, remaining);
+		score_1 = _mm_sub_epi32(score_1, _mm_castps_si128(_mm_and_ps(active, goal_1)));
+		score_2 = _mm_sub_epi32(score_2, _mm_castps_si128(_mm_and_ps(active, goal_2)));
+		active = _mm_and_ps(active, _mm_cmpgt_ps(remaining, zero));
+	}
+
+	_mm_storeu_ps(b->ball_p_x + i, px);
+	_mm_storeu_ps(b->ball_p_y + i, py);
+	_mm_storeu_ps(b->ball_dp_x + i, vx);
+	_mm_storeu_ps(b->ball_dp_y + i, vy);
+	_mm_storeu_si128((__m128i*)(b->player_1_score + i), score_1);
+	_mm_storeu_si128((__m128i*)(b->player_2_score + i), score_2);
+}
+
+#endif
+
+internal void
+simulate_match_batch(Match_Batch* batch, const float* player_1_ddp, const float* player_2_ddp, float dt) {
+	int i = 0;
+#if MATCH_BATCH_SSE2
+	for (; i + 4 <= batch->count; i += 4) simulate_matches_4(batch, i, player_1_ddp, player_2_ddp, dt);
+#endif
+	for (; i < batch->count; i++) {
+		Match match;
+		match_batch_get(batch, i, &match);
+		simulate_match(&match, player_1_ddp[i], player_2_ddp[i], dt);
+		match_batch_set(batch, i, &match);
+	}
+}
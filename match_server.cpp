@@ -0,0 +1,893 @@
+// Dedicated match server: thousands of matches per node, each run by the
+// server alone with the clients sending only their paddle input.
+// Clients send SERVER_JOIN to the lobby port until they hear back. Every two
+// joins make a match, which goes to the shard with the fewest matches. The
+// shard sends both clients SERVER_ASSIGN with the match and its port until
+// their first SERVER_INPUT arrives, and SERVER_STATE -send_hz times a second.
+//
+// A shard is a thread pinned to one core with its own socket and its own
+// Match_Batch. It steps the whole batch every tick at SIM_HZ with
+// simulate_match_batch, reads input and sends state in batches (sendmmsg and
+// recvmmsg on Linux), and never locks: new matches come from the lobby through
+// a single producer, single consumer queue.
+//
+// Every second the server prints a line per shard and, with -metrics FILE,
+// rewrites FILE in the Prometheus text format (for node_exporter's textfile
+// collector): tick time percentiles, late ticks, matches and packets.
+// Ctrl+C, SIGINT or SIGTERM stops it after a last round of metrics.
+// -bots N adds N AI against AI matches, for load tests without clients; their
+// state goes to -bot_sink ADDRESS:PORT if there is one and -bot_ai LEVEL picks
+// how they play (see ai_opponent.cpp). -load N ADDRESS[:PORT]
+// runs N fake clients against a server instead of being one.
+// Build as its own console program:
+//   g++ -O2 -pthread match_server.cpp -o match_server        or        cl /O2 match_server.cpp
+// Usage: match_server [-port N] [-shards N] [-capacity N] [-send_hz N]
+//                     [-bots N] [-bot_sink ADDRESS:PORT] [-bot_ai LEVEL] [-metrics FILE]
+//        match_server -load N ADDRESS[:PORT]
+
+#include "utilis.cpp"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "platform_common.cpp"
+#if defined(_WIN32)
+#include "win32_udp.cpp"
+#else
+#include "linux_udp.cpp"
+#endif
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+
+#define SERVER_MAGIC 0x56525350 // "PSRV"
+#define SERVER_VERSION 1
+#define SERVER_DEFAULT_PORT 27200 // The lobby, shard i is on port + 1 + i
+#define SERVER_MAX_SHARDS 64
+#define SERVER_QUEUE_SIZE 1024 // Lobby to shard commands, power of two
+#define SERVER_TIMEOUT 10. // Seconds without input before a player is gone
+#define SERVER_SOCKET_BUFFER (4 * 1024 * 1024)
+#define POINTS_PER_MATCH 11
+
+enum {
+	SERVER_JOIN,
+	SERVER_ASSIGN,
+	SERVER_INPUT,
+	SERVER_STATE,
+	SERVER_END, // Same as SERVER_STATE, the last one of the match
+};
+
+// All packets, little endian.
+struct Server_Header {
+	u32 magic;
+	u8 version, type;
+	u16 reserved;
+};
+
+struct Server_Join {
+	Server_Header header;
+	u32 client; // Tells apart clients behind one address
+};
+
+struct Server_Assign {
+	Server_Header header;
+	u32 client;
+	u32 match;
+	u16 port; // Of the shard
+	u8 player; // 1 is the right paddle, 2 the left
+	u8 reserved;
+};
+
+struct Server_Input {
+	Server_Header header;
+	u32 match;
+	u32 sequence; // Older ones than the last are dropped
+	u8 player;
+	u8 up, down; // How much of the time the keys were held, in 255ths
+	u8 reserved;
+};
+
+struct Server_State {
+	Server_Header header;
+	u32 match;
+	u32 tick;
+	float player_1_p, player_2_p;
+	float ball_p_x, ball_p_y, ball_dp_x, ball_dp_y;
+	u8 player_1_score, player_2_score;
+	u8 reserved[2];
+};
+
+internal double
+seconds_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal Server_Header
+server_header(int type) {
+	Server_Header header = {SERVER_MAGIC, SERVER_VERSION, (u8)type, 0};
+	return header;
+}
+
+internal bool
+server_packet_valid(Net_Datagram* d, int size, int type) {
+	Server_Header* header = (Server_Header*)d->data;
+	return d->size >= size && header->magic == SERVER_MAGIC && header->version == SERVER_VERSION && header->type == type;
+}
+
+
+// Shards
+
+struct Server_Command {
+	Net_Address players[2];
+	u32 clients[2];
+	bool bot;
+};
+
+struct Server_Queue {
+	Server_Command commands[SERVER_QUEUE_SIZE];
+	std::atomic<u32> head, tail;
+};
+
+// One match of a shard. Kept in the same slot as its Match_Batch lanes.
+struct Server_Match {
+	u32 id;
+	bool bot;
+	Net_Address players[2];
+	u32 clients[2];
+	u32 sequence[2]; // 0 until the player's first input
+	double last_input[2];
+	float ddp[2];
+};
+
+// Ids stay the same when a match moves to another slot; the low 16 bits
+// index handles, the rest must match the handle's generation.
+struct Server_Handle {
+	int slot; // -1 when free
+	u32 generation;
+};
+
+struct Server_Metrics {
+	std::atomic<u64> ticks, late_ticks;
+	std::atomic<u64> packets_in, packets_out, dropped_out;
+	std::atomic<u64> matches_started, matches_finished;
+	std::atomic<int> match_count; // With the commands queued
+	// Of the last second of ticks, in microseconds
+	std::atomic<float> tick_p50, tick_p99, tick_max;
+};
+
+struct Server_Shard {
+	int index;
+	int core;
+	u16 port;
+	Net_Socket socket;
+	std::thread thread;
+	Server_Queue queue;
+	Server_Metrics metrics;
+
+	int capacity;
+	int count;
+	Match_Batch batch;
+	float* player_1_ddp;
+	float* player_2_ddp;
+	float* ai_1_ddp;
+	float* ai_2_ddp;
+	Server_Match* matches;
+	Server_Handle* handles;
+	int* free_handles;
+	int free_count;
+
+	Net_Datagram* datagrams; // For sends and receives, 4 per match
+	u8* packet_memory;
+	int datagram_capacity;
+};
+
+struct Server {
+	int shard_count;
+	Server_Shard* shards;
+	int send_every; // Ticks between states
+	Net_Address bot_sink;
+	bool has_bot_sink;
+	Ai_Level bot_ai;
+	std::atomic<bool> stop; // From the Ctrl+C and kill handlers
+};
+
+global_variable Server server;
+
+internal bool
+server_queue_push(Server_Queue* queue, Server_Command command) {
+	u32 tail = queue->tail.load(std::memory_order_relaxed);
+	if (tail - queue->head.load(std::memory_order_acquire) == SERVER_QUEUE_SIZE) return false;
+	queue->commands[tail & (SERVER_QUEUE_SIZE - 1)] = command;
+	queue->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+internal bool
+server_queue_pop(Server_Queue* queue, Server_Command* command) {
+	u32 head = queue->head.load(std::memory_order_relaxed);
+	if (head == queue->tail.load(std::memory_order_acquire)) return false;
+	*command = queue->commands[head & (SERVER_QUEUE_SIZE - 1)];
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+internal bool
+alloc_shard(Server_Shard* shard, int index, int capacity, u16 port) {
+	shard->index = index;
+	shard->capacity = capacity;
+	shard->port = port;
+	shard->count = 0;
+	if (!open_net_socket(&shard->socket, port)) return false;
+	net_socket_set_buffers(&shard->socket, SERVER_SOCKET_BUFFER);
+	if (!match_batch_alloc(&shard->batch, capacity)) return false;
+
+	shard->player_1_ddp = (float*)calloc(capacity, sizeof(float));
+	shard->player_2_ddp = (float*)calloc(capacity, sizeof(float));
+	shard->ai_1_ddp = (float*)calloc(capacity, sizeof(float));
+	shard->ai_2_ddp = (float*)calloc(capacity, sizeof(float));
+	shard->matches = (Server_Match*)calloc(capacity, sizeof(Server_Match));
+	shard->handles = (Server_Handle*)calloc(capacity, sizeof(Server_Handle));
+	shard->free_handles = (int*)calloc(capacity, sizeof(int));
+	shard->datagram_capacity = capacity * 4; // An assign and a state for both players
+	shard->datagrams = (Net_Datagram*)calloc(shard->datagram_capacity, sizeof(Net_Datagram));
+	shard->packet_memory = (u8*)calloc(shard->datagram_capacity, sizeof(Server_State));
+	if (!shard->player_1_ddp || !shard->player_2_ddp || !shard->ai_1_ddp || !shard->ai_2_ddp || !shard->matches ||
+		!shard->handles || !shard->free_handles || !shard->datagrams || !shard->packet_memory) return false;
+
+	for (int i = 0; i < capacity; i++) {
+		shard->handles[i].slot = -1;
+		shard->free_handles[i] = capacity - 1 - i;
+	}
+	shard->free_count = capacity;
+	return true;
+}
+
+internal void
+shard_add_match(Server_Shard* shard, Server_Command* command, double now) {
+	if (shard->count == shard->capacity) return; // The lobby only sends what fits
+	int slot = shard->count++;
+	int handle = shard->free_handles[--shard->free_count];
+	shard->handles[handle].slot = slot;
+
+	Server_Match* m = &shard->matches[slot];
+	*m = {};
+	m->id = shard->handles[handle].generation << 16 | (u32)handle;
+	m->bot = command->bot;
+	m->players[0] = command->players[0];
+	m->players[1] = command->players[1];
+	m->clients[0] = command->clients[0];
+	m->clients[1] = command->clients[1];
+	m->last_input[0] = m->last_input[1] = now;
+
+	Match match;
+	init_match(&match);
+	match_batch_set(&shard->batch, slot, &match);
+	shard->metrics.matches_started.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The last match moves into the slot, so the batch stays packed.
+internal void
+shard_remove_match(Server_Shard* shard, int slot) {
+	Server_Match* m = &shard->matches[slot];
+	int handle = (int)(m->id & 0xffff);
+	shard->handles[handle].slot = -1;
+	shard->handles[handle].generation = (shard->handles[handle].generation + 1) & 0xffff;
+	shard->free_handles[shard->free_count++] = handle;
+
+	int last = --shard->count;
+	if (slot != last) {
+		shard->matches[slot] = shard->matches[last];
+		Match match;
+		match_batch_get(&shard->batch, last, &match);
+		match_batch_set(&shard->batch, slot, &match);
+		shard->handles[shard->matches[slot].id & 0xffff].slot = slot;
+	}
+	shard->metrics.matches_finished.fetch_add(1, std::memory_order_relaxed);
+	shard->metrics.match_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+internal int
+shard_find(Server_Shard* shard, u32 id) {
+	// Ids come straight off the wire
+	if ((int)(id & 0xffff) >= shard->capacity) return -1;
+	Server_Handle* handle = &shard->handles[id & 0xffff];
+	if (handle->slot < 0 || handle->generation != id >> 16) return -1;
+	return handle->slot;
+}
+
+internal void
+shard_receive(Server_Shard* shard, double now) {
+	int capacity = shard->datagram_capacity < 1024 ? shard->datagram_capacity : 1024;
+	for (;;) {
+		for (int i = 0; i < capacity; i++) {
+			shard->datagrams[i].data = shard->packet_memory + i * sizeof(Server_State);
+			shard->datagrams[i].size = sizeof(Server_State);
+		}
+		int count = net_socket_receive_batch(&shard->socket, shard->datagrams, capacity);
+		shard->metrics.packets_in.fetch_add(count, std::memory_order_relaxed);
+		for (int i = 0; i < count; i++) {
+			Net_Datagram* d = &shard->datagrams[i];
+			if (!server_packet_valid(d, sizeof(Server_Input), SERVER_INPUT)) continue;
+			Server_Input* input = (Server_Input*)d->data;
+			int slot = shard_find(shard, input->match);
+			if (slot < 0 || input->player < 1 || input->player > 2) continue;
+
+			Server_Match* m = &shard->matches[slot];
+			int p = input->player - 1;
+			// Only the player's own address moves their paddle
+			if (d->address.ip != m->players[p].ip || d->address.port != m->players[p].port) continue;
+			if ((s32)(input->sequence - m->sequence[p]) <= 0 && m->sequence[p]) continue;
+			m->sequence[p] = input->sequence;
+			m->last_input[p] = now;
+			m->ddp[p] = 2000.f * (input->up - input->down) / 255.f;
+		}
+		if (count < capacity) break;
+	}
+}
+
+internal void
+shard_put_state(Server_Shard* shard, int* used, int slot, u32 tick, int type, Net_Address to) {
+	if (*used == shard->datagram_capacity) return;
+	Net_Datagram* d = &shard->datagrams[*used];
+	Server_State* state = (Server_State*)(shard->packet_memory + *used * sizeof(Server_State));
+	Match_Batch* b = &shard->batch;
+	state->header = server_header(type);
+	state->match = shard->matches[slot].id;
+	state->tick = tick;
+	state->player_1_p = b->player_1_p[slot];
+	state->player_2_p = b->player_2_p[slot];
+	state->ball_p_x = b->ball_p_x[slot];
+	state->ball_p_y = b->ball_p_y[slot];
+	state->ball_dp_x = b->ball_dp_x[slot];
+	state->ball_dp_y = b->ball_dp_y[slot];
+	state->player_1_score = (u8)b->player_1_score[slot];
+	state->player_2_score = (u8)b->player_2_score[slot];
+	state->reserved[0] = state->reserved[1] = 0;
+	d->address = to;
+	d->size = sizeof(Server_State);
+	d->data = (u8*)state;
+	(*used)++;
+}
+
+// Until the player's first input, which says the assign arrived.
+internal void
+shard_put_assigns(Server_Shard* shard, int* used, int slot) {
+	Server_Match* m = &shard->matches[slot];
+	for (int p = 0; p < 2; p++) {
+		if (m->sequence[p] || *used == shard->datagram_capacity) continue;
+		Net_Datagram* d = &shard->datagrams[*used];
+		Server_Assign* assign = (Server_Assign*)(shard->packet_memory + *used * sizeof(Server_State));
+		assign->header = server_header(SERVER_ASSIGN);
+		assign->client = m->clients[p];
+		assign->match = m->id;
+		assign->port = shard->port;
+		assign->player = (u8)(p + 1);
+		assign->reserved = 0;
+		d->address = m->players[p];
+		d->size = sizeof(Server_Assign);
+		d->data = (u8*)assign;
+		(*used)++;
+	}
+}
+
+internal int
+shard_put_match_states(Server_Shard* shard, int used, int slot, u32 tick, int type) {
+	Server_Match* m = &shard->matches[slot];
+	if (m->bot) {
+		if (server.has_bot_sink) shard_put_state(shard, &used, slot, tick, type, server.bot_sink);
+	} else {
+		if (type == SERVER_STATE) shard_put_assigns(shard, &used, slot);
+		shard_put_state(shard, &used, slot, tick, type, m->players[0]);
+		shard_put_state(shard, &used, slot, tick, type, m->players[1]);
+	}
+	return used;
+}
+
+internal void
+shard_send(Server_Shard* shard, int count) {
+	if (!count) return;
+	int sent = net_socket_send_batch(&shard->socket, shard->datagrams, count);
+	shard->metrics.packets_out.fetch_add(sent, std::memory_order_relaxed);
+	shard->metrics.dropped_out.fetch_add(count - sent, std::memory_order_relaxed);
+}
+
+internal void
+pin_thread(std::thread* thread, int core) {
+#if defined(_WIN32)
+	SetThreadAffinityMask(thread->native_handle(), (DWORD_PTR)1 << core);
+#else
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(core, &cpus);
+	pthread_setaffinity_np(thread->native_handle(), sizeof(cpus), &cpus);
+#endif
+}
+
+internal void
+shard_thread(Server_Shard* shard) {
+	std::vector<float> samples;
+	samples.reserve(SIM_HZ);
+	double start = seconds_now();
+	u32 tick = 0;
+
+	while (!server.stop.load(std::memory_order_relaxed)) {
+		double due = start + (double)tick / SIM_HZ;
+		double now = seconds_now();
+		if (due > now) {
+			std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+			now = seconds_now();
+		}
+		if (now - due > 1. / SIM_HZ) shard->metrics.late_ticks.fetch_add(1, std::memory_order_relaxed);
+		double begin = now;
+
+		Server_Command command;
+		while (server_queue_pop(&shard->queue, &command)) shard_add_match(shard, &command, now);
+		shard_receive(shard, now);
+
+		// Everyone steps together; the bots' paddles come from the AI.
+		shard->batch.count = shard->count;
+		ai_batch_ddp(&shard->batch, 1, server.bot_ai, shard->ai_1_ddp);
+		ai_batch_ddp(&shard->batch, 2, server.bot_ai, shard->ai_2_ddp);
+		for (int i = 0; i < shard->count; i++) {
+			Server_Match* m = &shard->matches[i];
+			shard->player_1_ddp[i] = m->bot ? shard->ai_1_ddp[i] : m->ddp[0];
+			shard->player_2_ddp[i] = m->bot ? shard->ai_2_ddp[i] : m->ddp[1];
+		}
+		simulate_match_batch(&shard->batch, shard->player_1_ddp, shard->player_2_ddp, SIM_DT);
+		tick++;
+
+		// Finished matches get their last state; bots start over, the rest go.
+		int used = 0;
+		for (int i = 0; i < shard->count; i++) {
+			Server_Match* m = &shard->matches[i];
+			bool over = shard->batch.player_1_score[i] >= POINTS_PER_MATCH || shard->batch.player_2_score[i] >= POINTS_PER_MATCH;
+			bool gone = !m->bot && (now - m->last_input[0] > SERVER_TIMEOUT || now - m->last_input[1] > SERVER_TIMEOUT);
+			if (!over && !gone) continue;
+			used = shard_put_match_states(shard, used, i, tick, SERVER_END);
+			if (m->bot) {
+				Match match;
+				init_match(&match);
+				match_batch_set(&shard->batch, i, &match);
+				shard->metrics.matches_finished.fetch_add(1, std::memory_order_relaxed);
+				shard->metrics.matches_started.fetch_add(1, std::memory_order_relaxed);
+			} else {
+				shard_send(shard, used);
+				used = 0;
+				shard_remove_match(shard, i--);
+			}
+		}
+		// Each tick sends states for 1 / send_every of the matches, so the
+		// sends don't all land on the same tick.
+		u32 phase = tick % server.send_every;
+		for (int i = 0; i < shard->count; i++) {
+			if ((shard->matches[i].id & 0xffff) % server.send_every == phase) used = shard_put_match_states(shard, used, i, tick, SERVER_STATE);
+		}
+		shard_send(shard, used);
+
+		double end = seconds_now();
+		samples.push_back((float)((end - begin) * 1e6));
+		shard->metrics.ticks.fetch_add(1, std::memory_order_relaxed);
+		if (samples.size() == SIM_HZ) {
+			std::sort(samples.begin(), samples.end());
+			shard->metrics.tick_p50.store(samples[SIM_HZ / 2], std::memory_order_relaxed);
+			shard->metrics.tick_p99.store(samples[SIM_HZ * 99 / 100], std::memory_order_relaxed);
+			shard->metrics.tick_max.store(samples[SIM_HZ - 1], std::memory_order_relaxed);
+			samples.clear();
+		}
+	}
+}
+
+
+// Lobby, on the main thread
+
+struct Lobby_Player {
+	Net_Address address;
+	u32 client;
+	double time;
+};
+
+internal bool
+same_player(Lobby_Player* a, Net_Address address, u32 client) {
+	return a->address.ip == address.ip && a->address.port == address.port && a->client == client;
+}
+
+// The shard with the fewest matches, or -1 when all are full.
+internal int
+lobby_pick_shard() {
+	int best = -1, best_count = 0;
+	for (int i = 0; i < server.shard_count; i++) {
+		Server_Shard* shard = &server.shards[i];
+		int count = shard->metrics.match_count.load(std::memory_order_relaxed);
+		if (count < shard->capacity && (best < 0 || count < best_count)) {
+			best = i;
+			best_count = count;
+		}
+	}
+	return best;
+}
+
+internal bool
+lobby_start_match(Lobby_Player* players, bool bot) {
+	int index = lobby_pick_shard();
+	if (index < 0) return false;
+	Server_Shard* shard = &server.shards[index];
+	Server_Command command = {};
+	command.bot = bot;
+	if (players) {
+		for (int p = 0; p < 2; p++) {
+			command.players[p] = players[p].address;
+			command.clients[p] = players[p].client;
+		}
+	}
+	if (!server_queue_push(&shard->queue, command)) return false;
+	shard->metrics.match_count.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+// Joins made into matches are remembered for a while, the clients keep
+// sending SERVER_JOIN until the assign arrives.
+struct Lobby {
+	Net_Socket socket;
+	bool waiting;
+	Lobby_Player waiting_player;
+	std::vector<Lobby_Player> recent;
+};
+
+internal void
+lobby_receive(Lobby* lobby, double now) {
+	u8 buffer[64];
+	Net_Datagram d;
+	d.data = buffer;
+	for (;;) {
+		d.size = sizeof(buffer);
+		if (net_socket_receive_batch(&lobby->socket, &d, 1) != 1) break;
+		if (!server_packet_valid(&d, sizeof(Server_Join), SERVER_JOIN)) continue;
+		u32 client = ((Server_Join*)d.data)->client;
+
+		bool known = lobby->waiting && same_player(&lobby->waiting_player, d.address, client);
+		for (size_t i = 0; i < lobby->recent.size() && !known; i++) known = same_player(&lobby->recent[i], d.address, client);
+		if (known) continue;
+
+		Lobby_Player player = {d.address, client, now};
+		if (!lobby->waiting) {
+			lobby->waiting_player = player;
+			lobby->waiting = true;
+			continue;
+		}
+		Lobby_Player players[2] = {lobby->waiting_player, player};
+		if (!lobby_start_match(players, false)) continue; // Full, the join is tried again
+		lobby->waiting = false;
+		lobby->recent.push_back(players[0]);
+		lobby->recent.push_back(players[1]);
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < lobby->recent.size(); i++) {
+		if (now - lobby->recent[i].time < SERVER_TIMEOUT) lobby->recent[kept++] = lobby->recent[i];
+	}
+	lobby->recent.resize(kept);
+	if (lobby->waiting && now - lobby->waiting_player.time > SERVER_TIMEOUT) lobby->waiting = false;
+}
+
+internal void
+write_metrics(const char* path) {
+	char temporary[512];
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	FILE* file = fopen(temporary, "w");
+	if (!file) return;
+
+	struct Metric {
+		const char* name;
+		const char* type;
+		const char* help;
+	};
+	Metric metrics[] = {
+		{"pong_shard_tick_microseconds", "gauge", "Tick time over the last second, by quantile"},
+		{"pong_shard_ticks_total", "counter", "Ticks run"},
+		{"pong_shard_late_ticks_total", "counter", "Ticks started more than a tick late"},
+		{"pong_shard_matches", "gauge", "Matches running"},
+		{"pong_shard_matches_started_total", "counter", "Matches started"},
+		{"pong_shard_matches_finished_total", "counter", "Matches finished"},
+		{"pong_shard_packets_in_total", "counter", "Datagrams received"},
+		{"pong_shard_packets_out_total", "counter", "Datagrams sent"},
+		{"pong_shard_packets_dropped_total", "counter", "Datagrams the socket didn't take"},
+	};
+	for (int m = 0; m < (int)(sizeof(metrics) / sizeof(metrics[0])); m++) {
+		fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", metrics[m].name, metrics[m].help, metrics[m].name, metrics[m].type);
+		for (int i = 0; i < server.shard_count; i++) {
+			Server_Metrics* s = &server.shards[i].metrics;
+			switch (m) {
+				case 0: {
+					fprintf(file, "%s{shard=\"%d\",quantile=\"0.5\"} %.2f\n", metrics[m].name, i, s->tick_p50.load());
+					fprintf(file, "%s{shard=\"%d\",quantile=\"0.99\"} %.2f\n", metrics[m].name, i, s->tick_p99.load());
+					fprintf(file, "%s{shard=\"%d\",quantile=\"1\"} %.2f\n", metrics[m].name, i, s->tick_max.load());
+				} break;
+				case 1: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->ticks.load()); break;
+				case 2: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->late_ticks.load()); break;
+				case 3: fprintf(file, "%s{shard=\"%d\"} %d\n", metrics[m].name, i, s->match_count.load()); break;
+				case 4: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->matches_started.load()); break;
+				case 5: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->matches_finished.load()); break;
+				case 6: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->packets_in.load()); break;
+				case 7: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->packets_out.load()); break;
+				case 8: fprintf(file, "%s{shard=\"%d\"} %llu\n", metrics[m].name, i, (unsigned long long)s->dropped_out.load()); break;
+			}
+		}
+	}
+	fclose(file);
+	// Readers never see half a file
+#if defined(_WIN32)
+	MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING);
+#else
+	rename(temporary, path);
+#endif
+}
+
+internal void
+print_metrics() {
+	for (int i = 0; i < server.shard_count; i++) {
+		Server_Metrics* s = &server.shards[i].metrics;
+		printf("shard %2d  %5d matches  tick p50 %6.1f us  p99 %6.1f us  max %6.1f us  late %llu  in %llu  out %llu\n", i,
+			s->match_count.load(), s->tick_p50.load(), s->tick_p99.load(), s->tick_max.load(),
+			(unsigned long long)s->late_ticks.load(), (unsigned long long)s->packets_in.load(), (unsigned long long)s->packets_out.load());
+	}
+	fflush(stdout);
+}
+
+
+// -load: fake clients that join and play randomly, for testing a server.
+
+struct Load_Client {
+	u32 match;
+	u8 player;
+	bool assigned;
+	u16 port;
+	u32 sequence;
+	u8 up, down;
+	int hold;
+};
+
+internal int
+run_load(int client_count, Net_Address lobby) {
+	Net_Socket socket;
+	if (!open_net_socket(&socket, 0)) {
+		fprintf(stderr, "no socket\n");
+		return 1;
+	}
+	net_socket_set_buffers(&socket, SERVER_SOCKET_BUFFER);
+	std::vector<Load_Client> clients(client_count);
+	std::vector<Net_Datagram> datagrams(client_count > NET_BATCH ? client_count : NET_BATCH);
+	std::vector<Server_Input> inputs(client_count);
+	std::vector<Server_State> received(NET_BATCH);
+	u32 random = 1;
+	u64 states = 0, ends = 0;
+	int assigned = 0;
+	double last_send = 0, last_print = seconds_now();
+
+	while (!server.stop.load(std::memory_order_relaxed)) {
+		double now = seconds_now();
+		for (;;) {
+			for (int i = 0; i < NET_BATCH; i++) {
+				datagrams[i].data = (u8*)&received[i];
+				datagrams[i].size = sizeof(Server_State);
+			}
+			int count = net_socket_receive_batch(&socket, datagrams.data(), NET_BATCH);
+			for (int i = 0; i < count; i++) {
+				Net_Datagram* d = &datagrams[i];
+				if (server_packet_valid(d, sizeof(Server_Assign), SERVER_ASSIGN)) {
+					Server_Assign* assign = (Server_Assign*)d->data;
+					if (assign->client >= (u32)client_count || clients[assign->client].assigned) continue;
+					Load_Client* c = &clients[assign->client];
+					c->assigned = true;
+					c->match = assign->match;
+					c->player = assign->player;
+					c->port = assign->port;
+					assigned++;
+				} else if (server_packet_valid(d, sizeof(Server_State), SERVER_STATE)) {
+					states++;
+				} else if (server_packet_valid(d, sizeof(Server_State), SERVER_END)) {
+					ends++;
+				}
+			}
+			if (count < NET_BATCH) break;
+		}
+
+		if (now - last_send >= 1. / 60) {
+			last_send = now;
+			int count = 0;
+			for (int i = 0; i < client_count; i++) {
+				Load_Client* c = &clients[i];
+				Net_Datagram* d = &datagrams[count++];
+				d->data = (u8*)&inputs[i];
+				if (!c->assigned) {
+					Server_Join* join = (Server_Join*)&inputs[i];
+					join->header = server_header(SERVER_JOIN);
+					join->client = (u32)i;
+					d->address = lobby;
+					d->size = sizeof(Server_Join);
+					continue;
+				}
+				if (c->hold-- <= 0) {
+					random ^= random << 13;
+					random ^= random >> 17;
+					random ^= random << 5;
+					c->up = random % 3 == 0 ? 255 : 0;
+					c->down = random % 3 == 1 ? 255 : 0;
+					c->hold = (int)((random >> 8) % 30);
+				}
+				Server_Input* input = &inputs[i];
+				input->header = server_header(SERVER_INPUT);
+				input->match = c->match;
+				input->sequence = ++c->sequence;
+				input->player = c->player;
+				input->up = c->up;
+				input->down = c->down;
+				input->reserved = 0;
+				d->address = {lobby.ip, c->port};
+				d->size = sizeof(Server_Input);
+			}
+			net_socket_send_batch(&socket, datagrams.data(), count);
+		}
+
+		if (now - last_print >= 1.) {
+			printf("clients %d assigned %d  states %llu/s  matches ended %llu\n", client_count, assigned, (unsigned long long)(states / (now - last_print)), (unsigned long long)ends);
+			fflush(stdout);
+			states = 0;
+			last_print = now;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	close_net_socket(&socket);
+	return 0;
+}
+
+// Ctrl+C or a kill stops the shards at the end of their tick, so the last
+// metrics get written and the sockets closed. A -load run stops the same way.
+#if defined(_WIN32)
+internal BOOL WINAPI
+server_console_handler(DWORD) {
+	server.stop.store(true, std::memory_order_relaxed);
+	return TRUE;
+}
+#else
+internal void
+server_signal_handler(int) {
+	server.stop.store(true, std::memory_order_relaxed);
+}
+#endif
+
+internal bool
+parse_address(const char* text, u16 default_port, Net_Address* address) {
+	char name[256];
+	unsigned port = default_port;
+	if (sscanf(text, "%255[^:]:%u", name, &port) < 1) return false;
+	return net_resolve(name, (u16)port, address);
+}
+
+int main(int argc, char** argv) {
+	u16 port = SERVER_DEFAULT_PORT;
+	int shard_count = (int)std::thread::hardware_concurrency();
+	int capacity = 8192;
+	int send_hz = 60;
+	int bots = 0;
+	const char* metrics_path = 0;
+	int load = 0;
+	const char* load_address = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-port") && i + 1 < argc) port = (u16)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-shards") && i + 1 < argc) shard_count = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-capacity") && i + 1 < argc) capacity = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-send_hz") && i + 1 < argc) send_hz = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-bots") && i + 1 < argc) bots = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-metrics") && i + 1 < argc) metrics_path = argv[++i];
+		else if (!strcmp(argv[i], "-bot_sink") && i + 1 < argc) {
+			if (!parse_address(argv[++i], 9, &server.bot_sink)) {
+				fprintf(stderr, "can't resolve %s\n", argv[i]);
+				return 1;
+			}
+			server.has_bot_sink = true;
+		} else if (!strcmp(argv[i], "-bot_ai") && i + 1 < argc) {
+			int level = find_ai_level(argv[++i]);
+			if (level < 0) {
+				fprintf(stderr, "unknown ai level %s (classic, easy, medium or hard)\n", argv[i]);
+				return 1;
+			}
+			server.bot_ai = (Ai_Level)level;
+		} else if (!strcmp(argv[i], "-load") && i + 2 < argc) {
+			load = atoi(argv[++i]);
+			load_address = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [-port N] [-shards N] [-capacity N] [-send_hz N] [-bots N] [-bot_sink ADDRESS:PORT] [-bot_ai LEVEL] [-metrics FILE]\n"
+				"       %s -load N ADDRESS[:PORT]\n", argv[0], argv[0]);
+			return 1;
+		}
+	}
+
+#if defined(_WIN32)
+	SetConsoleCtrlHandler(server_console_handler, TRUE);
+#else
+	signal(SIGINT, server_signal_handler);
+	signal(SIGTERM, server_signal_handler);
+#endif
+
+	if (load_address) {
+		Net_Address lobby;
+		if (!parse_address(load_address, SERVER_DEFAULT_PORT, &lobby)) {
+			fprintf(stderr, "can't resolve %s\n", load_address);
+			return 1;
+		}
+		return run_load(load < 1 ? 1 : load, lobby);
+	}
+
+	if (shard_count < 1) shard_count = 1;
+	if (shard_count > SERVER_MAX_SHARDS) shard_count = SERVER_MAX_SHARDS;
+	if (capacity < 1) capacity = 1;
+	if (capacity > 0x10000) capacity = 0x10000; // Match ids keep the handle in 16 bits
+	if (send_hz < 1) send_hz = 1;
+	server.send_every = SIM_HZ / send_hz > 0 ? SIM_HZ / send_hz : 1;
+	server.shard_count = shard_count;
+	server.shards = new Server_Shard[shard_count];
+
+	Lobby lobby;
+	if (!open_net_socket(&lobby.socket, port)) {
+		fprintf(stderr, "can't open port %d\n", port);
+		return 1;
+	}
+	lobby.waiting = false;
+	for (int i = 0; i < shard_count; i++) {
+		if (!alloc_shard(&server.shards[i], i, capacity, (u16)(port + 1 + i))) {
+			fprintf(stderr, "can't set up shard %d on port %d\n", i, port + 1 + i);
+			return 1;
+		}
+	}
+	int cores = (int)std::thread::hardware_concurrency();
+	for (int i = 0; i < shard_count; i++) {
+		Server_Shard* shard = &server.shards[i];
+		shard->core = cores > 0 ? i % cores : 0;
+		shard->thread = std::thread(shard_thread, shard);
+		pin_thread(&shard->thread, shard->core);
+	}
+	for (int i = 0; i < bots; i++) {
+		if (!lobby_start_match(0, true)) {
+			// The queues hold SERVER_QUEUE_SIZE at a time, give the shards a moment
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			if (!lobby_start_match(0, true)) break;
+		}
+	}
+	printf("lobby on port %d, %d shards on ports %d-%d, up to %d matches each\n", port, shard_count, port + 1, port + shard_count, capacity);
+	fflush(stdout);
+
+	double last_metrics = seconds_now();
+	while (!server.stop.load(std::memory_order_relaxed)) {
+		double now = seconds_now();
+		lobby_receive(&lobby, now);
+		if (now - last_metrics >= 1.) {
+			last_metrics = now;
+			print_metrics();
+			if (metrics_path) write_metrics(metrics_path);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	for (int i = 0; i < shard_count; i++) server.shards[i].thread.join();
+	print_metrics();
+	if (metrics_path) write_metrics(metrics_path);
+	for (int i = 0; i < shard_count; i++) close_net_socket(&server.shards[i].socket);
+	close_net_socket(&lobby.socket);
+	return 0;
+}
@@ -0,0 +1,382 @@
+// Online two player matches over UDP with input delay and rollback. The host
+// is player 1 (the right paddle), the one who joins is player 2; either plays
+// with the arrows or W and S.
+//
+// A tick's local input is sent and scheduled input_delay ticks ahead, so a
+// peer that is about that close has it in time. The peer's input for a tick
+// that hasn't arrived yet is predicted as its last one with the keys kept as
+// they were. When the real input turns out different, the state is restored
+// from before the first wrong tick and the ticks since are simulated again.
+// States are kept for every tick in a ring, so a rollback is a copy of
+// Game_State and a few simulate_game calls: no allocation and, at 240 Hz,
+// well under a microsecond per tick. The simulation stops instead of
+// predicting more than NET_MAX_PREDICTION ticks.
+//
+// Every packet repeats all local inputs the peer hasn't acked, so a lost
+// packet costs nothing but the wait for the next one, and the simulation
+// stops before one of them would be overwritten. The tick counts in the
+// packets keep the two peers in step: the one that is ahead runs a tick less
+// now and then.
+//
+// Ticks go into the replay log once both inputs are known, so a log of an
+// online match plays back like any other.
+
+#include <stddef.h>
+#include <string.h>
+
+#define NET_MAGIC 0x54454e50 // "PNET"
+#define NET_VERSION 1
+#define NET_DEFAULT_PORT 27015
+#define NET_DEFAULT_DELAY 4 // Ticks, about 17 ms
+#define NET_RING 64 // Ticks of inputs and states kept, power of two
+#define NET_MAX_PREDICTION 24 // Ticks past the peer's last input, 100 ms
+#define NET_MAX_INPUTS 64 // Per packet
+#define NET_HELLO_INTERVAL .1
+#define NET_TIMEOUT 5. // Seconds without a packet before the peer is gone
+
+// A rollback simulates ticks down to NET_MAX_PREDICTION behind again, and the
+// next tick needs input up to NET_MAX_PREDICTION ahead; both have to fit.
+static_assert(NET_RING > 2 * NET_MAX_PREDICTION + 1, "NET_RING too small for NET_MAX_PREDICTION");
+
+enum {
+	NET_HELLO, // Player 2 to the host until the host welcomes
+	NET_WELCOME,
+	NET_INPUTS,
+	NET_QUIT,
+};
+
+// A Button_State as it goes over the wire. held is in 255ths, and both peers
+// simulate with exactly that.
+struct Net_Button {
+	u8 flags; // 1 is_down, 2 changed
+	u8 presses, releases;
+	u8 held;
+};
+
+// One player's buttons for one tick.
+struct Net_Input {
+	Net_Button up, down;
+};
+
+// Little endian like everything the game writes.
+struct Net_Packet {
+	u32 magic;
+	u8 version, type;
+	u8 input_delay; // Of the host, in NET_WELCOME
+	u8 count; // Inputs
+	u32 first; // Tick of inputs[0]
+	u32 ack; // Ticks of the receiver's input the sender has
+	u32 tick; // Sender's next tick
+	s32 advantage; // Sender's next tick minus the receiver's, as the sender last heard it
+	Net_Input inputs[NET_MAX_INPUTS];
+};
+
+struct Net_Session {
+	Net_Socket socket;
+	Net_Address peer;
+	bool host;
+	bool connected;
+	int input_delay;
+	double last_received, last_hello;
+
+	u32 tick; // Next tick to simulate
+	s64 local_latest, remote_latest; // Newest tick with input, -1 for none
+	s64 peer_has; // Newest of the local inputs the peer acked
+	s64 rollback_from; // First tick simulated with a wrong prediction, -1 for none
+	s32 advantage, remote_advantage;
+	bool synced; // Already ran a tick less this frame
+
+	Net_Input local[NET_RING], remote[NET_RING];
+	Net_Input used[NET_RING]; // Remote input, real or predicted, each tick was simulated with
+	Game_State states[NET_RING]; // Before each tick
+
+	Replay_Writer* replay_log;
+	s64 logged; // Ticks in the log
+
+	u64 rollbacks, rollback_ticks, stalls;
+	int max_rollback;
+};
+
+internal Net_Button
+net_button(Button_State* b) {
+	Net_Button result;
+	result.flags = (b->is_down ? 1 : 0) | (b->changed ? 2 : 0);
+	result.presses = b->presses;
+	result.releases = b->releases;
+	result.held = (u8)(b->held * 255.f + .5f);
+	return result;
+}
+
+internal Button_State
+net_button_state(Net_Button b) {
+	Button_State result;
+	result.is_down = (b.flags & 1) != 0;
+	result.changed = (b.flags & 2) != 0;
+	result.presses = b.presses;
+	result.releases = b.releases;
+	result.held = b.held / 255.f;
+	return result;
+}
+
+// The arrows, or W and S when the arrows aren't in use.
+internal Net_Input
+net_local_input(Input* input) {
+	Net_Input result;
+	Button_State* up = &input->buttons[BUTTON_UP];
+	Button_State* down = &input->buttons[BUTTON_DOWN];
+	if (!up->is_down && !up->changed && !up->presses) up = &input->buttons[BUTTON_W];
+	if (!down->is_down && !down->changed && !down->presses) down = &input->buttons[BUTTON_S];
+	result.up = net_button(up);
+	result.down = net_button(down);
+	return result;
+}
+
+// Keeps the keys as they were, without the edges.
+internal Net_Button
+net_predict_button(Net_Button b) {
+	Net_Button result = {};
+	result.flags = b.flags & 1;
+	result.held = result.flags ? 255 : 0;
+	return result;
+}
+
+internal bool
+net_inputs_equal(Net_Input* a, Net_Input* b) {
+	return !memcmp(a, b, sizeof(Net_Input));
+}
+
+internal void
+net_start(Net_Session* s, Game_State* game) {
+	s->connected = true;
+	s->tick = 0;
+	memset(s->local, 0, sizeof(s->local));
+	memset(s->remote, 0, sizeof(s->remote));
+	s->local_latest = s->input_delay - 1; // The first ticks have no input
+	s->remote_latest = s->input_delay - 1;
+	s->peer_has = s->input_delay - 1;
+	s->rollback_from = -1;
+	s->logged = 0;
+
+	*game = {};
+	game->current_gamemode = GM_GAMEPLAY;
+	game->hot_button = 1;
+	game->enemy_is_ai = false;
+	init_match(&game->match);
+}
+
+internal bool
+net_open(Net_Session* s, u16 port, int input_delay) {
+	memset(s, 0, sizeof(*s));
+	if (!open_net_socket(&s->socket, port)) return false;
+	s->input_delay = input_delay < 0 ? 0 : input_delay > NET_MAX_PREDICTION ? NET_MAX_PREDICTION : input_delay;
+	s->last_received = present_clock();
+	return true;
+}
+
+// Waits on port for player 2.
+internal bool
+net_host(Net_Session* s, u16 port, int input_delay) {
+	if (!net_open(s, port, input_delay)) return false;
+	s->host = true;
+	return true;
+}
+
+// Connects to the host at address; the host's input delay is used.
+internal bool
+net_join(Net_Session* s, const char* host_name, u16 port) {
+	Net_Address address;
+	if (!net_resolve(host_name, port, &address) || !net_open(s, 0, NET_DEFAULT_DELAY)) return false;
+	s->peer = address;
+	s->last_hello = -NET_HELLO_INTERVAL;
+	return true;
+}
+
+internal void
+net_send_packet(Net_Session* s, int type, int first, int count) {
+	Net_Packet packet;
+	packet.magic = NET_MAGIC;
+	packet.version = NET_VERSION;
+	packet.type = (u8)type;
+	packet.input_delay = (u8)s->input_delay;
+	packet.count = (u8)count;
+	packet.first = (u32)first;
+	packet.ack = (u32)(s->remote_latest + 1);
+	packet.tick = s->tick;
+	packet.advantage = s->advantage;
+	for (int i = 0; i < count; i++) packet.inputs[i] = s->local[(first + i) & (NET_RING - 1)];
+	net_socket_send(&s->socket, s->peer, &packet, (int)(offsetof(Net_Packet, inputs) + count * sizeof(Net_Input)));
+}
+
+internal void
+net_build_input(Net_Session* s, Net_Input* local, Net_Input* remote, Input* input) {
+	Net_Input* player_1 = s->host ? local : remote;
+	Net_Input* player_2 = s->host ? remote : local;
+	*input = {};
+	input->buttons[BUTTON_UP] = net_button_state(player_1->up);
+	input->buttons[BUTTON_DOWN] = net_button_state(player_1->down);
+	input->buttons[BUTTON_W] = net_button_state(player_2->up);
+	input->buttons[BUTTON_S] = net_button_state(player_2->down);
+}
+
+// Simulates the tick with the peer's input or, until it arrives, a prediction.
+internal void
+net_simulate(Net_Session* s, Game_State* game, s64 tick, Match_Events* events = 0) {
+	int slot = (int)(tick & (NET_RING - 1));
+	Net_Input remote;
+	if (tick <= s->remote_latest) {
+		remote = s->remote[slot];
+	} else {
+		Net_Input last = s->remote[s->remote_latest & (NET_RING - 1)];
+		remote.up = net_predict_button(last.up);
+		remote.down = net_predict_button(last.down);
+	}
+	s->used[slot] = remote;
+	s->states[slot] = *game;
+
+	Input input;
+	net_build_input(s, &s->local[slot], &remote, &input);
+	simulate_game(game, &input, SIM_DT, events);
+}
+
+// Logs the ticks up to last with the input they were simulated with. For the
+// ticks both inputs are known for that is the real input, and their states in
+// the ring are the real ones, once the rollbacks are done.
+internal void
+net_log_ticks(Net_Session* s, s64 last) {
+	for (; s->logged <= last; s->logged++) {
+		int slot = (int)(s->logged & (NET_RING - 1));
+		Input input;
+		net_build_input(s, &s->local[slot], &s->used[slot], &input);
+		replay_write_tick(s->replay_log, &s->states[slot], &input);
+	}
+}
+
+internal void
+net_receive_inputs(Net_Session* s, Net_Packet* packet, int count) {
+	if ((s64)packet->ack - 1 > s->peer_has) s->peer_has = (s64)packet->ack - 1;
+	for (int i = 0; i < count; i++) {
+		s64 tick = (s64)packet->first + i;
+		if (tick <= s->remote_latest) continue;
+		if (tick > s->remote_latest + 1) break; // A packet went missing, the next one repeats it
+		// Its slot still holds a tick a rollback may simulate again. The peer
+		// ran far ahead on a long delay; it sends this again until it's acked.
+		if (tick >= (s64)s->tick - NET_MAX_PREDICTION + NET_RING) break;
+		int slot = (int)(tick & (NET_RING - 1));
+		s->remote[slot] = packet->inputs[i];
+		s->remote_latest = tick;
+		if (tick < s->tick && !net_inputs_equal(&s->used[slot], &packet->inputs[i]) && (s->rollback_from < 0 || tick < s->rollback_from)) {
+			s->rollback_from = tick;
+		}
+	}
+	s->advantage = (s32)((s64)s->tick - packet->tick);
+	s->remote_advantage = packet->advantage;
+}
+
+// Start of the frame: reads what arrived and rolls back if a prediction was
+// wrong. Returns false once the peer is gone.
+internal bool
+net_poll(Net_Session* s, Game_State* game) {
+	PROFILE_SCOPE("NET");
+	double now = present_clock();
+	s->synced = false;
+
+	Net_Packet packet;
+	Net_Address from;
+	int size;
+	while ((size = net_socket_receive(&s->socket, &from, &packet, sizeof(packet))) >= 0) {
+		if (size < (int)offsetof(Net_Packet, inputs) || packet.magic != NET_MAGIC || packet.version != NET_VERSION) continue;
+		int count = (size - (int)offsetof(Net_Packet, inputs)) / (int)sizeof(Net_Input);
+		if (count > packet.count) count = packet.count;
+
+		if (s->host && packet.type == NET_HELLO) {
+			// Welcomed again if the welcome went missing
+			if (!s->connected) {
+				s->peer = from;
+				net_start(s, game);
+			}
+			if (from.ip == s->peer.ip && from.port == s->peer.port) net_send_packet(s, NET_WELCOME, 0, 0);
+			s->last_received = now;
+			continue;
+		}
+		if (!s->connected && !s->host && packet.type == NET_WELCOME) {
+			s->input_delay = packet.input_delay;
+			net_start(s, game);
+		}
+		if (!s->connected || from.ip != s->peer.ip || from.port != s->peer.port) continue;
+		s->last_received = now;
+		if (packet.type == NET_QUIT) return false;
+		if (packet.type == NET_INPUTS) net_receive_inputs(s, &packet, count);
+	}
+
+	if (!s->connected) {
+		if (!s->host && now - s->last_hello >= NET_HELLO_INTERVAL) {
+			net_send_packet(s, NET_HELLO, 0, 0);
+			s->last_hello = now;
+		}
+		return true;
+	}
+	if (now - s->last_received > NET_TIMEOUT) return false;
+
+	if (s->rollback_from >= 0) {
+		PROFILE_SCOPE("ROLLBACK");
+		int ticks = (int)(s->tick - s->rollback_from);
+		*game = s->states[s->rollback_from & (NET_RING - 1)];
+		for (s64 tick = s->rollback_from; tick < s->tick; tick++) net_simulate(s, game, tick);
+		s->rollbacks++;
+		s->rollback_ticks += ticks;
+		if (ticks > s->max_rollback) s->max_rollback = ticks;
+		s->rollback_from = -1;
+	}
+	if (s->replay_log) net_log_ticks(s, s->remote_latest < (s64)s->tick - 1 ? s->remote_latest : (s64)s->tick - 1);
+	return true;
+}
+
+// False when the next tick has to wait: not connected yet, too far ahead of
+// the peer's input, its input would overwrite one the peer hasn't acked, or
+// ahead of the peer's clock.
+internal bool
+net_can_advance(Net_Session* s) {
+	if (!s->connected) return false;
+	if ((s64)s->tick - s->remote_latest > NET_MAX_PREDICTION || (s64)s->tick + s->input_delay - s->peer_has >= NET_RING) {
+		s->stalls++;
+		return false;
+	}
+	// Both advantages include the latency, half their difference is how far ahead this side is
+	if (!s->synced && s->advantage - s->remote_advantage >= 4) {
+		s->synced = true;
+		return false;
+	}
+	return true;
+}
+
+// Runs the next tick, with input the tick's local input from the platform.
+// events gets its hits, the ticks simulated again on a rollback report none.
+internal void
+net_tick(Net_Session* s, Game_State* game, Input* input, Match_Events* events) {
+	s->local_latest = s->tick + s->input_delay;
+	s->local[s->local_latest & (NET_RING - 1)] = net_local_input(input);
+	net_simulate(s, game, s->tick, events);
+	s->tick++;
+}
+
+// End of the frame: everything the peer hasn't acked.
+internal void
+net_send_inputs(Net_Session* s) {
+	if (!s->connected) return;
+	s64 first = s->peer_has + 1;
+	s64 count = s->local_latest - s->peer_has;
+	if (count > NET_MAX_INPUTS) count = NET_MAX_INPUTS;
+	net_send_packet(s, NET_INPUTS, (int)first, (int)count);
+}
+
+// The ticks that were predicted go into the log as they were played, so the
+// log stays in step with the match that goes on at this keyboard.
+internal void
+close_net_session(Net_Session* s) {
+	if (s->connected) {
+		net_send_packet(s, NET_QUIT, 0, 0);
+		if (s->replay_log) net_log_ticks(s, (s64)s->tick - 1);
+		s->connected = false;
+	}
+	close_net_socket(&s->socket);
+}
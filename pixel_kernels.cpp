@@ -0,0 +1,137 @@
+// Fill kernels for every pixel format and blend mode. fill_rect_kernel is a
+// template on both, so each pair compiles into its own loop with nothing
+// decided per pixel; select_raster_kernels points fill_rect_kernels at the row
+// for render_state.format once per frame (render_begin_frame). Colors are
+// 0xRRGGBB above this file whatever the format.
+// Opaque spans still go through the CPUID-picked fill_span (span_fill.cpp);
+// RGB565 fills two pixels per u32. Alpha is 0 to 255, 255 is opaque.
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define PIXEL_KERNELS_SSE2 1
+#include <emmintrin.h>
+#else
+#define PIXEL_KERNELS_SSE2 0
+#endif
+
+enum Blend_Mode {
+	BLEND_OPAQUE,
+	BLEND_ALPHA,
+
+	BLEND_COUNT,
+};
+
+struct Format_XRGB8888 {
+	typedef u32 Pixel;
+	static Pixel pack(u32 color) { return color; }
+	static u32 unpack(Pixel pixel) { return pixel; }
+};
+
+// The top bits of each channel are repeated into the bottom ones on the way
+// back, so white stays white.
+struct Format_RGB565 {
+	typedef u16 Pixel;
+	static Pixel pack(u32 color) {
+		return (Pixel)(((color >> 8) & 0xf800) | ((color >> 5) & 0x07e0) | ((color >> 3) & 0x001f));
+	}
+	static u32 unpack(Pixel pixel) {
+		u32 r = (pixel >> 11) & 0x1f, g = (pixel >> 5) & 0x3f, b = pixel & 0x1f;
+		return (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+	}
+};
+
+internal void
+opaque_span(u32* dest, int count, u32 color) {
+	fill_span(dest, count, color);
+}
+
+internal void
+opaque_span(u16* dest, int count, u16 color) {
+	if (count && ((size_t)dest & 2)) {
+		*dest++ = color;
+		count--;
+	}
+	fill_span((u32*)dest, count / 2, (u32)color << 16 | color);
+	if (count & 1) dest[count - 1] = color;
+}
+
+// Red and blue blend in one multiply, green in another; every channel has room
+// above it for the product.
+internal void
+alpha_span(u32* dest, int count, u32 color, u32 alpha) {
+	u32 a = alpha + (alpha >> 7); // 0 to 256
+	u32 rb = (color & 0xff00ff) * a, g = (color & 0xff00) * a;
+	int i = 0;
+#if PIXEL_KERNELS_SSE2
+	// Same products, eight channels at a time
+	__m128i zero = _mm_setzero_si128();
+	__m128i source = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32((int)(color & 0xffffff)), zero), _mm_set1_epi16((short)a));
+	__m128i keep = _mm_set1_epi16((short)(256 - a));
+	__m128i rgb = _mm_set1_epi32(0xffffff); // X comes out 0, as in the loop below
+	for (; i + 4 <= count; i += 4) {
+		__m128i d = _mm_loadu_si128((__m128i*)(dest + i));
+		__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), keep), source), 8);
+		__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), keep), source), 8);
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_and_si128(_mm_packus_epi16(lo, hi), rgb));
+	}
+#endif
+	for (; i < count; i++) {
+		u32 d = dest[i];
+		u32 out_rb = ((d & 0xff00ff) * (256 - a) + rb) >> 8;
+		u32 out_g = ((d & 0xff00) * (256 - a) + g) >> 8;
+		dest[i] = (out_rb & 0xff00ff) | (out_g & 0xff00);
+	}
+}
+
+// Spread to 0x07e0f81f, green on top, every channel gets five spare bits for
+// the 5 bit alpha.
+internal void
+alpha_span(u16* dest, int count, u16 color, u32 alpha) {
+	u32 a = (alpha + 4) >> 3; // 0 to 32
+	u32 source = (((u32)color << 16 | color) & 0x07e0f81f) * a;
+	for (int i = 0; i < count; i++) {
+		u32 d = ((u32)dest[i] << 16 | dest[i]) & 0x07e0f81f;
+		u32 out = ((d * (32 - a) + source) >> 5) & 0x07e0f81f;
+		dest[i] = (u16)(out | out >> 16);
+	}
+}
+
+struct Blend_Opaque {
+	template <typename Pixel> static void span(Pixel* dest, int count, Pixel color, u32 alpha) { opaque_span(dest, count, color); }
+};
+
+struct Blend_Alpha {
+	template <typename Pixel> static void span(Pixel* dest, int count, Pixel color, u32 alpha) { alpha_span(dest, count, color, alpha); }
+};
+
+typedef void Fill_Rect(Pixel_Rect r, u32 color, u32 alpha);
+
+// r has to be on screen and not empty.
+template <typename Format, typename Blend> internal void
+fill_rect_kernel(Pixel_Rect r, u32 color, u32 alpha) {
+	typedef typename Format::Pixel Pixel;
+	Pixel pixel = Format::pack(color);
+	Pixel* row = (Pixel*)render_state.memory + r.x0 + (s64)r.y0 * render_state.pitch;
+	int count = r.x1 - r.x0;
+	for (int y = r.y0; y < r.y1; y++) {
+		Blend::span(row, count, pixel, alpha);
+		row += render_state.pitch;
+	}
+}
+
+global_variable Fill_Rect* raster_kernels[PIXEL_FORMAT_COUNT][BLEND_COUNT] = {
+	{ fill_rect_kernel<Format_XRGB8888, Blend_Opaque>, fill_rect_kernel<Format_XRGB8888, Blend_Alpha> },
+	{ fill_rect_kernel<Format_RGB565, Blend_Opaque>, fill_rect_kernel<Format_RGB565, Blend_Alpha> },
+};
+
+// The current format's, indexed by Blend_Mode.
+global_variable Fill_Rect** fill_rect_kernels = raster_kernels[PIXEL_XRGB8888];
+
+internal void
+select_raster_kernels() {
+	fill_rect_kernels = raster_kernels[render_state.format];
+}
+
+internal Blend_Mode
+blend_for_alpha(u32 alpha) {
+	return alpha >= 255 ? BLEND_OPAQUE : BLEND_ALPHA;
+}
@@ -1,6 +1,10 @@
+// State during one simulation tick. A press shorter than a tick still counts
+// in presses and releases, and held says how much of the tick it was down for.
 struct Button_State {
-	bool is_down;
-	bool changed;
+	bool is_down; // At the end of the tick
+	bool changed; // Since the last tick
+	u8 presses, releases;
+	float held; // Fraction of the tick, 0 to 1
 };
 
 enum {
@@ -11,10 +15,55 @@ enum {
 	BUTTON_LEFT,
 	BUTTON_RIGHT,
 	BUTTON_ENTER,
+	BUTTON_F3,
 
 	BUTTON_COUNT, // Should be the last item
 };
 
+#define MAX_TICK_EVENTS 32
+
+// A press or release. time is seconds on present_clock in the event queue, and
+// the fraction of the tick it happened at once it is in Input.
+struct Input_Event {
+	double time;
+	u8 button;
+	bool is_down;
+};
+
 struct Input {
 	Button_State buttons[BUTTON_COUNT];
+
+	// Everything that happened during the tick, in order
+	Input_Event events[MAX_TICK_EVENTS];
+	int event_count;
+};
+
+// How render_state.memory holds a pixel. Colors are 0xRRGGBB in either, see
+// pixel_kernels.cpp.
+enum Pixel_Format {
+	PIXEL_XRGB8888, // One u32 per pixel, the default
+	PIXEL_RGB565, // One u16, for 16 bit panels
+
+	PIXEL_FORMAT_COUNT,
+};
+
+struct Render_State {
+	int height, width;
+	int pitch; // Pixels from one row to the next, at least width
+	void* memory;
+	Pixel_Format format; // Set once at startup, buffers stay sized for u32 pixels
+};
+
+internal int
+pixel_size(Pixel_Format format) {
+	return format == PIXEL_RGB565 ? 2 : 4;
+}
+
+global_variable Render_State render_state;
+
+// IPv4 address and port in host byte order, for the platform's UDP sockets
+// (win32_udp.cpp, linux_udp.cpp).
+struct Net_Address {
+	u32 ip;
+	u16 port;
 };
@@ -0,0 +1,154 @@
+// Scoped timers. PROFILE_SCOPE("NAME") records one event with the scope's begin
+// and end time into a ring owned by the calling thread. Only the owner writes
+// a ring; readers take a copy and then check the owner didn't lap them, so
+// nobody ever waits. The overlay (profiler_overlay.cpp) sums the events of
+// every frame, profiler_write_trace dumps what is still in the rings as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev).
+// Names have to be string literals. Keep them uppercase, the overlay draws them.
+// Build with PROFILER_DISABLED to compile every scope away.
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_RING_EVENTS (1 << 16) // Per thread, the trace keeps this many
+#define MAX_PROFILE_THREADS 64
+
+struct Profile_Event {
+	const char* name;
+	u64 begin, end; // Nanoseconds, profile_ticks
+};
+
+struct Profile_Ring {
+	std::atomic<u64> written;
+	const char* thread_name;
+	Profile_Event events[PROFILE_RING_EVENTS];
+};
+
+struct Profiler {
+	std::atomic<int> thread_count;
+	std::atomic<Profile_Ring*> rings[MAX_PROFILE_THREADS];
+	u64 start;
+};
+
+global_variable Profiler profiler;
+thread_local Profile_Ring* profile_ring;
+
+internal u64
+profile_ticks() {
+	return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal Profile_Ring*
+profile_thread_ring() {
+	if (!profile_ring) {
+		int index = profiler.thread_count.fetch_add(1, std::memory_order_relaxed);
+		if (index >= MAX_PROFILE_THREADS) return 0;
+		profile_ring = (Profile_Ring*)calloc(1, sizeof(Profile_Ring));
+		profiler.rings[index].store(profile_ring, std::memory_order_release);
+	}
+	return profile_ring;
+}
+
+// Shows up as the thread's name in the trace.
+internal void
+profile_thread_name(const char* name) {
+	if (Profile_Ring* ring = profile_thread_ring()) ring->thread_name = name;
+}
+
+internal void
+profile_record(const char* name, u64 begin, u64 end) {
+	Profile_Ring* ring = profile_ring ? profile_ring : profile_thread_ring();
+	if (!ring) return;
+	u64 index = ring->written.load(std::memory_order_relaxed);
+	Profile_Event* event = &ring->events[index & (PROFILE_RING_EVENTS - 1)];
+	event->name = name;
+	event->begin = begin;
+	event->end = end;
+	ring->written.store(index + 1, std::memory_order_release);
+}
+
+struct Profile_Scope {
+	const char* name;
+	u64 begin;
+
+	Profile_Scope(const char* name) : name(name), begin(profile_ticks()) {}
+	~Profile_Scope() { profile_record(name, begin, profile_ticks()); }
+};
+
+#ifdef PROFILER_DISABLED
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_JOIN_(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_(a, b)
+#define PROFILE_SCOPE(name) Profile_Scope PROFILE_JOIN(profile_scope_, __LINE__)(name)
+#endif
+
+internal void
+init_profiler() {
+	profiler.start = profile_ticks();
+	profile_thread_name("MAIN");
+}
+
+// Copies the events of ring in [*from, written) into out, at most capacity of
+// them, and moves *from past them. Events the owner overwrote while they were
+// copied are left out. Returns how many were copied.
+internal int
+profile_read(Profile_Ring* ring, u64* from, Profile_Event* out, int capacity) {
+	u64 written = ring->written.load(std::memory_order_acquire);
+	u64 first = *from;
+	if (written - first > PROFILE_RING_EVENTS) first = written - PROFILE_RING_EVENTS;
+	if (written - first > (u64)capacity) first = written - capacity;
+
+	for (u64 i = first; i < written; i++) out[i - first] = ring->events[i & (PROFILE_RING_EVENTS - 1)];
+
+	// Anything below this may have been overwritten during the copy.
+	u64 after = ring->written.load(std::memory_order_acquire);
+	u64 valid = after > PROFILE_RING_EVENTS ? after - PROFILE_RING_EVENTS : 0;
+	int skip = valid > first ? (int)(valid - first) : 0;
+	int count = (int)(written - first);
+	if (skip > count) skip = count;
+	if (skip) memmove(out, out + skip, (count - skip) * sizeof(Profile_Event));
+
+	*from = written;
+	return count - skip;
+}
+
+// Writes every event still in the rings. Meant for exit, but safe while running.
+internal bool
+profiler_write_trace(const char* path) {
+	FILE* file = fopen(path, "wb");
+	if (!file) return false;
+
+	static Profile_Event events[PROFILE_RING_EVENTS];
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	int thread_count = profiler.thread_count.load(std::memory_order_acquire);
+	if (thread_count > MAX_PROFILE_THREADS) thread_count = MAX_PROFILE_THREADS;
+
+	for (int t = 0; t < thread_count; t++) {
+		Profile_Ring* ring = profiler.rings[t].load(std::memory_order_acquire);
+		if (!ring) continue;
+
+		if (ring->thread_name) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", t, ring->thread_name);
+			first = false;
+		}
+
+		u64 from = 0;
+		int count = profile_read(ring, &from, events, PROFILE_RING_EVENTS);
+		for (int i = 0; i < count; i++) {
+			Profile_Event* e = &events[i];
+			double ts = (s64)(e->begin - profiler.start) / 1000.;
+			double dur = (e->end - e->begin) / 1000.;
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", e->name, t, ts, dur);
+			first = false;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,143 @@
+// Profiler overlay, toggled with F3. profiler_end_frame sums the scopes every
+// thread recorded since the last frame, per name, and keeps the last
+// PROFILE_HISTORY frames of each. The overlay shows the last frame and the
+// p50/p99 over that history in microseconds, plus a graph of frame times.
+// Scopes that run on several threads at once (WORK) add up, so they can be
+// longer than the frame. Present work finishes a frame or more after the frame
+// itself was rendered and is counted in the frame it finished in.
+
+#include <algorithm>
+
+#define PROFILE_HISTORY 256
+#define MAX_PROFILE_ZONES 16
+#define PROFILE_GRAPH_FRAMES 128
+
+struct Profile_Zone {
+	const char* name;
+	float sum; // Seconds, of the frame being collected
+	float history[PROFILE_HISTORY];
+};
+
+struct Profile_Overlay {
+	bool visible;
+	int frames; // Recorded so far
+	float frame_time[PROFILE_HISTORY];
+	float latency[PROFILE_HISTORY];
+
+	int zone_count;
+	Profile_Zone zones[MAX_PROFILE_ZONES];
+	u64 read_from[MAX_PROFILE_THREADS];
+};
+
+global_variable Profile_Overlay profile_overlay;
+
+internal Profile_Zone*
+profile_zone(const char* name) {
+	for (int i = 0; i < profile_overlay.zone_count; i++) {
+		Profile_Zone* zone = &profile_overlay.zones[i];
+		if (zone->name == name || !strcmp(zone->name, name)) return zone;
+	}
+	if (profile_overlay.zone_count == MAX_PROFILE_ZONES) return 0;
+	Profile_Zone* zone = &profile_overlay.zones[profile_overlay.zone_count++];
+	zone->name = name;
+	return zone;
+}
+
+// Call once per frame from the main thread with the time the frame took.
+internal void
+profiler_end_frame(float frame_seconds) {
+	Profile_Overlay* overlay = &profile_overlay;
+	static Profile_Event events[4096];
+
+	int thread_count = profiler.thread_count.load(std::memory_order_acquire);
+	if (thread_count > MAX_PROFILE_THREADS) thread_count = MAX_PROFILE_THREADS;
+	for (int t = 0; t < thread_count; t++) {
+		Profile_Ring* ring = profiler.rings[t].load(std::memory_order_acquire);
+		if (!ring) continue;
+		int count = profile_read(ring, &overlay->read_from[t], events, (int)(sizeof(events) / sizeof(events[0])));
+		for (int i = 0; i < count; i++) {
+			if (Profile_Zone* zone = profile_zone(events[i].name)) zone->sum += (events[i].end - events[i].begin) * 1e-9f;
+		}
+	}
+
+	int slot = overlay->frames % PROFILE_HISTORY;
+	overlay->frame_time[slot] = frame_seconds;
+	overlay->latency[slot] = (float)frame_buffers.input_latency.load(std::memory_order_relaxed);
+	for (int i = 0; i < overlay->zone_count; i++) {
+		overlay->zones[i].history[slot] = overlay->zones[i].sum;
+		overlay->zones[i].sum = 0;
+	}
+	overlay->frames++;
+}
+
+internal void
+history_percentiles(float* history, float* p50, float* p99) {
+	int count = profile_overlay.frames < PROFILE_HISTORY ? profile_overlay.frames : PROFILE_HISTORY;
+	float sorted[PROFILE_HISTORY];
+	memcpy(sorted, history, count * sizeof(float));
+	std::sort(sorted, sorted + count);
+	*p50 = count ? sorted[count / 2] : 0;
+	*p99 = count ? sorted[(count - 1) * 99 / 100] : 0;
+}
+
+internal void
+draw_profile_row(const char* name, float* history, float y) {
+	float p50, p99;
+	history_percentiles(history, &p50, &p99);
+	float last = history[(profile_overlay.frames + PROFILE_HISTORY - 1) % PROFILE_HISTORY];
+
+	draw_text(name, -80, y, .4f, 0xffffff);
+	draw_number((int)(last * 1e6f), -44, y - 1.2f, .4f, 0xffffff);
+	draw_number((int)(p50 * 1e6f), -34, y - 1.2f, .4f, 0xffffff);
+	draw_number((int)(p99 * 1e6f), -24, y - 1.2f, .4f, 0xffffff);
+}
+
+internal void
+draw_profiler_overlay() {
+	Profile_Overlay* overlay = &profile_overlay;
+	if (!overlay->visible || !overlay->frames) return;
+
+	// A translucent panel under it all, so it reads over the game
+	float bottom = 43 - 4 * (2 + overlay->zone_count) - 25;
+	float right = std::max(-10.f, -80 + PROFILE_GRAPH_FRAMES * .5f) + 2;
+	set_draw_alpha(160);
+	draw_rect((right - 82) * .5f, (45 + bottom) * .5f, (right + 82) * .5f, (45 - bottom) * .5f, 0x000000);
+	set_draw_alpha(255);
+
+	float y = 43;
+	draw_text("US", -80, y, .4f, 0xaaaaaa);
+	draw_text("NOW", -50, y, .4f, 0xaaaaaa);
+	// There are no digit glyphs
+	draw_text("P", -40, y, .4f, 0xaaaaaa);
+	draw_number(50, -34, y - 1.2f, .4f, 0xaaaaaa);
+	draw_text("P", -30, y, .4f, 0xaaaaaa);
+	draw_number(99, -24, y - 1.2f, .4f, 0xaaaaaa);
+	y -= 4;
+	draw_profile_row("FRAME", overlay->frame_time, y);
+	y -= 4;
+	draw_profile_row("LATENCY", overlay->latency, y);
+	for (int i = 0; i < overlay->zone_count; i++) {
+		y -= 4;
+		draw_profile_row(overlay->zones[i].name, overlay->zones[i].history, y);
+	}
+
+	// Frame times, newest on the right. Half a unit is a millisecond, the line
+	// marks 60 Hz and frames over twice the median are red.
+	float p50, p99;
+	history_percentiles(overlay->frame_time, &p50, &p99);
+	float base = y - 24;
+	draw_rect(-80 + PROFILE_GRAPH_FRAMES * .25f, base + 16.667f * .5f, PROFILE_GRAPH_FRAMES * .25f, .1f, 0x888888);
+	int frames = overlay->frames < PROFILE_GRAPH_FRAMES ? overlay->frames : PROFILE_GRAPH_FRAMES;
+	// The bars don't overlap, so each color goes as one batch
+	World_Rect fast[PROFILE_GRAPH_FRAMES], slow[PROFILE_GRAPH_FRAMES];
+	int fast_count = 0, slow_count = 0;
+	for (int i = 0; i < frames; i++) {
+		float t = overlay->frame_time[(overlay->frames - frames + i) % PROFILE_HISTORY];
+		float height = std::min(t * 1000.f, 40.f) * .25f;
+		World_Rect bar = { -80 + (PROFILE_GRAPH_FRAMES - frames + i) * .5f + .25f, base + height, .2f, height };
+		if (t > 2 * p50) slow[slow_count++] = bar;
+		else fast[fast_count++] = bar;
+	}
+	draw_rects(fast, fast_count, 0x00ff00);
+	draw_rects(slow, slow_count, 0xff0000);
+}
@@ -0,0 +1,580 @@
+// Render command buffer. draw_rect, draw_text and draw_number only append
+// commands to a per-frame arena; render_flush culls them and hands them to the
+// rasterizer in renderer.cpp. Every command carries the pixel bounds it can
+// touch, already clipped, so culling never has to look inside a command.
+// Commands pushed after set_draw_alpha blend at that alpha; they never occlude
+// anything, and since the dirty tracker restores the background under them
+// every frame they don't blend over their own last frame.
+
+#include <stdlib.h>
+#include <string.h>
+
+// Grows array to hold at least count, doubling. Also used by render_tiles.cpp.
+template <typename T> internal void
+reserve(T** array, int* capacity, int count) {
+	if (count <= *capacity) return;
+	int new_capacity = *capacity ? *capacity : 256;
+	while (new_capacity < count) new_capacity *= 2;
+	*array = (T*)realloc(*array, new_capacity * sizeof(T));
+	*capacity = new_capacity;
+}
+
+typedef void Draw_Background();
+
+enum Render_Command_Type {
+	RC_RECT,
+	RC_GLYPH,
+	RC_NUMBER,
+	RC_CLIP,
+	RC_CAPTURE, // Copy the framebuffer under bounds into a bitmap
+	RC_BLIT, // Copy a bitmap back, opaque
+	RC_RECT_BATCH, // A Rect_Batch, never an occluder
+	RC_SKIP, // Culled
+};
+
+struct Render_Command {
+	u8 type;
+	u8 alpha; // 255 is opaque
+	u16 size;
+	u32 color;
+	Pixel_Rect bounds;
+};
+
+struct Render_Command_Glyph {
+	Render_Command header;
+	int x, y; // Origin in pixels
+	s16 atlas_entry;
+	s16 letter;
+};
+
+struct Render_Command_Number {
+	Render_Command header;
+	float x, y, size;
+	int number;
+};
+
+// Off-screen copy of a framebuffer region. rect is where it lives on screen.
+// pixels are in render_state.format, so a u32 holds two RGB565 ones.
+struct Bitmap {
+	u32* pixels;
+	int capacity; // In u32s
+	Pixel_Rect rect;
+};
+
+struct Render_Command_Bitmap {
+	Render_Command header;
+	Bitmap* bitmap;
+};
+
+// Many small rects in one command, each with its own 0xAARRGGBB color.
+// bin_rect_batch sorts them into RECT_BATCH_CELL squares, a rect that
+// straddles cells into each of them, so a tile only goes through the rects of
+// its own cells. The arrays have to stay put until the frame is flushed.
+#define RECT_BATCH_CELL 64 // TILE_SIZE, so tiles cover whole cells
+
+struct Rect_Batch {
+	Pixel_Rect* rects;
+	u32* colors;
+	int count;
+
+	// From bin_rect_batch
+	Pixel_Rect bounds;
+	int cells_x, cells_y;
+	int* cell_first; // cells_x * cells_y + 1 offsets into entries
+	int cell_capacity;
+	int* entries; // Index into rects
+	int entry_capacity;
+};
+
+struct Render_Command_Rect_Batch {
+	Render_Command header;
+	Rect_Batch* batch;
+};
+
+#define RENDER_ARENA_SIZE (256 * 1024)
+#define MAX_RENDER_COMMANDS (RENDER_ARENA_SIZE / sizeof(Render_Command))
+#define MAX_OCCLUDERS 64
+#define MIN_OCCLUDER_AREA 1024
+
+struct Render_Commands {
+	u8 arena[RENDER_ARENA_SIZE];
+	int used;
+	int last_rect; // Offset of the last command if it is a rect, for merging. -1 otherwise
+
+	Pixel_Rect clip;
+	Draw_Background* draw_background; // Of the current frame
+
+	// Stats of the last flush
+	int command_count;
+	int culled_count;
+
+	u8 alpha; // Of the commands pushed now
+};
+
+global_variable Render_Commands render_commands = { {}, 0, -1, {}, 0, 0, 0, 255 };
+
+internal void render_flush();
+internal void push_clip(Pixel_Rect clip);
+internal bool rasterize_tiled(Render_Command** commands, int count);
+
+// Rasterizes what we have in the middle of a frame and carries the clip over.
+internal void
+render_flush_keep_clip() {
+	Pixel_Rect clip = render_commands.clip;
+	render_flush();
+	if (clip.x0 != 0 || clip.y0 != 0 || clip.x1 != render_state.width || clip.y1 != render_state.height) {
+		push_clip(clip);
+	}
+}
+
+internal void*
+push_command(int type, int size, u32 color, Pixel_Rect bounds) {
+	if (render_commands.used + size > RENDER_ARENA_SIZE) render_flush_keep_clip(); // Out of space
+
+	Render_Command* command = (Render_Command*)(render_commands.arena + render_commands.used);
+	command->type = (u8)type;
+	command->alpha = render_commands.alpha;
+	command->size = (u16)size;
+	command->color = color;
+	command->bounds = bounds;
+	render_commands.used += size;
+	render_commands.last_rect = -1;
+	return command;
+}
+
+internal Pixel_Rect
+clip_to_commands(Pixel_Rect r) {
+	r = clip_to_screen(r);
+	Pixel_Rect clip = render_commands.clip;
+	r.x0 = clamp(clip.x0, r.x0, clip.x1);
+	r.x1 = clamp(clip.x0, r.x1, clip.x1);
+	r.y0 = clamp(clip.y0, r.y0, clip.y1);
+	r.y1 = clamp(clip.y0, r.y1, clip.y1);
+	return r;
+}
+
+// alpha out of 255, until the next call. Every frame starts opaque.
+internal void
+set_draw_alpha(u32 alpha) {
+	render_commands.alpha = (u8)(alpha > 255 ? 255 : alpha);
+	render_commands.last_rect = -1;
+}
+
+internal void
+push_clip(Pixel_Rect clip) {
+	render_commands.clip = clip_to_screen(clip);
+	push_command(RC_CLIP, sizeof(Render_Command), 0, render_commands.clip);
+}
+
+// Rects are clipped here, so the rasterizer never needs the clip for them.
+// A rect continuing the previous one in the same color extends it instead.
+internal void
+push_rect(int x0, int y0, int x1, int y1, u32 color) {
+	Pixel_Rect r = { x0, y0, x1, y1 };
+	r = clip_to_commands(r);
+	if (rect_is_empty(r)) return;
+
+	dirty_record(r.x0, r.y0, r.x1, r.y1);
+
+	if (render_commands.last_rect >= 0) {
+		Render_Command* last = (Render_Command*)(render_commands.arena + render_commands.last_rect);
+		Pixel_Rect b = last->bounds;
+		if (last->color == color) {
+			if (b.y0 == r.y0 && b.y1 == r.y1 && (b.x1 == r.x0 || r.x1 == b.x0)) {
+				last->bounds = rect_union(b, r);
+				return;
+			}
+			if (b.x0 == r.x0 && b.x1 == r.x1 && (b.y1 == r.y0 || r.y1 == b.y0)) {
+				last->bounds = rect_union(b, r);
+				return;
+			}
+		}
+	}
+
+	Render_Command* command = (Render_Command*)push_command(RC_RECT, sizeof(Render_Command), color, r);
+	render_commands.last_rect = (int)((u8*)command - render_commands.arena);
+}
+
+internal void
+push_glyph(int letter, float x, float y, float size, u32 color) {
+	Glyph_Atlas_Entry* entry = find_atlas_entry(size);
+	if (!entry) {
+		// A full atlas scales over an entry that queued glyphs may still use
+		if (glyph_atlas.count == MAX_ATLAS_SIZES) render_flush_keep_clip();
+		entry = add_atlas_entry(size);
+	}
+	int ox, oy;
+	glyph_origin(x, y, &ox, &oy);
+
+	Pixel_Rect bounds = entry->glyphs[letter].bounds;
+	bounds.x0 += ox;
+	bounds.x1 += ox;
+	bounds.y0 += oy;
+	bounds.y1 += oy;
+	bounds = clip_to_commands(bounds);
+	if (rect_is_empty(bounds)) return;
+
+	dirty_record(bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+
+	Render_Command_Glyph* glyph = (Render_Command_Glyph*)push_command(RC_GLYPH, sizeof(Render_Command_Glyph), color, bounds);
+	glyph->x = ox;
+	glyph->y = oy;
+	glyph->atlas_entry = (s16)(entry - glyph_atlas.entries);
+	glyph->letter = (s16)letter;
+}
+
+internal void
+push_number(int number, float x, float y, float size, u32 color) {
+	Rect_Sink sink = {};
+	number_rects(number, x, y, size, &sink);
+	Pixel_Rect bounds = clip_to_commands(sink.bounds);
+	if (rect_is_empty(bounds)) return;
+
+	dirty_record(bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+
+	Render_Command_Number* command = (Render_Command_Number*)push_command(RC_NUMBER, sizeof(Render_Command_Number), color, bounds);
+	command->x = x;
+	command->y = y;
+	command->size = size;
+	command->number = number;
+}
+
+// Bins the rects for the current screen size. The cell arrays only grow.
+internal void
+bin_rect_batch(Rect_Batch* batch) {
+	batch->bounds = {};
+	batch->cells_x = (render_state.width + RECT_BATCH_CELL - 1) / RECT_BATCH_CELL;
+	batch->cells_y = (render_state.height + RECT_BATCH_CELL - 1) / RECT_BATCH_CELL;
+	int cell_count = batch->cells_x * batch->cells_y;
+	reserve(&batch->cell_first, &batch->cell_capacity, cell_count + 1);
+	memset(batch->cell_first, 0, (cell_count + 1) * sizeof(int));
+
+	// Count into cell_first[cell + 1], clipping on the way
+	int entry_count = 0;
+	for (int i = 0; i < batch->count; i++) {
+		Pixel_Rect r = clip_to_screen(batch->rects[i]);
+		batch->rects[i] = r;
+		if (rect_is_empty(r)) continue;
+		batch->bounds = rect_is_empty(batch->bounds) ? r : rect_union(batch->bounds, r);
+		for (int cy = r.y0 / RECT_BATCH_CELL; cy <= (r.y1 - 1) / RECT_BATCH_CELL; cy++) {
+			for (int cx = r.x0 / RECT_BATCH_CELL; cx <= (r.x1 - 1) / RECT_BATCH_CELL; cx++) {
+				batch->cell_first[cy * batch->cells_x + cx + 1]++;
+				entry_count++;
+			}
+		}
+	}
+	for (int c = 0; c < cell_count; c++) batch->cell_first[c + 1] += batch->cell_first[c];
+
+	// Then fill, with cell_first[cell] as the cursor; afterwards it is the
+	// start of the next cell, which the shift puts right.
+	reserve(&batch->entries, &batch->entry_capacity, entry_count);
+	for (int i = 0; i < batch->count; i++) {
+		Pixel_Rect r = batch->rects[i];
+		if (rect_is_empty(r)) continue;
+		for (int cy = r.y0 / RECT_BATCH_CELL; cy <= (r.y1 - 1) / RECT_BATCH_CELL; cy++) {
+			for (int cx = r.x0 / RECT_BATCH_CELL; cx <= (r.x1 - 1) / RECT_BATCH_CELL; cx++) {
+				batch->entries[batch->cell_first[cy * batch->cells_x + cx]++] = i;
+			}
+		}
+	}
+	memmove(batch->cell_first + 1, batch->cell_first, cell_count * sizeof(int));
+	batch->cell_first[0] = 0;
+}
+
+// After bin_rect_batch, in the same frame.
+internal void
+push_rect_batch(Rect_Batch* batch) {
+	Pixel_Rect bounds = clip_to_commands(batch->bounds);
+	if (rect_is_empty(bounds)) return;
+
+	dirty_record(bounds.x0, bounds.y0, bounds.x1, bounds.y1);
+
+	Render_Command_Rect_Batch* command = (Render_Command_Rect_Batch*)push_command(RC_RECT_BATCH, sizeof(Render_Command_Rect_Batch), 0, bounds);
+	command->batch = batch;
+}
+
+// Each rect is drawn clipped to its cell too, so the ones that straddle cells
+// don't blend twice.
+internal void
+execute_rect_batch(Rect_Batch* batch, Pixel_Rect clip) {
+	int cx0 = clip.x0 / RECT_BATCH_CELL, cx1 = (clip.x1 - 1) / RECT_BATCH_CELL;
+	int cy0 = clip.y0 / RECT_BATCH_CELL, cy1 = (clip.y1 - 1) / RECT_BATCH_CELL;
+	for (int cy = cy0; cy <= cy1 && cy < batch->cells_y; cy++) {
+		for (int cx = cx0; cx <= cx1 && cx < batch->cells_x; cx++) {
+			Pixel_Rect cell = { cx * RECT_BATCH_CELL, cy * RECT_BATCH_CELL, (cx + 1) * RECT_BATCH_CELL, (cy + 1) * RECT_BATCH_CELL };
+			cell = rect_intersect(cell, clip);
+			int first = batch->cell_first[cy * batch->cells_x + cx];
+			int last = batch->cell_first[cy * batch->cells_x + cx + 1];
+			for (int e = first; e < last; e++) {
+				int i = batch->entries[e];
+				Pixel_Rect r = rect_intersect(batch->rects[i], cell);
+				if (rect_is_empty(r)) continue;
+				u32 alpha = batch->colors[i] >> 24;
+				fill_rect_kernels[blend_for_alpha(alpha)](r, batch->colors[i] & 0xffffff, alpha);
+			}
+		}
+	}
+}
+
+internal void
+push_bitmap(int type, Bitmap* bitmap) {
+	Pixel_Rect bounds = clip_to_commands(bitmap->rect);
+	if (rect_is_empty(bounds)) return;
+
+	Render_Command_Bitmap* command = (Render_Command_Bitmap*)push_command(type, sizeof(Render_Command_Bitmap), 0, bounds);
+	command->bitmap = bitmap;
+}
+
+internal bool
+rect_contains(Pixel_Rect outer, Pixel_Rect inner) {
+	return outer.x0 <= inner.x0 && outer.y0 <= inner.y0 && outer.x1 >= inner.x1 && outer.y1 >= inner.y1;
+}
+
+global_variable Render_Command* flush_commands[MAX_RENDER_COMMANDS];
+
+// Rects are opaque, so anything inside a later rect never shows. Only big rects
+// are tracked as occluders, small ones almost never cover anything.
+internal int
+cull_covered_commands() {
+	Render_Command** commands = flush_commands;
+	int count = 0;
+	for (int offset = 0; offset < render_commands.used;) {
+		Render_Command* command = (Render_Command*)(render_commands.arena + offset);
+		commands[count++] = command;
+		offset += command->size;
+	}
+
+	Pixel_Rect occluders[MAX_OCCLUDERS];
+	int occluder_count = 0;
+	render_commands.command_count = count;
+	render_commands.culled_count = 0;
+
+	for (int i = count - 1; i >= 0; i--) {
+		Render_Command* command = commands[i];
+		if (command->type == RC_CLIP || command->type == RC_CAPTURE) continue;
+
+		bool covered = false;
+		for (int j = 0; j < occluder_count; j++) {
+			if (rect_contains(occluders[j], command->bounds)) {
+				covered = true;
+				break;
+			}
+		}
+
+		if (covered) {
+			command->type = RC_SKIP;
+			render_commands.culled_count++;
+		} else if (command->type == RC_RECT && command->alpha == 255 && occluder_count < MAX_OCCLUDERS &&
+			rect_area(command->bounds) >= MIN_OCCLUDER_AREA) {
+			occluders[occluder_count++] = command->bounds;
+		}
+	}
+	return count;
+}
+
+// Clip commands are handled by the caller, clip is what the command may touch.
+internal void
+execute_command(Render_Command* command, Pixel_Rect clip) {
+	switch (command->type) {
+		case RC_RECT: {
+			Pixel_Rect b = command->bounds;
+			draw_rect_clipped(b.x0, b.y0, b.x1, b.y1, clip, command->color, command->alpha);
+		} break;
+
+		case RC_GLYPH: {
+			Render_Command_Glyph* glyph = (Render_Command_Glyph*)command;
+			Scaled_Glyph* scaled = &glyph_atlas.entries[glyph->atlas_entry].glyphs[glyph->letter];
+			blit_glyph(scaled, glyph->x, glyph->y, clip, command->color, command->alpha);
+		} break;
+
+		case RC_NUMBER: {
+			Render_Command_Number* number = (Render_Command_Number*)command;
+			Rect_Sink sink = { true, command->color, {}, clip, command->alpha };
+			number_rects(number->number, number->x, number->y, number->size, &sink);
+		} break;
+
+		case RC_RECT_BATCH: {
+			Rect_Batch* batch = ((Render_Command_Rect_Batch*)command)->batch;
+			Pixel_Rect r = rect_intersect(command->bounds, clip);
+			if (!rect_is_empty(r)) execute_rect_batch(batch, r);
+		} break;
+
+		case RC_CAPTURE:
+		case RC_BLIT: {
+			Bitmap* bitmap = ((Render_Command_Bitmap*)command)->bitmap;
+			Pixel_Rect r = rect_intersect(command->bounds, clip);
+			if (rect_is_empty(r)) break;
+
+			int size = pixel_size(render_state.format);
+			int bitmap_width = bitmap->rect.x1 - bitmap->rect.x0;
+			int bytes = (r.x1 - r.x0) * size;
+			for (int y = r.y0; y < r.y1; y++) {
+				u8* screen = (u8*)render_state.memory + (r.x0 + (s64)y * render_state.pitch) * size;
+				u8* pixels = (u8*)bitmap->pixels + ((r.x0 - bitmap->rect.x0) + (s64)(y - bitmap->rect.y0) * bitmap_width) * size;
+				if (command->type == RC_CAPTURE) memcpy(pixels, screen, bytes);
+				else memcpy(screen, pixels, bytes);
+			}
+		} break;
+	}
+}
+
+// Rasterizes everything pushed so far and empties the arena.
+internal void
+render_flush() {
+	int count = cull_covered_commands();
+
+	if (!rasterize_tiled(flush_commands, count)) {
+		Pixel_Rect clip = screen_rect();
+		for (int i = 0; i < count; i++) {
+			Render_Command* command = flush_commands[i];
+			if (command->type == RC_CLIP) clip = command->bounds;
+			else execute_command(command, clip);
+		}
+	}
+
+	render_commands.used = 0;
+	render_commands.last_rect = -1;
+	render_commands.clip = screen_rect();
+}
+
+// The background rendered once into a buffer of its own, so restoring it is a
+// copy instead of drawing it again. It is redrawn when the framebuffer changes
+// size or format, or when the frame brings a different Draw_Background, which
+// is how a gamemode change shows up. The bitmap is pitch pixels wide, so its
+// rows line up with the framebuffer's.
+struct Static_Layer {
+	void* block;
+	Bitmap bitmap;
+	Draw_Background* draw_background; // What's in it, 0 when nothing is
+	int width, height, pitch;
+	Pixel_Format format;
+};
+
+global_variable Static_Layer static_layer;
+
+internal void
+build_static_layer(Draw_Background* draw_background) {
+	Static_Layer* layer = &static_layer;
+	if (layer->draw_background == draw_background && layer->width == render_state.width &&
+		layer->height == render_state.height && layer->pitch == render_state.pitch &&
+		layer->format == render_state.format) return;
+
+	layer->draw_background = 0;
+	s64 capacity = ((s64)render_state.pitch * render_state.height * pixel_size(render_state.format) + 3) / 4;
+	if (capacity > layer->bitmap.capacity) {
+		free(layer->block);
+		layer->block = malloc((size_t)capacity * sizeof(u32) + 63);
+		layer->bitmap.pixels = (u32*)(((size_t)layer->block + 63) & ~(size_t)63);
+		layer->bitmap.capacity = layer->block ? (int)capacity : 0;
+		if (!layer->block) return; // render_begin_frame draws the background instead
+	}
+
+	// Rendered like a frame, only into the layer
+	void* frame = render_state.memory;
+	render_state.memory = layer->bitmap.pixels;
+	dirty.suspended++;
+	draw_background();
+	render_flush();
+	dirty.suspended--;
+	render_state.memory = frame;
+
+	layer->bitmap.rect = { 0, 0, render_state.pitch, render_state.height };
+	layer->draw_background = draw_background;
+	layer->width = render_state.width;
+	layer->height = render_state.height;
+	layer->pitch = render_state.pitch;
+	layer->format = render_state.format;
+}
+
+// The background under the current clip, from the static layer if there is one.
+// Opaque whatever set_draw_alpha says, it replaces what was there.
+internal void
+restore_background() {
+	if (static_layer.draw_background) {
+		push_bitmap(RC_BLIT, &static_layer.bitmap);
+	} else {
+		u8 alpha = render_commands.alpha;
+		set_draw_alpha(255);
+		render_commands.draw_background();
+		set_draw_alpha(alpha);
+	}
+}
+
+// Restores the background where last frame drew something, or everywhere on a full redraw.
+internal void
+render_begin_frame(Draw_Background* draw_background) {
+	render_commands.used = 0;
+	render_commands.last_rect = -1;
+	render_commands.clip = screen_rect();
+	// A new background differs everywhere, not only under last frame's draws
+	if (render_commands.draw_background != draw_background) invalidate_frame();
+	render_commands.draw_background = draw_background;
+	render_commands.alpha = 255;
+	select_raster_kernels();
+	build_static_layer(draw_background);
+
+	dirty_begin_frame();
+
+	dirty.suspended++;
+	if (dirty.full_redraw) {
+		restore_background();
+	} else {
+		for (int i = 0; i < dirty.previous.count; i++) {
+			push_clip(dirty.previous.rects[i]);
+			restore_background();
+		}
+		push_clip(screen_rect());
+	}
+	dirty.suspended--;
+}
+
+internal void
+render_end_frame() {
+	render_flush();
+	dirty_end_frame();
+}
+
+void draw_arena_borders(float arena_x, float arena_y, u32 color) {
+	Pixel_Rect arena = world_to_pixels(0, 0, arena_x, arena_y);
+	int x0 = arena.x0, y0 = arena.y0, x1 = arena.x1, y1 = arena.y1;
+
+	push_rect(0, 0, render_state.width, y0, color);
+	push_rect(0, y1, x1, render_state.height, color);
+	push_rect(0, y0, x0, y1, color);
+	push_rect(x1, y0, render_state.width, render_state.height, color);
+}
+
+// gambar rectangle untuk digerakain
+void draw_rect(float x, float y, float half_size_x, float half_size_y, u32 color) {
+	Pixel_Rect r = world_to_pixels(x, y, half_size_x, half_size_y);
+	push_rect(r.x0, r.y0, r.x1, r.y1, color);
+}
+
+// draw_rect for count rects of one color, converted in one batch.
+internal void
+draw_rects(const World_Rect* rects, int count, u32 color) {
+	Pixel_Rect pixels[RECT_SINK_SIZE];
+	for (int first = 0; first < count; first += RECT_SINK_SIZE) {
+		int n = count - first < RECT_SINK_SIZE ? count - first : RECT_SINK_SIZE;
+		world_rects_to_pixels(rects + first, pixels, n);
+		for (int i = 0; i < n; i++) push_rect(pixels[i].x0, pixels[i].y0, pixels[i].x1, pixels[i].y1, color);
+	}
+}
+
+void draw_text(const char *text, float x, float y, float size, u32 color) {
+	dirty_begin_group();
+
+	while (*text) {
+		if (*text != 32) push_glyph(letter_index(*text), x, y, size, color);
+		text++;
+		x += size * 6.f;
+	}
+
+	dirty_end_group();
+}
+
+void draw_number(int number, float x, float y, float size, u32 color) {
+	dirty_begin_group();
+	push_number(number, x, y, size, color);
+	dirty_end_group();
+}
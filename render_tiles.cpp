@@ -0,0 +1,140 @@
+// Tiled rasterization. render_flush bins the culled commands into TILE_SIZE
+// square tiles and rasterizes the tiles on render_pool. A tile replays its
+// commands in submission order and tiles never overlap, so the frame comes out
+// the same no matter which worker ran which tile. render_pool.deterministic
+// additionally runs every tile in order on the calling thread.
+
+#include <stdlib.h>
+
+#define TILE_SIZE 64
+
+// Below this many covered pixels waking the workers costs more than it saves.
+#define MIN_TILED_PIXELS (512 * 1024)
+
+struct Tile_Bins {
+	int tiles_x, tiles_y;
+
+	int* tile_first; // tile_count + 1 offsets into entries
+	int tile_capacity;
+	int* cursor;
+	int cursor_capacity;
+
+	int* entries; // Index into commands
+	int entry_capacity;
+
+	Pixel_Rect* clips; // Clip each command was pushed under
+	int clip_capacity;
+
+	Render_Command** commands;
+};
+
+global_variable Work_Pool render_pool;
+global_variable Tile_Bins tile_bins;
+
+// Starts the rasterizer threads. worker_count 0 uses every hardware thread.
+internal void
+init_render_workers(int worker_count, bool deterministic) {
+	render_pool.deterministic = deterministic;
+	work_pool_start(&render_pool, worker_count);
+}
+
+internal void
+shutdown_render_workers() {
+	work_pool_stop(&render_pool);
+}
+
+internal void
+tile_range(Pixel_Rect r, int* tx0, int* ty0, int* tx1, int* ty1) {
+	*tx0 = r.x0 / TILE_SIZE;
+	*ty0 = r.y0 / TILE_SIZE;
+	*tx1 = (r.x1 - 1) / TILE_SIZE;
+	*ty1 = (r.y1 - 1) / TILE_SIZE;
+}
+
+internal void
+rasterize_tile(int tile, int worker, void* data) {
+	Tile_Bins* bins = (Tile_Bins*)data;
+	int tx = tile % bins->tiles_x;
+	int ty = tile / bins->tiles_x;
+
+	Pixel_Rect tile_rect;
+	tile_rect.x0 = tx * TILE_SIZE;
+	tile_rect.y0 = ty * TILE_SIZE;
+	tile_rect.x1 = tile_rect.x0 + TILE_SIZE < render_state.width ? tile_rect.x0 + TILE_SIZE : render_state.width;
+	tile_rect.y1 = tile_rect.y0 + TILE_SIZE < render_state.height ? tile_rect.y0 + TILE_SIZE : render_state.height;
+
+	for (int e = bins->tile_first[tile]; e < bins->tile_first[tile + 1]; e++) {
+		int index = bins->entries[e];
+		Pixel_Rect clip = rect_intersect(bins->clips[index], tile_rect);
+		if (!rect_is_empty(clip)) execute_command(bins->commands[index], clip);
+	}
+}
+
+// Returns false when the frame is too small to be worth it; the caller rasterizes serially then.
+internal bool
+rasterize_tiled(Render_Command** commands, int count) {
+	if (render_pool.worker_count <= 1 && !render_pool.deterministic) return false;
+
+	Tile_Bins* bins = &tile_bins;
+	bins->commands = commands;
+	bins->tiles_x = (render_state.width + TILE_SIZE - 1) / TILE_SIZE;
+	bins->tiles_y = (render_state.height + TILE_SIZE - 1) / TILE_SIZE;
+	int tile_count = bins->tiles_x * bins->tiles_y;
+	if (!tile_count) return true;
+
+	reserve(&bins->clips, &bins->clip_capacity, count);
+	reserve(&bins->tile_first, &bins->tile_capacity, tile_count + 1);
+	for (int i = 0; i <= tile_count; i++) bins->tile_first[i] = 0;
+
+	// Count pass: tile_first[t + 1] holds the number of commands in tile t.
+	Pixel_Rect clip = screen_rect();
+	s64 pixels = 0;
+	int entry_count = 0;
+	for (int i = 0; i < count; i++) {
+		Render_Command* command = commands[i];
+		bins->clips[i] = clip;
+		if (command->type == RC_CLIP) {
+			clip = command->bounds;
+			continue;
+		}
+		if (command->type == RC_SKIP) continue;
+
+		Pixel_Rect b = rect_intersect(command->bounds, clip);
+		if (rect_is_empty(b)) continue;
+		pixels += rect_area(b);
+
+		int tx0, ty0, tx1, ty1;
+		tile_range(b, &tx0, &ty0, &tx1, &ty1);
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) bins->tile_first[ty * bins->tiles_x + tx + 1]++;
+		}
+		entry_count += (tx1 - tx0 + 1) * (ty1 - ty0 + 1);
+	}
+
+	if (pixels < MIN_TILED_PIXELS && !render_pool.deterministic) return false;
+
+	for (int t = 0; t < tile_count; t++) bins->tile_first[t + 1] += bins->tile_first[t];
+
+	// Fill pass, in submission order so every tile keeps the painter's order.
+	reserve(&bins->entries, &bins->entry_capacity, entry_count);
+	reserve(&bins->cursor, &bins->cursor_capacity, tile_count);
+	int* cursor = bins->cursor;
+	for (int t = 0; t < tile_count; t++) cursor[t] = bins->tile_first[t];
+
+	for (int i = 0; i < count; i++) {
+		Render_Command* command = commands[i];
+		if (command->type == RC_CLIP || command->type == RC_SKIP) continue;
+
+		Pixel_Rect b = rect_intersect(command->bounds, bins->clips[i]);
+		if (rect_is_empty(b)) continue;
+
+		int tx0, ty0, tx1, ty1;
+		tile_range(b, &tx0, &ty0, &tx1, &ty1);
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) bins->entries[cursor[ty * bins->tiles_x + tx]++] = i;
+		}
+	}
+
+	work_pool_run(&render_pool, tile_count, rasterize_tile, bins);
+	return true;
+}
@@ -1,71 +1,174 @@
-void render_background(){
-	unsigned int* pixel = (unsigned int*)render_state.memory;
-	for (int y = 0; y < render_state.height;y++){
-		for (int x = 0; x< render_state.width;x++){
-		*pixel++ = 0xff00ff * x + 0x00ff00 * y;}}}
-		
-
-void clear_screen(u32 color) {
-	unsigned int* pixel = (u32*)render_state.memory;
+// Test gradient, not part of the game's frame. Steps the color along the row
+// instead of multiplying per pixel; anything static like it belongs in the
+// static layer (see render_commands.cpp), where it's drawn once.
+void render_background() {
 	for (int y = 0; y < render_state.height; y++) {
+		u32* pixel = (u32*)render_state.memory + (s64)y * render_state.pitch;
+		u32 color = 0x00ff00 * (u32)y;
 		for (int x = 0; x < render_state.width; x++) {
 			*pixel++ = color;
+			color += 0xff00ff;
 		}
 	}
 }
 
-void draw_rect_in_pixels(int x0, int y0, int x1, int y1, u32 color) {
-	
-	x0 = clamp(0, x0, render_state.width);
-	x1 = clamp(0, x1, render_state.width);
-	y0 = clamp(0, y0, render_state.height);
-	y1 = clamp(0, y1, render_state.height);
-
-	for (int y = y0; y < y1; y++) {
-		u32* pixel = (u32*)render_state.memory + x0 + y*render_state.width;
-		for (int x = x0; x < x1; x++) {
-			*pixel++ = color;
-		}
+void clear_screen(u32 color) {
+	// The framebuffer is contiguous, so the whole clear is one span. The row
+	// padding gets filled too, nobody looks at it.
+	if (render_state.format != PIXEL_XRGB8888) {
+		Pixel_Rect all = { 0, 0, render_state.pitch, render_state.height };
+		if (render_state.height) fill_rect_kernels[BLEND_OPAQUE](all, color, 255);
+		return;
 	}
+	int count = render_state.pitch * render_state.height;
+	if (count >= NON_TEMPORAL_THRESHOLD) fill_span_stream((u32*)render_state.memory, count, color);
+	else fill_span((u32*)render_state.memory, count, color);
+}
+
+// clip has to lie inside the screen. Tiles and clip commands rasterize through this.
+internal void
+draw_rect_clipped(int x0, int y0, int x1, int y1, Pixel_Rect clip, u32 color, u32 alpha = 255) {
+	Pixel_Rect r;
+	r.x0 = clamp(clip.x0, x0, clip.x1);
+	r.x1 = clamp(clip.x0, x1, clip.x1);
+	r.y0 = clamp(clip.y0, y0, clip.y1);
+	r.y1 = clamp(clip.y0, y1, clip.y1);
+	if (r.x0 >= r.x1 || r.y0 >= r.y1) return;
+
+	fill_rect_kernels[blend_for_alpha(alpha)](r, color, alpha);
+}
+
+void draw_rect_in_pixels(int x0, int y0, int x1, int y1, u32 color) {
+	draw_rect_clipped(x0, y0, x1, y1, screen_rect(), color);
 }
 
 global_variable float render_scale = 0.01f;
 
-void draw_arena_borders(float arena_x, float arena_y, u32 color) {
-	arena_x *= render_state.height * render_scale;
-	arena_y *= render_state.height * render_scale;
+struct World_Rect {
+	float x, y, half_size_x, half_size_y;
+};
 
-	int x0 = (int)((float)render_state.width * .5f - arena_x);
-	int x1 = (int)((float)render_state.width * .5f + arena_x);
-	int y0 = (int)((float)render_state.height * .5f - arena_y);
-	int y1 = (int)((float)render_state.height * .5f + arena_y);
+// World to pixel mapping for the current framebuffer size, in 16.16 fixed point.
+// rebuild_viewport_transform remakes it when the framebuffer is resized, next to
+// rebuild_glyph_atlas; drawing only converts. An edge goes to 16.16 world units
+// and then to floor(edge * scale + center), so rects that share a world edge
+// meet on the same pixel. The 16.16 scale is a little off, so the centers carry
+// 1/64 of a pixel of slack: an edge that should land on a whole pixel doesn't
+// end up just short of it.
+struct Viewport_Transform {
+	float pixels_per_unit; // render_state.height * render_scale
+	float world_limit; // Edges are clamped to +-this, which keeps pixels in 16.16 range
+	s64 scale; // Pixels per world unit, 16.16
+	s64 center_x, center_y; // Where the world origin lands, 16.16, plus the slack
+	u32 bias_x, bias_y; // See world_rects_to_pixels
+};
 
-	draw_rect_in_pixels(0, 0, render_state.width, y0, color);
-	draw_rect_in_pixels(0, y1, x1, render_state.height, color);
-	draw_rect_in_pixels(0, y0, x0, y1, color);
-	draw_rect_in_pixels(x1, y0, render_state.width, render_state.height, color);
+global_variable Viewport_Transform viewport;
+
+internal void
+rebuild_viewport_transform() {
+	Viewport_Transform* v = &viewport;
+	v->pixels_per_unit = render_state.height * render_scale;
+	v->scale = (s64)(v->pixels_per_unit * 65536.f + .5f);
+	v->center_x = ((s64)render_state.width << 15) + 1024;
+	v->center_y = ((s64)render_state.height << 15) + 1024;
+	v->world_limit = v->pixels_per_unit > 16384.f / 32767.f ? 16384.f / v->pixels_per_unit : 32767.f;
+	v->bias_x = (u32)((v->scale << 15) - v->center_x);
+	v->bias_y = (u32)((v->scale << 15) - v->center_y);
 }
-// gambar rectangle untuk digerakain
-void draw_rect(float x, float y, float half_size_x, float half_size_y, u32 color) {
 
-	x *= render_state.height*render_scale;
-	y *= render_state.height * render_scale;
-	half_size_x *= render_state.height * render_scale;
-	half_size_y *= render_state.height * render_scale;
+internal int
+world_edge_to_pixel(float edge, s64 center) {
+	// In the order maxps and minps compare, so a NaN ends up the same as in SSE2
+	edge = edge > -viewport.world_limit ? edge : -viewport.world_limit;
+	edge = edge < viewport.world_limit ? edge : viewport.world_limit;
+	s32 world = (s32)(edge * 65536.f);
+	return (int)((((s64)world * viewport.scale >> 16) + center) >> 16);
+}
 
-	x += render_state.width / 2.f;
-	y += render_state.height / 2.f;
+internal Pixel_Rect
+world_to_pixels(float x, float y, float half_size_x, float half_size_y) {
+	Pixel_Rect result;
+	result.x0 = world_edge_to_pixel(x - half_size_x, viewport.center_x);
+	result.y0 = world_edge_to_pixel(y - half_size_y, viewport.center_y);
+	result.x1 = world_edge_to_pixel(x + half_size_x, viewport.center_x);
+	result.y1 = world_edge_to_pixel(y + half_size_y, viewport.center_y);
+	return result;
+}
 
-	// Change to pixels
-	int x0 = x - half_size_x;
-	int x1 = x + half_size_x;
-	int y0 = y - half_size_y;
-	int y1 = y + half_size_y;
+// world_to_pixels for count rects. The SSE2 path does a whole rect per
+// register and gives the same pixels: edges are biased by 2^31 to multiply
+// unsigned, bias_x and bias_y take that back out along with the center, and
+// everything wraps the same way modulo 2^32.
+internal void
+world_rects_to_pixels(const World_Rect* rects, Pixel_Rect* pixels, int count) {
+	int i = 0;
+#if PIXEL_KERNELS_SSE2
+	__m128 limit = _mm_set1_ps(viewport.world_limit);
+	__m128 negate_half = _mm_castsi128_ps(_mm_set_epi32(0, 0, (int)0x80000000, (int)0x80000000));
+	__m128i sign = _mm_set1_epi32((int)0x80000000);
+	__m128i scale = _mm_set1_epi32((int)(u32)viewport.scale);
+	__m128i low = _mm_set_epi32(0, -1, 0, -1);
+	__m128i bias = _mm_set_epi32((int)viewport.bias_y, (int)viewport.bias_x, (int)viewport.bias_y, (int)viewport.bias_x);
+	for (; i < count; i++) {
+		__m128 r = _mm_loadu_ps(&rects[i].x);
+		__m128 center = _mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 0, 1, 0));
+		__m128 half = _mm_xor_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 2, 3, 2)), negate_half);
+		__m128 edges = _mm_add_ps(center, half); // x0, y0, x1, y1
+		edges = _mm_min_ps(_mm_max_ps(edges, _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+
+		__m128i world = _mm_xor_si128(_mm_cvttps_epi32(_mm_mul_ps(edges, _mm_set1_ps(65536.f))), sign);
+		__m128i even = _mm_srli_epi64(_mm_mul_epu32(world, scale), 16);
+		__m128i odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(world, 32), scale), 16);
+		__m128i fixed = _mm_sub_epi32(_mm_or_si128(_mm_and_si128(even, low), _mm_slli_epi64(odd, 32)), bias);
+		_mm_storeu_si128((__m128i*)&pixels[i], _mm_srai_epi32(fixed, 16));
+	}
+#endif
+	for (; i < count; i++) {
+		pixels[i] = world_to_pixels(rects[i].x, rects[i].y, rects[i].half_size_x, rects[i].half_size_y);
+	}
+}
+
+// Glyphs and digits are laid out as world space rects. A sink either rasterizes
+// them or only collects their pixel bounds for the command buffer. It converts
+// them in batches, on flush_rect_sink or when it fills up.
+#define RECT_SINK_SIZE 64
+
+struct Rect_Sink {
+	bool rasterize;
+	u32 color;
+	Pixel_Rect bounds;
+	Pixel_Rect clip;
+	u32 alpha;
+
+	int count;
+	World_Rect rects[RECT_SINK_SIZE];
+};
 
-	draw_rect_in_pixels(x0, y0, x1, y1, color);
+internal void
+flush_rect_sink(Rect_Sink* sink) {
+	Pixel_Rect pixels[RECT_SINK_SIZE];
+	world_rects_to_pixels(sink->rects, pixels, sink->count);
+	for (int i = 0; i < sink->count; i++) {
+		Pixel_Rect r = pixels[i];
+		if (sink->rasterize) {
+			draw_rect_clipped(r.x0, r.y0, r.x1, r.y1, sink->clip, sink->color, sink->alpha);
+		} else {
+			r = clip_to_screen(r);
+			if (rect_is_empty(r)) continue;
+			sink->bounds = rect_is_empty(sink->bounds) ? r : rect_union(sink->bounds, r);
+		}
+	}
+	sink->count = 0;
+}
+
+internal void
+sink_rect(Rect_Sink* sink, float x, float y, float half_size_x, float half_size_y) {
+	if (sink->count == RECT_SINK_SIZE) flush_rect_sink(sink);
+	sink->rects[sink->count++] = { x, y, half_size_x, half_size_y };
 }
 
-const char* letters[][7] = {
+constexpr const char* letters[][7] = {
     " 00",
     "0  0",
     "0  0",
@@ -291,38 +394,15 @@ const char* letters[][7] = {
 	"0",
 };
 
-void draw_text(const char *text, float x, float y, float size, u32 color) {
-	float half_size = size * .5f;
-	float original_y = y;
-
-	while (*text) {
-		if (*text != 32) {
-			const char** letter;
-			if (*text == 47) letter = letters[27];
-			else if (*text == 46) letter = letters[26];
-			else letter = letters[*text - 'A'];
-			float original_x = x;
-
-			for (int i = 0; i < 7; i++) {
-				const char* row = letter[i];
-				while (*row) {
-					if (*row == '0') {
-						draw_rect(x, y, half_size, half_size, color);
-					}
-					x += size;
-					row++;
-				}
-				y -= size;
-				x = original_x;
-			}
-		}
-		text++;
-		x += size * 6.f;
-		y = original_y;
-	}
+internal int
+letter_index(char c) {
+	if (c == 47) return 27;
+	if (c == 46) return 26;
+	return c - 'A';
 }
 
-void draw_number(int number, float x, float y, float size, u32 color) {
+internal void
+number_rects(int number, float x, float y, float size, Rect_Sink* sink) {
 	float half_size = size * .5f;
 
 	bool drew_number = false;
@@ -334,84 +414,85 @@ void draw_number(int number, float x, float y, float size, u32 color) {
 
 		switch (digit) {
 		case 0: {
-			draw_rect(x - size, y, half_size, 2.5f * size, color);
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
-			draw_rect(x, y + size * 2.f, half_size, half_size, color);
-			draw_rect(x, y - size * 2.f, half_size, half_size, color);
+			sink_rect(sink, x - size, y, half_size, 2.5f * size);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
+			sink_rect(sink, x, y + size * 2.f, half_size, half_size);
+			sink_rect(sink, x, y - size * 2.f, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 1: {
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
 			x -= size * 2.f;
 		} break;
 
 		case 2: {
-			draw_rect(x, y + size * 2.f, 1.5f * size, half_size, color);
-			draw_rect(x, y, 1.5f * size, half_size, color);
-			draw_rect(x, y - size * 2.f, 1.5f * size, half_size, color);
-			draw_rect(x + size, y + size, half_size, half_size, color);
-			draw_rect(x - size, y - size, half_size, half_size, color);
+			sink_rect(sink, x, y + size * 2.f, 1.5f * size, half_size);
+			sink_rect(sink, x, y, 1.5f * size, half_size);
+			sink_rect(sink, x, y - size * 2.f, 1.5f * size, half_size);
+			sink_rect(sink, x + size, y + size, half_size, half_size);
+			sink_rect(sink, x - size, y - size, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 3: {
-			draw_rect(x - half_size, y + size * 2.f, size, half_size, color);
-			draw_rect(x - half_size, y, size, half_size, color);
-			draw_rect(x - half_size, y - size * 2.f, size, half_size, color);
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
+			sink_rect(sink, x - half_size, y + size * 2.f, size, half_size);
+			sink_rect(sink, x - half_size, y, size, half_size);
+			sink_rect(sink, x - half_size, y - size * 2.f, size, half_size);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
 			x -= size * 4.f;
 		} break;
 
 		case 4: {
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
-			draw_rect(x - size, y + size, half_size, 1.5f * size, color);
-			draw_rect(x, y, half_size, half_size, color);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
+			sink_rect(sink, x - size, y + size, half_size, 1.5f * size);
+			sink_rect(sink, x, y, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 5: {
-			draw_rect(x, y + size * 2.f, 1.5f * size, half_size, color);
-			draw_rect(x, y, 1.5f * size, half_size, color);
-			draw_rect(x, y - size * 2.f, 1.5f * size, half_size, color);
-			draw_rect(x - size, y + size, half_size, half_size, color);
-			draw_rect(x + size, y - size, half_size, half_size, color);
+			sink_rect(sink, x, y + size * 2.f, 1.5f * size, half_size);
+			sink_rect(sink, x, y, 1.5f * size, half_size);
+			sink_rect(sink, x, y - size * 2.f, 1.5f * size, half_size);
+			sink_rect(sink, x - size, y + size, half_size, half_size);
+			sink_rect(sink, x + size, y - size, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 6: {
-			draw_rect(x + half_size, y + size * 2.f, size, half_size, color);
-			draw_rect(x + half_size, y, size, half_size, color);
-			draw_rect(x + half_size, y - size * 2.f, size, half_size, color);
-			draw_rect(x - size, y, half_size, 2.5f * size, color);
-			draw_rect(x + size, y - size, half_size, half_size, color);
+			sink_rect(sink, x + half_size, y + size * 2.f, size, half_size);
+			sink_rect(sink, x + half_size, y, size, half_size);
+			sink_rect(sink, x + half_size, y - size * 2.f, size, half_size);
+			sink_rect(sink, x - size, y, half_size, 2.5f * size);
+			sink_rect(sink, x + size, y - size, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 7: {
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
-			draw_rect(x - half_size, y + size * 2.f, size, half_size, color);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
+			sink_rect(sink, x - half_size, y + size * 2.f, size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 8: {
-			draw_rect(x - size, y, half_size, 2.5f * size, color);
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
-			draw_rect(x, y + size * 2.f, half_size, half_size, color);
-			draw_rect(x, y - size * 2.f, half_size, half_size, color);
-			draw_rect(x, y, half_size, half_size, color);
+			sink_rect(sink, x - size, y, half_size, 2.5f * size);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
+			sink_rect(sink, x, y + size * 2.f, half_size, half_size);
+			sink_rect(sink, x, y - size * 2.f, half_size, half_size);
+			sink_rect(sink, x, y, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 
 		case 9: {
-			draw_rect(x - half_size, y + size * 2.f, size, half_size, color);
-			draw_rect(x - half_size, y, size, half_size, color);
-			draw_rect(x - half_size, y - size * 2.f, size, half_size, color);
-			draw_rect(x + size, y, half_size, 2.5f * size, color);
-			draw_rect(x - size, y + size, half_size, half_size, color);
+			sink_rect(sink, x - half_size, y + size * 2.f, size, half_size);
+			sink_rect(sink, x - half_size, y, size, half_size);
+			sink_rect(sink, x - half_size, y - size * 2.f, size, half_size);
+			sink_rect(sink, x + size, y, half_size, 2.5f * size);
+			sink_rect(sink, x - size, y + size, half_size, half_size);
 			x -= size * 4.f;
 		} break;
 		}
 
 	}
+	flush_rect_sink(sink);
 }
@@ -0,0 +1,435 @@
+// Replays: every tick's Button_State, enough to play a match again tick for
+// tick since simulate_game depends on nothing else. Written by the game loop
+// with -save_replay FILE, played back with -replay FILE or fast-forwarded
+// without a window by replay_tool.cpp.
+//
+// Layout, all little endian: a Replay_Header, then records, each starting with
+// a varint of value << 2 | tag:
+//   REPLAY_RUN       value ticks with the same buttons as the tick before.
+//   REPLAY_BUTTONS   one tick; value is the mask of buttons that differ from
+//                    the tick before, each followed by a flags byte (REPLAY_*
+//                    bits), presses and releases if REPLAY_COUNTS, and held as
+//                    a float if it's REPLAY_HELD_EXACT.
+//   REPLAY_SNAPSHOT  u64 tick, then the Game_State before that tick as bytes.
+//                    The tick before a snapshot counts as all buttons up.
+//   REPLAY_END       then the snapshot index (Replay_Snapshot each) and a
+//                    Replay_Footer.
+// A file without a footer, from a crash, plays up to the last whole record;
+// the index is made by scanning it.
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define REPLAY_MAGIC 0x4c505250 // "PRPL"
+#define REPLAY_FOOTER_MAGIC 0x58505250 // "PRPX"
+#define REPLAY_VERSION 2 // 2 added Game_State::ai_level
+#define REPLAY_SNAPSHOT_TICKS (SIM_HZ * 10)
+#define REPLAY_WRITE_BUFFER (64 * 1024)
+
+enum {
+	REPLAY_RUN,
+	REPLAY_BUTTONS,
+	REPLAY_SNAPSHOT,
+	REPLAY_END,
+};
+
+// Button flags
+#define REPLAY_IS_DOWN 0x1
+#define REPLAY_CHANGED 0x2
+#define REPLAY_COUNTS 0x4
+#define REPLAY_HELD_ONE 0x8 // Otherwise held is 0
+#define REPLAY_HELD_EXACT 0x10
+
+struct Replay_Header {
+	u32 magic, version;
+	u32 sim_hz;
+	u32 state_size; // sizeof(Game_State), a replay only plays in the build that wrote it
+	u32 button_count;
+	u32 seed; // The game has no randomness yet, this is 0 until it does
+};
+
+struct Replay_Snapshot {
+	u64 tick;
+	u64 offset; // Of the record after it
+};
+
+struct Replay_Footer {
+	u64 tick_count;
+	u64 index_offset;
+	u32 snapshot_count;
+	u32 magic;
+};
+
+internal void
+replay_put_varint(u8** at, u64 value) {
+	while (value >= 0x80) {
+		*(*at)++ = (u8)(value | 0x80);
+		value >>= 7;
+	}
+	*(*at)++ = (u8)value;
+}
+
+// Returns false past end.
+internal bool
+replay_get_varint(u8** at, u8* end, u64* value) {
+	*value = 0;
+	for (int shift = 0; *at < end && shift < 64; shift += 7) {
+		u8 byte = *(*at)++;
+		*value |= (u64)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+internal bool
+replay_buttons_equal(Button_State* a, Button_State* b, int count) {
+	for (int i = 0; i < count; i++) {
+		if (a[i].is_down != b[i].is_down || a[i].changed != b[i].changed ||
+			a[i].presses != b[i].presses || a[i].releases != b[i].releases || a[i].held != b[i].held) return false;
+	}
+	return true;
+}
+
+// A snapshot as a state. A damaged file can still hold anything, so a level
+// that doesn't exist reads as AI_CLASSIC and never indexes past ai_levels.
+internal void
+replay_load_state(Game_State* state, u8* snapshot) {
+	memcpy(state, snapshot, sizeof(Game_State));
+	if (state->ai_level >= AI_LEVEL_COUNT) state->ai_level = AI_CLASSIC;
+}
+
+// Compared field by field, the padding in a snapshot is whatever it was.
+internal bool
+replay_state_matches(Game_State* state, u8* snapshot) {
+	Game_State other;
+	replay_load_state(&other, snapshot);
+	return state->current_gamemode == other.current_gamemode && state->hot_button == other.hot_button &&
+		state->enemy_is_ai == other.enemy_is_ai && state->ai_level == other.ai_level &&
+		!memcmp(&state->match, &other.match, sizeof(Match));
+}
+
+
+// Writing, on the game thread. Records go through a buffer, so a tick costs
+// a compare and now and then an fwrite.
+
+struct Replay_Writer {
+	FILE* file;
+	u8 buffer[REPLAY_WRITE_BUFFER];
+	int used;
+	u64 offset; // Bytes in the file and the buffer
+	u64 tick;
+	u64 run; // Ticks like last that aren't written yet
+	Button_State last[BUTTON_COUNT];
+	std::vector<Replay_Snapshot> snapshots;
+};
+
+internal void
+replay_flush(Replay_Writer* writer) {
+	fwrite(writer->buffer, 1, writer->used, writer->file);
+	writer->used = 0;
+}
+
+// Makes room for size bytes and returns where they go.
+internal u8*
+replay_reserve(Replay_Writer* writer, int size) {
+	if (writer->used + size > REPLAY_WRITE_BUFFER) replay_flush(writer);
+	return writer->buffer + writer->used;
+}
+
+internal void
+replay_commit(Replay_Writer* writer, u8* end) {
+	int size = (int)(end - (writer->buffer + writer->used));
+	writer->used += size;
+	writer->offset += size;
+}
+
+internal void
+replay_write_run(Replay_Writer* writer) {
+	if (!writer->run) return;
+	u8* at = replay_reserve(writer, 10);
+	replay_put_varint(&at, writer->run << 2 | REPLAY_RUN);
+	replay_commit(writer, at);
+	writer->run = 0;
+}
+
+internal bool
+open_replay_writer(Replay_Writer* writer, const char* path) {
+	writer->file = fopen(path, "wb");
+	if (!writer->file) return false;
+	Replay_Header header = {REPLAY_MAGIC, REPLAY_VERSION, SIM_HZ, sizeof(Game_State), BUTTON_COUNT, 0};
+	fwrite(&header, sizeof(header), 1, writer->file);
+	writer->used = 0;
+	writer->offset = sizeof(header);
+	writer->tick = writer->run = 0;
+	memset(writer->last, 0, sizeof(writer->last));
+	writer->snapshots.clear();
+	return true;
+}
+
+// Before simulate_game, with the state the tick starts from.
+internal void
+replay_write_tick(Replay_Writer* writer, Game_State* state, Input* input) {
+	if (writer->tick % REPLAY_SNAPSHOT_TICKS == 0) {
+		replay_write_run(writer);
+		u8* at = replay_reserve(writer, 1 + sizeof(u64) + sizeof(Game_State));
+		*at++ = REPLAY_SNAPSHOT;
+		memcpy(at, &writer->tick, sizeof(u64));
+		memcpy(at + sizeof(u64), state, sizeof(Game_State));
+		replay_commit(writer, at + sizeof(u64) + sizeof(Game_State));
+		writer->snapshots.push_back({writer->tick, writer->offset});
+		memset(writer->last, 0, sizeof(writer->last));
+	}
+	writer->tick++;
+
+	Button_State* buttons = input->buttons;
+	if (replay_buttons_equal(buttons, writer->last, BUTTON_COUNT)) {
+		writer->run++;
+		return;
+	}
+	replay_write_run(writer);
+
+	u8* at = replay_reserve(writer, 10 + BUTTON_COUNT * 7);
+	u64 mask = 0;
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		if (!replay_buttons_equal(&buttons[i], &writer->last[i], 1)) mask |= 1ull << i;
+	}
+	replay_put_varint(&at, mask << 2 | REPLAY_BUTTONS);
+	for (int i = 0; i < BUTTON_COUNT; i++) {
+		if (!(mask & (1ull << i))) continue;
+		Button_State* b = &buttons[i];
+		u8 flags = (b->is_down ? REPLAY_IS_DOWN : 0) | (b->changed ? REPLAY_CHANGED : 0);
+		if (b->presses || b->releases) flags |= REPLAY_COUNTS;
+		if (b->held == 1.f) flags |= REPLAY_HELD_ONE;
+		else if (b->held != 0.f) flags |= REPLAY_HELD_EXACT;
+		*at++ = flags;
+		if (flags & REPLAY_COUNTS) {
+			*at++ = b->presses;
+			*at++ = b->releases;
+		}
+		if (flags & REPLAY_HELD_EXACT) {
+			memcpy(at, &b->held, sizeof(float));
+			at += sizeof(float);
+		}
+		writer->last[i] = *b;
+	}
+	replay_commit(writer, at);
+}
+
+internal void
+close_replay_writer(Replay_Writer* writer) {
+	if (!writer->file) return;
+	replay_write_run(writer);
+	u8* at = replay_reserve(writer, 1);
+	*at++ = REPLAY_END;
+	replay_commit(writer, at);
+	replay_flush(writer);
+
+	Replay_Footer footer = {writer->tick, writer->offset, (u32)writer->snapshots.size(), REPLAY_FOOTER_MAGIC};
+	fwrite(writer->snapshots.data(), sizeof(Replay_Snapshot), writer->snapshots.size(), writer->file);
+	fwrite(&footer, sizeof(footer), 1, writer->file);
+	fclose(writer->file);
+	writer->file = 0;
+}
+
+
+// Reading, from the file mapped whole.
+
+struct Replay {
+	u8* data;
+	size_t size;
+	u8* end; // Of the records
+	u64 tick_count;
+	std::vector<Replay_Snapshot> snapshots;
+#if defined(_WIN32)
+	HANDLE file, mapping;
+#endif
+
+	// Playback
+	u64 tick; // Of the next tick
+	u8* at;
+	u64 run;
+	Input input; // Buttons of the last tick read, no events
+	u8* snapshot; // Game_State bytes if the last tick read had a snapshot, else 0
+};
+
+internal bool
+replay_map(Replay* replay, const char* path) {
+#if defined(_WIN32)
+	replay->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (replay->file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	replay->mapping = GetFileSizeEx(replay->file, &size) && size.QuadPart ? CreateFileMappingA(replay->file, 0, PAGE_READONLY, 0, 0, 0) : 0;
+	replay->data = replay->mapping ? (u8*)MapViewOfFile(replay->mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+	if (!replay->data) {
+		if (replay->mapping) CloseHandle(replay->mapping);
+		CloseHandle(replay->file);
+		return false;
+	}
+	replay->size = (size_t)size.QuadPart;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return false;
+	struct stat info;
+	void* memory = fstat(file, &info) == 0 && info.st_size ? mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	close(file);
+	if (memory == MAP_FAILED) return false;
+	replay->data = (u8*)memory;
+	replay->size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+internal void
+close_replay(Replay* replay) {
+	if (!replay->data) return;
+#if defined(_WIN32)
+	UnmapViewOfFile(replay->data);
+	CloseHandle(replay->mapping);
+	CloseHandle(replay->file);
+#else
+	munmap(replay->data, replay->size);
+#endif
+	replay->data = 0;
+}
+
+// Reads the tick at replay->at into replay->input. Returns false at the end
+// or at a record that was cut off.
+internal bool
+replay_read_tick(Replay* replay) {
+	replay->snapshot = 0;
+	Button_State* buttons = replay->input.buttons;
+	if (replay->run) {
+		replay->run--;
+		replay->tick++;
+		return true;
+	}
+
+	for (;;) {
+		u8* at = replay->at;
+		u64 value;
+		if (!replay_get_varint(&at, replay->end, &value)) return false;
+		int tag = (int)(value & 3);
+		value >>= 2;
+
+		if (tag == REPLAY_SNAPSHOT) {
+			if (replay->end - at < (s64)(sizeof(u64) + sizeof(Game_State))) return false;
+			replay->snapshot = at + sizeof(u64);
+			replay->at = at + sizeof(u64) + sizeof(Game_State);
+			memset(buttons, 0, sizeof(replay->input.buttons));
+			continue;
+		}
+		if (tag == REPLAY_RUN) {
+			if (!value) return false;
+			replay->at = at;
+			replay->run = value - 1;
+			replay->tick++;
+			return true;
+		}
+		if (tag != REPLAY_BUTTONS) return false;
+
+		for (int i = 0; i < BUTTON_COUNT; i++) {
+			if (!(value & (1ull << i))) continue;
+			if (at >= replay->end) return false;
+			u8 flags = *at++;
+			Button_State b = {};
+			b.is_down = (flags & REPLAY_IS_DOWN) != 0;
+			b.changed = (flags & REPLAY_CHANGED) != 0;
+			if (flags & REPLAY_COUNTS) {
+				if (replay->end - at < 2) return false;
+				b.presses = at[0];
+				b.releases = at[1];
+				at += 2;
+			}
+			if (flags & REPLAY_HELD_EXACT) {
+				if (replay->end - at < (s64)sizeof(float)) return false;
+				memcpy(&b.held, at, sizeof(float));
+				at += sizeof(float);
+			} else {
+				b.held = flags & REPLAY_HELD_ONE ? 1.f : 0.f;
+			}
+			buttons[i] = b;
+		}
+		replay->at = at;
+		replay->tick++;
+		return true;
+	}
+}
+
+// Back to right before tick 0.
+internal void
+replay_rewind(Replay* replay) {
+	replay->at = replay->data + sizeof(Replay_Header);
+	replay->tick = replay->run = 0;
+	replay->input = {};
+	replay->snapshot = 0;
+}
+
+// Maps the file and finds its snapshots: from the index when the file is
+// whole, otherwise by reading it through.
+internal bool
+open_replay(Replay* replay, const char* path) {
+	if (!replay_map(replay, path)) return false;
+	Replay_Header* header = (Replay_Header*)replay->data;
+	if (replay->size < sizeof(Replay_Header) || header->magic != REPLAY_MAGIC || header->version != REPLAY_VERSION ||
+		header->sim_hz != SIM_HZ || header->state_size != sizeof(Game_State) || header->button_count != BUTTON_COUNT) {
+		close_replay(replay);
+		return false;
+	}
+
+	replay->snapshots.clear();
+	Replay_Footer footer = {};
+	if (replay->size >= sizeof(Replay_Header) + sizeof(Replay_Footer)) memcpy(&footer, replay->data + replay->size - sizeof(footer), sizeof(footer));
+	u64 index_size = (u64)footer.snapshot_count * sizeof(Replay_Snapshot);
+	if (footer.magic == REPLAY_FOOTER_MAGIC && footer.index_offset + index_size + sizeof(footer) == replay->size) {
+		replay->end = replay->data + footer.index_offset;
+		replay->tick_count = footer.tick_count;
+		replay->snapshots.resize(footer.snapshot_count);
+		memcpy(replay->snapshots.data(), replay->end, index_size);
+	} else {
+		replay->end = replay->data + replay->size;
+		replay_rewind(replay);
+		while (replay_read_tick(replay)) {
+			if (replay->snapshot) replay->snapshots.push_back({replay->tick - 1, (u64)(replay->snapshot + sizeof(Game_State) - replay->data)});
+		}
+		replay->tick_count = replay->tick;
+	}
+	replay_rewind(replay);
+	return true;
+}
+
+// Next tick's buttons into replay->input. Returns false after the last tick.
+internal bool
+replay_next_tick(Replay* replay) {
+	if (replay->tick >= replay->tick_count) return false;
+	return replay_read_tick(replay);
+}
+
+// Puts the replay right before tick and state where the game was then,
+// starting from the nearest snapshot at or before it.
+internal bool
+replay_seek(Replay* replay, u64 tick, Game_State* state) {
+	if (tick > replay->tick_count) return false;
+	Replay_Snapshot* from = 0;
+	for (size_t i = 0; i < replay->snapshots.size() && replay->snapshots[i].tick <= tick; i++) from = &replay->snapshots[i];
+	if (!from) return false;
+
+	u8* snapshot = replay->data + from->offset - sizeof(Game_State);
+	replay_load_state(state, snapshot);
+	replay->at = replay->data + from->offset;
+	replay->tick = from->tick;
+	replay->run = 0;
+	replay->input = {};
+	replay->snapshot = 0;
+	while (replay->tick < tick && replay_next_tick(replay)) simulate_game(state, &replay->input, SIM_DT);
+	return replay->tick == tick;
+}
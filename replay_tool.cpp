@@ -0,0 +1,116 @@
+// Plays a replay (see replay.cpp) without a window, as fast as simulate_game
+// goes, and prints where the match ended up. -verify checks the re-simulated
+// state against every snapshot in the file, which is how a change that breaks
+// determinism shows up. -seek TICK starts from the nearest snapshot and prints
+// the state at TICK. -repeat N plays it N times, for timing.
+// Build as its own console program:
+//   cl /O2 replay_tool.cpp        or        g++ -O2 -pthread replay_tool.cpp -o replay_tool
+// Usage: replay_tool FILE [-verify] [-seek TICK] [-repeat N]
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "platform_common.cpp"
+#include "profiler.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "frame_buffers.cpp"
+#include "pixel_kernels.cpp"
+#include "renderer.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+#include "profiler_overlay.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+#include "effects.cpp"
+#include "gamemovement.cpp"
+#include "replay.cpp"
+
+internal double
+seconds_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal void
+print_state(const char* label, u64 tick, Game_State* state) {
+	Match* m = &state->match;
+	printf("%-11s tick %llu, %s, %d - %d, paddles %.4f %.4f, ball %.4f %.4f\n", label, (unsigned long long)tick,
+		state->current_gamemode == GM_GAMEPLAY ? (state->enemy_is_ai ? "vs ai" : "two players") : "menu",
+		m->player_1_score, m->player_2_score, m->player_1_p, m->player_2_p, m->ball_p_x, m->ball_p_y);
+}
+
+int main(int argc, char** argv) {
+	const char* path = 0;
+	bool verify = false;
+	s64 seek = -1;
+	int repeat = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-verify")) verify = true;
+		else if (!strcmp(argv[i], "-seek") && i + 1 < argc) seek = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-repeat") && i + 1 < argc) repeat = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && !path) path = argv[i];
+		else {
+			fprintf(stderr, "usage: %s FILE [-verify] [-seek TICK] [-repeat N]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s FILE [-verify] [-seek TICK] [-repeat N]\n", argv[0]);
+		return 1;
+	}
+	if (repeat < 1) repeat = 1;
+
+	static Replay replay;
+	if (!open_replay(&replay, path)) {
+		fprintf(stderr, "can't read %s as a replay of this build\n", path);
+		return 1;
+	}
+	printf("replay      %llu ticks (%.1f minutes), %d snapshots\n", (unsigned long long)replay.tick_count,
+		replay.tick_count / (double)SIM_HZ / 60., (int)replay.snapshots.size());
+
+	if (seek >= 0) {
+		Game_State state;
+		double begin = seconds_now();
+		if (!replay_seek(&replay, (u64)seek, &state)) {
+			fprintf(stderr, "can't seek to tick %lld\n", (long long)seek);
+			return 1;
+		}
+		printf("seek        %.3f ms\n", (seconds_now() - begin) * 1e3);
+		print_state("state", replay.tick, &state);
+		close_replay(&replay);
+		return 0;
+	}
+
+	Game_State state = {};
+	int mismatches = 0;
+	double begin = seconds_now();
+	for (int run = 0; run < repeat; run++) {
+		replay_seek(&replay, 0, &state); // An online match doesn't start at the menu
+		while (replay_next_tick(&replay)) {
+			if (verify && replay.snapshot && !replay_state_matches(&state, replay.snapshot)) {
+				if (run == 0) printf("mismatch    at the snapshot before tick %llu\n", (unsigned long long)(replay.tick - 1));
+				mismatches++;
+				replay_load_state(&state, replay.snapshot); // So the next snapshot tells something new
+			}
+			simulate_game(&state, &replay.input, SIM_DT);
+		}
+	}
+	double elapsed = seconds_now() - begin;
+
+	u64 ticks = replay.tick_count * repeat;
+	printf("ticks/sec   %.0f\n", ticks / elapsed);
+	print_state("final", replay.tick, &state);
+	if (verify) printf("verify      %s\n", mismatches ? "FAILED" : "ok");
+
+	close_replay(&replay);
+	return mismatches ? 1 : 0;
+}
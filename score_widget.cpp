@@ -0,0 +1,81 @@
+// Cached score widget. When the value changes the number is drawn once over
+// the background and the result, background included, is captured into a
+// bitmap. After that the widget only blits the bitmap back when the dirty
+// tracker restored background over it, and costs nothing on other frames.
+// Anything drawn before a widget and overlapping it gets captured too, so draw
+// widgets right after the background.
+
+#define SCORE_WIDGET_MAX_PIXELS (256 * 1024)
+
+struct Score_Widget {
+	bool valid;
+	int value;
+	float x, y, size;
+	u32 color;
+	u8 alpha;
+	int screen_width, screen_height;
+
+	Bitmap bitmap;
+	u32 pixels[SCORE_WIDGET_MAX_PIXELS];
+};
+
+internal Pixel_Rect
+number_bounds(int number, float x, float y, float size) {
+	Rect_Sink sink = {};
+	number_rects(number, x, y, size, &sink);
+	return sink.bounds;
+}
+
+internal void
+draw_score(Score_Widget* widget, int value, float x, float y, float size, u32 color) {
+	bool unchanged = widget->valid && widget->value == value && widget->x == x && widget->y == y &&
+		widget->size == size && widget->color == color && widget->alpha == render_commands.alpha &&
+		widget->screen_width == render_state.width && widget->screen_height == render_state.height;
+
+	if (unchanged) {
+		if (dirty.full_redraw || dirty_previous_touches(widget->bitmap.rect)) {
+			push_bitmap(RC_BLIT, &widget->bitmap);
+			dirty_record_present(widget->bitmap.rect);
+		}
+		return;
+	}
+
+	Pixel_Rect bounds = number_bounds(value, x, y, size);
+	Pixel_Rect old_bounds = widget->valid ? widget->bitmap.rect : bounds;
+	if (widget->screen_width != render_state.width || widget->screen_height != render_state.height) old_bounds = bounds;
+	Pixel_Rect area = rect_is_empty(old_bounds) ? bounds : rect_union(old_bounds, bounds);
+
+	widget->valid = false;
+	widget->value = value;
+	widget->x = x;
+	widget->y = y;
+	widget->size = size;
+	widget->color = color;
+	widget->alpha = render_commands.alpha;
+	widget->screen_width = render_state.width;
+	widget->screen_height = render_state.height;
+
+	// Too big to cache: draw it like any other number.
+	if (rect_area(bounds) > SCORE_WIDGET_MAX_PIXELS) {
+		if (!rect_is_empty(old_bounds)) dirty_list_add(&dirty.current, old_bounds);
+		draw_number(value, x, y, size, color);
+		return;
+	}
+
+	// Wipe the old digits, draw the new ones and keep them.
+	dirty.suspended++;
+	if (!rect_is_empty(area)) {
+		push_clip(area);
+		restore_background();
+		push_clip(screen_rect());
+	}
+	push_number(value, x, y, size, color);
+	dirty.suspended--;
+
+	widget->bitmap.pixels = widget->pixels;
+	widget->bitmap.capacity = SCORE_WIDGET_MAX_PIXELS;
+	widget->bitmap.rect = bounds;
+	push_bitmap(RC_CAPTURE, &widget->bitmap);
+	dirty_record_present(area);
+	widget->valid = !rect_is_empty(bounds);
+}
@@ -0,0 +1,461 @@
+// Self-play harness for tuning the AI offline. Every parameter set of a sweep
+// plays -matches single player matches as player 1, the game's AI paddle,
+// against -opponent (an AI level from ai_opponent.cpp, or random: the held
+// keys headless.cpp plays with). The matches run in Match_Batch chunks of
+// SELF_PLAY_CHUNK, one work item each, on a work_pool.cpp pool over every core;
+// items share nothing but their own row of tallies, so it scales with cores.
+// Match n of every set starts from the same dealt serve and paddles, so sets
+// are compared on the same matches. -levels plays the built in levels instead
+// of a sweep.
+//
+// A sweep is AXIS=VALUE or AXIS=FROM:TO:STEP, comma separated, over the
+// Ai_Params fields predict, gain, damping, max_ddp and error; axes left out
+// keep the default sweep's values.
+//
+// The result goes to -out FILE (self_play.col) one row per set, as columns:
+//   char magic[4] "PCOL", u32 version, u32 row_count, u32 column_count
+//   column_count times: char name[24] zero padded, u32 type (0 f32, 1 s64), u64 offset
+//   then each column's row_count values at its offset, little endian
+// numpy.frombuffer(data, dtype, row_count, offset) reads one straight out.
+//
+// Build as its own console program:
+//   cl /O2 self_play.cpp        or        g++ -O2 -pthread self_play.cpp -o self_play
+// Usage: self_play [-matches N] [-sweep SPEC] [-levels] [-opponent LEVEL|random]
+//                  [-minutes N] [-threads N] [-seed N] [-top N] [-out FILE]
+
+#include "utilis.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "profiler.cpp"
+#include "work_pool.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+
+#define POINTS_PER_MATCH 11
+#define SELF_PLAY_CHUNK 256
+#define RALLY_HISTOGRAM 64 // Rallies of more returns count in the last bucket
+#define OPPONENT_RANDOM -1
+#define SWEEP_AXES 5 // The Ai_Params fields a sweep can vary
+
+internal double
+seconds_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+internal u32
+xorshift32(u32* state) {
+	u32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// Same values the keyboard produces: W, S or nothing.
+struct Random_Input {
+	u32 state;
+	float ddp;
+	int hold;
+};
+
+internal float
+random_input(Random_Input* input) {
+	if (input->hold-- <= 0) {
+		u32 r = xorshift32(&input->state);
+		input->ddp = (r % 3 == 0) ? 2000.f : (r % 3 == 1) ? -2000.f : 0.f;
+		input->hold = (int)((r >> 8) % (SIM_HZ / 2));
+	}
+	return input->ddp;
+}
+
+// One work item's tallies, summed per set afterwards. A rally ends with a point
+// and its length is in returns: every time the ball turns around off a paddle.
+// player_1_score counts the balls past the right edge, the tuned AI's.
+struct Self_Play_Stats {
+	s64 matches, wins, losses, timeouts;
+	s64 points_for, points_against;
+	s64 rallies, rally_ticks, rally_returns;
+	s64 ticks;
+	s64 returns_histogram[RALLY_HISTOGRAM];
+};
+
+// What a chunk keeps per match besides the match.
+struct Self_Play_Lane {
+	Random_Input opponent;
+	int score_sum;
+	bool ball_right; // Moving right on the last tick
+	s64 rally_start;
+	int returns;
+};
+
+struct alignas(64) Self_Play_Worker {
+	Match_Batch batch;
+	float player_1_ddp[SELF_PLAY_CHUNK];
+	float player_2_ddp[SELF_PLAY_CHUNK];
+	Self_Play_Lane lanes[SELF_PLAY_CHUNK];
+};
+
+struct Self_Play {
+	std::vector<Ai_Params> sets;
+	int opponent; // An Ai_Level, or OPPONENT_RANDOM
+	int matches_per_set;
+	int chunks_per_set;
+	s64 max_ticks; // Per match, the ones still going then count as timeouts
+	u32 seed;
+
+	std::vector<Self_Play_Stats> items; // One per chunk of every set
+	std::vector<Self_Play_Worker> workers;
+};
+
+// Match n of a set: a serve to either side at some angle, the paddles somewhere.
+internal void
+deal_match(Self_Play* play, int n, Match_Batch* batch, int i, Self_Play_Lane* lane) {
+	u32 state = play->seed ^ ((u32)n * 0x9e3779b9 + 0x6d2b79f5);
+	if (!state) state = 1;
+	for (int warm = 0; warm < 4; warm++) xorshift32(&state);
+
+	Match match;
+	init_match(&match);
+	u32 r = xorshift32(&state);
+	if (r & 1) match.ball_dp_x = -match.ball_dp_x;
+	match.ball_dp_y = (float)((int)((r >> 1) % 121) - 60);
+	match.player_1_p = (float)((int)((r >> 8) % 41) - 20);
+	match.player_2_p = (float)((int)((r >> 16) % 41) - 20);
+	match_batch_set(batch, i, &match);
+
+	*lane = {};
+	lane->opponent.state = xorshift32(&state) | 1;
+	lane->ball_right = match.ball_dp_x > 0;
+}
+
+internal void
+tally_match(Self_Play_Stats* stats, int score_1, int score_2) {
+	stats->matches++;
+	stats->wins += score_2 >= POINTS_PER_MATCH;
+	stats->losses += score_1 >= POINTS_PER_MATCH;
+	stats->timeouts += score_1 < POINTS_PER_MATCH && score_2 < POINTS_PER_MATCH;
+	stats->points_for += score_2;
+	stats->points_against += score_1;
+}
+
+internal void
+self_play_job(int index, int worker, void* data) {
+	Self_Play* play = (Self_Play*)data;
+	Self_Play_Worker* w = &play->workers[worker];
+	Self_Play_Stats* stats = &play->items[index];
+	const Ai_Params* params = &play->sets[index / play->chunks_per_set];
+	int first = (index % play->chunks_per_set) * SELF_PLAY_CHUNK;
+	int count = std::min(SELF_PLAY_CHUNK, play->matches_per_set - first);
+
+	Match_Batch* b = &w->batch;
+	b->count = count;
+	for (int i = 0; i < count; i++) deal_match(play, first + i, b, i, &w->lanes[i]);
+	*stats = {};
+
+	s64 tick = 0;
+	for (; b->count && tick < play->max_ticks; tick++) {
+		ai_batch_params_ddp(b, 1, params, w->player_1_ddp);
+		if (play->opponent == OPPONENT_RANDOM) {
+			for (int i = 0; i < b->count; i++) w->player_2_ddp[i] = random_input(&w->lanes[i].opponent);
+		} else {
+			ai_batch_ddp(b, 2, (Ai_Level)play->opponent, w->player_2_ddp);
+		}
+		simulate_match_batch(b, w->player_1_ddp, w->player_2_ddp, SIM_DT);
+		stats->ticks += b->count;
+
+		for (int i = 0; i < b->count; i++) {
+			Self_Play_Lane* lane = &w->lanes[i];
+			int score_1 = b->player_1_score[i], score_2 = b->player_2_score[i];
+			bool ball_right = b->ball_dp_x[i] > 0;
+			if (score_1 + score_2 != lane->score_sum) {
+				// A goal turns the ball around too, that one isn't a return
+				stats->rallies++;
+				stats->rally_ticks += tick + 1 - lane->rally_start;
+				stats->rally_returns += lane->returns;
+				stats->returns_histogram[std::min(lane->returns, RALLY_HISTOGRAM - 1)]++;
+				lane->score_sum = score_1 + score_2;
+				lane->rally_start = tick + 1;
+				lane->returns = 0;
+			} else if (ball_right != lane->ball_right) {
+				lane->returns++;
+			}
+			lane->ball_right = ball_right;
+
+			if (score_1 >= POINTS_PER_MATCH || score_2 >= POINTS_PER_MATCH) {
+				tally_match(stats, score_1, score_2);
+				// The last match takes the slot, so the batch stays packed
+				int last = b->count - 1;
+				if (i != last) {
+					Match match;
+					match_batch_get(b, last, &match);
+					match_batch_set(b, i, &match);
+					*lane = w->lanes[last];
+				}
+				b->count--;
+				i--;
+			}
+		}
+	}
+	for (int i = 0; i < b->count; i++) tally_match(stats, b->player_1_score[i], b->player_2_score[i]);
+}
+
+struct Sweep_Axis {
+	const char* name;
+	float from, to, step;
+};
+
+internal int
+axis_values(Sweep_Axis* axis) {
+	if (axis->step <= 0 || axis->to <= axis->from) return 1;
+	return (int)((axis->to - axis->from) / axis->step + .001f) + 1;
+}
+
+// Takes "AXIS=VALUE" or "AXIS=FROM:TO:STEP" items, comma separated.
+internal bool
+parse_sweep(char* spec, Sweep_Axis* axes, int axis_count) {
+	for (char* item = strtok(spec, ","); item; item = strtok(0, ",")) {
+		char name[16];
+		float from, to, step;
+		int fields = sscanf(item, "%15[^=]=%f:%f:%f", name, &from, &to, &step);
+		if (fields != 2 && fields != 4) return false;
+		Sweep_Axis* axis = 0;
+		for (int i = 0; i < axis_count; i++) {
+			if (!strcmp(axes[i].name, name)) axis = &axes[i];
+		}
+		if (!axis) return false;
+		axis->from = from;
+		axis->to = fields == 4 ? to : from;
+		axis->step = fields == 4 ? step : 0;
+	}
+	return true;
+}
+
+struct Column {
+	const char* name;
+	u32 type; // 0 f32, 1 s64
+	std::vector<float> f32;
+	std::vector<s64> s64s;
+};
+
+internal bool
+write_columns(const char* path, Column* columns, int column_count, u32 row_count) {
+	FILE* file = fopen(path, "wb");
+	if (!file) return false;
+
+	u32 header[3] = {1, row_count, (u32)column_count};
+	fwrite("PCOL", 1, 4, file);
+	fwrite(header, sizeof(header), 1, file);
+	u64 offset = 16 + (u64)column_count * 36;
+	for (int i = 0; i < column_count; i++) {
+		char name[24] = {};
+		strncpy(name, columns[i].name, sizeof(name) - 1);
+		fwrite(name, sizeof(name), 1, file);
+		fwrite(&columns[i].type, 4, 1, file);
+		fwrite(&offset, 8, 1, file);
+		offset += (u64)row_count * (columns[i].type ? 8 : 4);
+	}
+	for (int i = 0; i < column_count; i++) {
+		if (columns[i].type) fwrite(columns[i].s64s.data(), 8, row_count, file);
+		else fwrite(columns[i].f32.data(), 4, row_count, file);
+	}
+	bool ok = !ferror(file);
+	return fclose(file) == 0 && ok;
+}
+
+// Smallest bucket that holds fraction of the rallies.
+internal float
+histogram_quantile(s64* histogram, s64 total, double fraction) {
+	s64 seen = 0;
+	for (int i = 0; i < RALLY_HISTOGRAM; i++) {
+		seen += histogram[i];
+		if (seen > 0 && seen >= total * fraction) return (float)i;
+	}
+	return RALLY_HISTOGRAM - 1;
+}
+
+int main(int argc, char** argv) {
+	int matches_per_set = 1024;
+	int threads = 0;
+	int top = 10;
+	double minutes = 10;
+	bool levels = false;
+	u32 seed = 1;
+	int opponent = OPPONENT_RANDOM;
+	const char* out_path = "self_play.col";
+	Sweep_Axis axes[SWEEP_AXES] = {
+		{"predict", 0, 1, 1},
+		{"gain", 50, 200, 50},
+		{"damping", 0, 8, 4},
+		{"max_ddp", 1300, 2000, 700},
+		{"error", 0, .6f, .3f},
+	};
+	const char* usage = "usage: %s [-matches N] [-sweep SPEC] [-levels] [-opponent LEVEL|random]\n"
+		"       [-minutes N] [-threads N] [-seed N] [-top N] [-out FILE]\n";
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-matches") && i + 1 < argc) matches_per_set = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-minutes") && i + 1 < argc) minutes = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc) seed = (u32)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-top") && i + 1 < argc) top = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-out") && i + 1 < argc) out_path = argv[++i];
+		else if (!strcmp(argv[i], "-levels")) levels = true;
+		else if (!strcmp(argv[i], "-sweep") && i + 1 < argc) {
+			if (!parse_sweep(argv[++i], axes, SWEEP_AXES)) {
+				fprintf(stderr, "bad sweep, want AXIS=VALUE or AXIS=FROM:TO:STEP over predict, gain, damping, max_ddp, error\n");
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "-opponent") && i + 1 < argc) {
+			i++;
+			opponent = !strcmp(argv[i], "random") ? OPPONENT_RANDOM : find_ai_level(argv[i]);
+			if (opponent == OPPONENT_RANDOM && strcmp(argv[i], "random")) {
+				fprintf(stderr, "unknown opponent %s (random, classic, easy, medium or hard)\n", argv[i]);
+				return 1;
+			}
+		} else {
+			fprintf(stderr, usage, argv[0]);
+			return 1;
+		}
+	}
+	if (matches_per_set < 1) matches_per_set = 1;
+
+	static Self_Play play;
+	play.opponent = opponent;
+	play.matches_per_set = matches_per_set;
+	play.chunks_per_set = (matches_per_set + SELF_PLAY_CHUNK - 1) / SELF_PLAY_CHUNK;
+	play.max_ticks = std::max((s64)(minutes * 60 * SIM_HZ), (s64)1);
+	play.seed = seed;
+
+	if (levels) {
+		for (int i = 0; i < AI_LEVEL_COUNT; i++) play.sets.push_back(ai_levels[i]);
+	} else {
+		// Every combination, the first axis changing slowest
+		int set_count = 1;
+		for (int a = 0; a < SWEEP_AXES; a++) set_count *= axis_values(&axes[a]);
+		for (int n = 0; n < set_count; n++) {
+			float values[SWEEP_AXES];
+			int rest = n;
+			for (int a = SWEEP_AXES - 1; a >= 0; a--) {
+				int count = axis_values(&axes[a]);
+				values[a] = axes[a].from + axes[a].step * (rest % count);
+				rest /= count;
+			}
+			Ai_Params params = {"sweep", values[0] != 0, values[1], values[2], values[3], values[4]};
+			play.sets.push_back(params);
+		}
+	}
+	int set_count = (int)play.sets.size();
+	int item_count = set_count * play.chunks_per_set;
+	play.items.resize(item_count);
+
+	init_profiler();
+	static Work_Pool pool;
+	work_pool_start(&pool, threads);
+	play.workers.resize(pool.worker_count);
+	for (Self_Play_Worker& w : play.workers) {
+		if (!match_batch_alloc(&w.batch, SELF_PLAY_CHUNK)) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+	}
+	printf("sets        %d x %d matches against %s, %d workers\n", set_count, matches_per_set,
+		opponent == OPPONENT_RANDOM ? "random" : ai_levels[opponent].name, pool.worker_count);
+
+	double begin = seconds_now();
+	work_pool_run(&pool, item_count, self_play_job, &play);
+	double elapsed = seconds_now() - begin;
+	work_pool_stop(&pool);
+
+	// Per set, in set order whatever order the items ran in
+	std::vector<Self_Play_Stats> sets(set_count);
+	s64 ticks = 0;
+	for (int i = 0; i < item_count; i++) {
+		Self_Play_Stats* item = &play.items[i];
+		Self_Play_Stats* set = &sets[i / play.chunks_per_set];
+		set->matches += item->matches;
+		set->wins += item->wins;
+		set->losses += item->losses;
+		set->timeouts += item->timeouts;
+		set->points_for += item->points_for;
+		set->points_against += item->points_against;
+		set->rallies += item->rallies;
+		set->rally_ticks += item->rally_ticks;
+		set->rally_returns += item->rally_returns;
+		set->ticks += item->ticks;
+		for (int h = 0; h < RALLY_HISTOGRAM; h++) set->returns_histogram[h] += item->returns_histogram[h];
+		ticks += item->ticks;
+	}
+	printf("time        %.2f s, %.0f matches/sec, %.0f ticks/sec\n", elapsed,
+		(double)set_count * matches_per_set / elapsed, ticks / elapsed);
+
+	Column columns[] = {
+		{"set", 1, {}, {}},
+		{"predict", 0, {}, {}},
+		{"gain", 0, {}, {}},
+		{"damping", 0, {}, {}},
+		{"max_ddp", 0, {}, {}},
+		{"error", 0, {}, {}},
+		{"matches", 1, {}, {}},
+		{"wins", 1, {}, {}},
+		{"losses", 1, {}, {}},
+		{"timeouts", 1, {}, {}},
+		{"win_rate", 0, {}, {}},
+		{"points_for", 1, {}, {}},
+		{"points_against", 1, {}, {}},
+		{"rallies", 1, {}, {}},
+		{"rally_seconds_mean", 0, {}, {}},
+		{"rally_returns_mean", 0, {}, {}},
+		{"rally_returns_p50", 0, {}, {}},
+		{"rally_returns_p99", 0, {}, {}},
+	};
+	for (int i = 0; i < set_count; i++) {
+		Ai_Params* p = &play.sets[i];
+		Self_Play_Stats* s = &sets[i];
+		double rallies = s->rallies ? (double)s->rallies : 1.;
+		float f32s[] = {
+			(float)p->predict, p->gain, p->damping, p->max_ddp, p->error,
+			(float)s->wins / (float)s->matches,
+			(float)(s->rally_ticks / rallies / SIM_HZ),
+			(float)(s->rally_returns / rallies),
+			histogram_quantile(s->returns_histogram, s->rallies, .5),
+			histogram_quantile(s->returns_histogram, s->rallies, .99),
+		};
+		s64 s64s[] = {i, s->matches, s->wins, s->losses, s->timeouts, s->points_for, s->points_against, s->rallies};
+		int f = 0, n = 0;
+		for (Column& c : columns) {
+			if (c.type) c.s64s.push_back(s64s[n++]);
+			else c.f32.push_back(f32s[f++]);
+		}
+	}
+	if (!write_columns(out_path, columns, (int)(sizeof(columns) / sizeof(columns[0])), (u32)set_count)) {
+		fprintf(stderr, "can't write %s\n", out_path);
+		return 1;
+	}
+	printf("wrote       %s, %d rows\n", out_path, set_count);
+
+	// Best first: win rate, then the fewest points given away
+	std::vector<int> order(set_count);
+	for (int i = 0; i < set_count; i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		if (sets[a].wins != sets[b].wins) return sets[a].wins > sets[b].wins;
+		return sets[a].points_against < sets[b].points_against;
+	});
+	printf("  set predict   gain damping max_ddp error   win%%  lost  timeout  points    returns/rally\n");
+	for (int r = 0; r < std::min(top, set_count); r++) {
+		int i = order[r];
+		Ai_Params* p = &play.sets[i];
+		Self_Play_Stats* s = &sets[i];
+		printf("%5d %7d %6.0f %7.1f %7.0f %5.2f %6.1f %5lld %8lld %6lld-%-6lld %5.1f\n", i, (int)p->predict,
+			p->gain, p->damping, p->max_ddp, p->error, 100. * s->wins / s->matches, (long long)s->losses,
+			(long long)s->timeouts, (long long)s->points_for, (long long)s->points_against,
+			s->rallies ? (double)s->rally_returns / s->rallies : 0.);
+	}
+	return 0;
+}
@@ -0,0 +1,272 @@
+#include <math.h>
+
+// Gameplay physics. Runs at a fixed SIM_DT and never touches the renderer, so
+// the render rate can differ from the tick rate. Positions of the previous tick
+// are kept so the renderer can interpolate between the last two ticks.
+// All state lives in Match; the arena and paddle sizes are shared by every match.
+
+#define SIM_HZ 240
+#define SIM_DT (1.f / SIM_HZ)
+#define MAX_TICKS_PER_FRAME 24 // Beyond this a frame drops time instead of spiralling
+#define MAX_BALL_BOUNCES 8 // Contacts resolved per tick
+
+float arena_half_size_x = 85, arena_half_size_y = 45;
+float player_half_size_x = 2.5, player_half_size_y = 12;
+float ball_half_size = 1;
+
+// Everything one match needs. Player 1 is the right paddle, player 2 the left.
+struct Match {
+	float player_1_p, player_1_dp, player_2_p, player_2_dp;
+	float ball_p_x, ball_p_y, ball_dp_x, ball_dp_y;
+	int player_1_score, player_2_score;
+
+	float prev_player_1_p, prev_player_2_p, prev_ball_p_x, prev_ball_p_y;
+};
+
+internal void
+init_match(Match* match) {
+	*match = {};
+	match->ball_dp_x = 130;
+}
+
+internal void
+simulate_player(float *p, float *dp, float ddp, float dt) {
+	ddp -= *dp * 10.f;
+
+	*p = *p + *dp * dt + ddp * dt * dt * .5f;
+	*dp = *dp + ddp * dt;
+
+	if (*p + player_half_size_y > arena_half_size_y) {
+		*p = arena_half_size_y - player_half_size_y;
+		*dp = 0;
+	}
+	else if (*p - player_half_size_y < -arena_half_size_y) {
+		*p = -arena_half_size_y + player_half_size_y;
+		*dp = 0;
+	}
+}
+
+internal bool
+aabb_vs_aabb(float p1x, float p1y, float hs1x, float hs1y,
+	float p2x, float p2y, float hs2x, float hs2y) {
+	return (p1x + hs1x > p2x - hs2x &&
+		p1x - hs1x < p2x + hs2x &&
+		p1y + hs1y > p2y - hs2y &&
+		p1y - hs1y < p2y + hs2y);
+}
+
+struct Sweep_Hit {
+	bool hit;
+	float t; // Fraction of the displacement where contact happens
+	float normal_x, normal_y; // Surface normal of the static box
+};
+
+// Box 1 moves by (dx, dy), box 2 stays. Boxes that already overlap hit at t = 0,
+// with the normal of the axis that penetrates the least.
+internal Sweep_Hit
+sweep_aabb(float p1x, float p1y, float hs1x, float hs1y, float dx, float dy,
+	float p2x, float p2y, float hs2x, float hs2y) {
+	Sweep_Hit result = {};
+	float ex = hs1x + hs2x;
+	float ey = hs1y + hs2y;
+
+	if (aabb_vs_aabb(p1x, p1y, hs1x, hs1y, p2x, p2y, hs2x, hs2y)) {
+		float penetration_x = ex - fabsf(p1x - p2x);
+		float penetration_y = ey - fabsf(p1y - p2y);
+		result.hit = true;
+		if (penetration_x <= penetration_y) result.normal_x = p1x < p2x ? -1.f : 1.f;
+		else result.normal_y = p1y < p2y ? -1.f : 1.f;
+		return result;
+	}
+
+	// Slabs of the box grown by the moving box's half size.
+	float entry_x = -1e30f, exit_x = 1e30f;
+	if (dx != 0) {
+		float t0 = (p2x - ex - p1x) / dx, t1 = (p2x + ex - p1x) / dx;
+		entry_x = t0 < t1 ? t0 : t1;
+		exit_x = t0 < t1 ? t1 : t0;
+	} else if (fabsf(p1x - p2x) >= ex) {
+		return result;
+	}
+
+	float entry_y = -1e30f, exit_y = 1e30f;
+	if (dy != 0) {
+		float t0 = (p2y - ey - p1y) / dy, t1 = (p2y + ey - p1y) / dy;
+		entry_y = t0 < t1 ? t0 : t1;
+		exit_y = t0 < t1 ? t1 : t0;
+	} else if (fabsf(p1y - p2y) >= ey) {
+		return result;
+	}
+
+	float entry = entry_x > entry_y ? entry_x : entry_y;
+	float exit = exit_x < exit_y ? exit_x : exit_y;
+	if (entry > exit || entry < 0 || entry > 1) return result;
+
+	result.hit = true;
+	result.t = entry;
+	if (entry_x > entry_y) result.normal_x = dx > 0 ? -1.f : 1.f;
+	else result.normal_y = dy > 0 ? -1.f : 1.f;
+	return result;
+}
+
+// Time of the ball reaching limit along one axis, if it's moving that way.
+internal bool
+sweep_plane(float p, float d, float limit, float* t) {
+	if (d > 0 ? p < limit : p > limit) {
+		if (d == 0 || (limit - p) / d > 1) return false;
+		*t = (limit - p) / d;
+	} else {
+		if (d == 0) return false;
+		*t = 0; // Already past it
+	}
+	return true;
+}
+
+enum Ball_Hit {
+	HIT_NONE,
+	HIT_PLAYER_1,
+	HIT_PLAYER_2,
+	HIT_TOP,
+	HIT_BOTTOM,
+	HIT_GOAL_PLAYER_1, // Past the right edge, scores for player 1 like before
+	HIT_GOAL_PLAYER_2,
+};
+
+// Paddle hits and goals of a tick, for effects (see effects.cpp). simulate_match
+// only appends to it and nothing reads it back, so it can't change a match.
+#define MAX_MATCH_EVENTS 32
+
+struct Match_Event {
+	Ball_Hit hit;
+	float x, y; // The ball at contact
+	float dp_x, dp_y; // And its velocity after
+};
+
+struct Match_Events {
+	int count;
+	Match_Event events[MAX_MATCH_EVENTS];
+};
+
+internal void
+add_match_event(Match_Events* events, Ball_Hit hit, float x, float y, float dp_x, float dp_y) {
+	if (!events || events->count == MAX_MATCH_EVENTS) return;
+	events->events[events->count++] = { hit, x, y, dp_x, dp_y };
+}
+
+// Face hits flip dp_x and add spin from the hit offset and the paddle velocity.
+// Top and bottom hits push the ball out and reflect it off the moving paddle.
+internal void
+bounce_off_paddle(Match* m, Sweep_Hit hit, float paddle_x, float paddle_p, float paddle_dp) {
+	if (hit.normal_y != 0) {
+		float y = paddle_p + hit.normal_y * (player_half_size_y + ball_half_size);
+		if (fabsf(y) + ball_half_size <= arena_half_size_y) {
+			m->ball_p_y = y;
+			m->ball_dp_y = hit.normal_y * fabsf(m->ball_dp_y - paddle_dp) + paddle_dp;
+			return;
+		}
+		// No room between the paddle and the wall, push it out the front instead
+		hit.normal_x = paddle_x > 0 ? -1.f : 1.f;
+	}
+	m->ball_p_x = paddle_x + hit.normal_x * (player_half_size_x + ball_half_size);
+	m->ball_dp_x = hit.normal_x * fabsf(m->ball_dp_x);
+	m->ball_dp_y = (m->ball_p_y - paddle_p) * 2 + paddle_dp * .75f;
+}
+
+internal void
+simulate_match(Match* m, float player_1_ddp, float player_2_ddp, float dt, Match_Events* events = 0) {
+	m->prev_player_1_p = m->player_1_p;
+	m->prev_player_2_p = m->player_2_p;
+	m->prev_ball_p_x = m->ball_p_x;
+	m->prev_ball_p_y = m->ball_p_y;
+
+	simulate_player(&m->player_1_p, &m->player_1_dp, player_1_ddp, dt);
+	simulate_player(&m->player_2_p, &m->player_2_dp, player_2_ddp, dt);
+
+
+	// Simulate Ball
+	// Swept against paddles, walls and goals. Every contact ends a sub-step and
+	// the rest of dt continues from there, so several bounces fit in one tick.
+	{
+		float remaining = dt;
+		for (int bounce = 0; bounce < MAX_BALL_BOUNCES && remaining > 0; bounce++) {
+			float dx = m->ball_dp_x * remaining;
+			float dy = m->ball_dp_y * remaining;
+
+			Ball_Hit hit = HIT_NONE;
+			float hit_t = 1.f;
+			float t;
+			Sweep_Hit paddle_1 = sweep_aabb(m->ball_p_x, m->ball_p_y, ball_half_size, ball_half_size, dx, dy, 80, m->player_1_p, player_half_size_x, player_half_size_y);
+			Sweep_Hit paddle_2 = sweep_aabb(m->ball_p_x, m->ball_p_y, ball_half_size, ball_half_size, dx, dy, -80, m->player_2_p, player_half_size_x, player_half_size_y);
+
+			// Only count paddle contacts the ball and paddle move into each other.
+			if (paddle_1.hit && paddle_1.t <= hit_t && m->ball_dp_x * paddle_1.normal_x + (m->ball_dp_y - m->player_1_dp) * paddle_1.normal_y < 0) {
+				hit = HIT_PLAYER_1;
+				hit_t = paddle_1.t;
+			}
+			if (paddle_2.hit && paddle_2.t <= hit_t && m->ball_dp_x * paddle_2.normal_x + (m->ball_dp_y - m->player_2_dp) * paddle_2.normal_y < 0) {
+				hit = HIT_PLAYER_2;
+				hit_t = paddle_2.t;
+			}
+			if (sweep_plane(m->ball_p_y, dy, arena_half_size_y - ball_half_size, &t) && dy > 0 && t < hit_t) {
+				hit = HIT_TOP;
+				hit_t = t;
+			}
+			if (sweep_plane(m->ball_p_y, dy, -arena_half_size_y + ball_half_size, &t) && dy < 0 && t < hit_t) {
+				hit = HIT_BOTTOM;
+				hit_t = t;
+			}
+			if (sweep_plane(m->ball_p_x, dx, arena_half_size_x - ball_half_size, &t) && dx > 0 && t < hit_t) {
+				hit = HIT_GOAL_PLAYER_1;
+				hit_t = t;
+			}
+			if (sweep_plane(m->ball_p_x, dx, -arena_half_size_x + ball_half_size, &t) && dx < 0 && t < hit_t) {
+				hit = HIT_GOAL_PLAYER_2;
+				hit_t = t;
+			}
+
+			m->ball_p_x += dx * hit_t;
+			m->ball_p_y += dy * hit_t;
+			remaining -= remaining * hit_t;
+
+			switch (hit) {
+				case HIT_NONE: {
+					remaining = 0;
+				} break;
+
+				case HIT_PLAYER_1: {
+					bounce_off_paddle(m, paddle_1, 80, m->player_1_p, m->player_1_dp);
+					add_match_event(events, hit, m->ball_p_x, m->ball_p_y, m->ball_dp_x, m->ball_dp_y);
+				} break;
+
+				case HIT_PLAYER_2: {
+					bounce_off_paddle(m, paddle_2, -80, m->player_2_p, m->player_2_dp);
+					add_match_event(events, hit, m->ball_p_x, m->ball_p_y, m->ball_dp_x, m->ball_dp_y);
+				} break;
+
+				case HIT_TOP: {
+					m->ball_p_y = arena_half_size_y - ball_half_size;
+					m->ball_dp_y *= -1;
+				} break;
+
+				case HIT_BOTTOM: {
+					m->ball_p_y = -arena_half_size_y + ball_half_size;
+					m->ball_dp_y *= -1;
+				} break;
+
+				case HIT_GOAL_PLAYER_1:
+				case HIT_GOAL_PLAYER_2: {
+					add_match_event(events, hit, m->ball_p_x, m->ball_p_y, m->ball_dp_x, m->ball_dp_y);
+					m->ball_dp_x *= -1;
+					m->ball_dp_y = 0;
+					m->ball_p_x = 0;
+					m->ball_p_y = 0;
+					if (hit == HIT_GOAL_PLAYER_1) m->player_1_score++;
+					else m->player_2_score++;
+					// The ball teleports, don't interpolate across the reset
+					m->prev_ball_p_x = m->prev_ball_p_y = 0;
+					remaining = 0;
+				} break;
+			}
+		}
+	}
+}
@@ -0,0 +1,208 @@
+// Span fill kernels. init_span_fill picks fill_span once at startup using CPUID.
+// Every kernel handles unaligned heads and tails itself.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPAN_FILL_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define SPAN_FILL_X86 0
+#endif
+
+typedef void Fill_Span(u32* dest, int count, u32 color);
+
+// Clears bigger than this (in pixels) use non-temporal stores, the frame
+// would only evict the cache anyway.
+#define NON_TEMPORAL_THRESHOLD (1 << 18)
+
+internal void
+fill_span_scalar(u32* dest, int count, u32 color) {
+	for (int i = 0; i < count; i++) {
+		dest[i] = color;
+	}
+}
+
+#if SPAN_FILL_X86
+
+internal void
+fill_span_sse2(u32* dest, int count, u32 color) {
+	while (count && ((size_t)dest & 15)) {
+		*dest++ = color;
+		count--;
+	}
+
+	__m128i c = _mm_set1_epi32((int)color);
+	for (; count >= 16; count -= 16, dest += 16) {
+		_mm_store_si128((__m128i*)dest + 0, c);
+		_mm_store_si128((__m128i*)dest + 1, c);
+		_mm_store_si128((__m128i*)dest + 2, c);
+		_mm_store_si128((__m128i*)dest + 3, c);
+	}
+	for (; count >= 4; count -= 4, dest += 4) {
+		_mm_store_si128((__m128i*)dest, c);
+	}
+
+	while (count--) *dest++ = color;
+}
+
+internal void
+fill_span_stream_sse2(u32* dest, int count, u32 color) {
+	while (count && ((size_t)dest & 15)) {
+		*dest++ = color;
+		count--;
+	}
+
+	__m128i c = _mm_set1_epi32((int)color);
+	for (; count >= 16; count -= 16, dest += 16) {
+		_mm_stream_si128((__m128i*)dest + 0, c);
+		_mm_stream_si128((__m128i*)dest + 1, c);
+		_mm_stream_si128((__m128i*)dest + 2, c);
+		_mm_stream_si128((__m128i*)dest + 3, c);
+	}
+	for (; count >= 4; count -= 4, dest += 4) {
+		_mm_stream_si128((__m128i*)dest, c);
+	}
+	_mm_sfence();
+
+	while (count--) *dest++ = color;
+}
+
+TARGET_AVX2 internal void
+fill_span_avx2(u32* dest, int count, u32 color) {
+	if (count < 8) {
+		while (count--) *dest++ = color;
+		return;
+	}
+
+	__m256i c = _mm256_set1_epi32((int)color);
+
+	// Head: one unaligned store, then skip to the next 32 byte boundary.
+	_mm256_storeu_si256((__m256i*)dest, c);
+	int skip = (int)((32 - ((size_t)dest & 31)) & 31) / 4;
+	dest += skip;
+	count -= skip;
+
+	for (; count >= 32; count -= 32, dest += 32) {
+		_mm256_store_si256((__m256i*)dest + 0, c);
+		_mm256_store_si256((__m256i*)dest + 1, c);
+		_mm256_store_si256((__m256i*)dest + 2, c);
+		_mm256_store_si256((__m256i*)dest + 3, c);
+	}
+	for (; count >= 8; count -= 8, dest += 8) {
+		_mm256_store_si256((__m256i*)dest, c);
+	}
+
+	// Tail: one unaligned store overlapping the previous one.
+	if (count) _mm256_storeu_si256((__m256i*)(dest + count - 8), c);
+}
+
+TARGET_AVX2 internal void
+fill_span_stream_avx2(u32* dest, int count, u32 color) {
+	while (count && ((size_t)dest & 31)) {
+		*dest++ = color;
+		count--;
+	}
+
+	__m256i c = _mm256_set1_epi32((int)color);
+	for (; count >= 32; count -= 32, dest += 32) {
+		_mm256_stream_si256((__m256i*)dest + 0, c);
+		_mm256_stream_si256((__m256i*)dest + 1, c);
+		_mm256_stream_si256((__m256i*)dest + 2, c);
+		_mm256_stream_si256((__m256i*)dest + 3, c);
+	}
+	for (; count >= 8; count -= 8, dest += 8) {
+		_mm256_stream_si256((__m256i*)dest, c);
+	}
+	_mm_sfence();
+
+	while (count--) *dest++ = color;
+}
+
+internal void
+cpuid(int leaf, int subleaf, u32 regs[4]) {
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+internal bool
+cpu_has_sse2() {
+	u32 regs[4];
+	cpuid(1, 0, regs);
+	return (regs[3] & (1 << 26)) != 0;
+}
+
+internal bool
+cpu_has_avx2() {
+	u32 regs[4];
+	cpuid(0, 0, regs);
+	if (regs[0] < 7) return false;
+
+	// AVX needs OSXSAVE and an OS that saves the XMM/YMM state.
+	cpuid(1, 0, regs);
+	if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28))) return false;
+#if defined(_MSC_VER)
+	u64 xcr0 = _xgetbv(0);
+#else
+	u32 xcr0_lo, xcr0_hi;
+	__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	u64 xcr0 = ((u64)xcr0_hi << 32) | xcr0_lo;
+#endif
+	if ((xcr0 & 6) != 6) return false;
+
+	cpuid(7, 0, regs);
+	return (regs[1] & (1 << 5)) != 0;
+}
+
+#endif
+
+struct Span_Fill_Kernel {
+	const char* name;
+	Fill_Span* fill;
+	Fill_Span* fill_stream;
+	bool supported;
+};
+
+global_variable Span_Fill_Kernel span_fill_kernels[] = {
+	{ "scalar", fill_span_scalar, fill_span_scalar, true },
+#if SPAN_FILL_X86
+	{ "sse2", fill_span_sse2, fill_span_stream_sse2, false },
+	{ "avx2", fill_span_avx2, fill_span_stream_avx2, false },
+#endif
+};
+
+#define SPAN_FILL_KERNEL_COUNT (int)(sizeof(span_fill_kernels) / sizeof(span_fill_kernels[0]))
+
+global_variable Fill_Span* fill_span = fill_span_scalar;
+global_variable Fill_Span* fill_span_stream = fill_span_scalar;
+
+internal void
+use_span_fill_kernel(Span_Fill_Kernel* kernel) {
+	fill_span = kernel->fill;
+	fill_span_stream = kernel->fill_stream;
+}
+
+// Picks the best kernel the CPU supports. Call once before the first frame.
+internal Span_Fill_Kernel*
+init_span_fill() {
+#if SPAN_FILL_X86
+	span_fill_kernels[1].supported = cpu_has_sse2();
+	span_fill_kernels[2].supported = cpu_has_avx2();
+#endif
+
+	Span_Fill_Kernel* best = &span_fill_kernels[0];
+	for (int i = 0; i < SPAN_FILL_KERNEL_COUNT; i++) {
+		if (span_fill_kernels[i].supported) best = &span_fill_kernels[i];
+	}
+	use_span_fill_kernel(best);
+	return best;
+}
@@ -0,0 +1,180 @@
+// Match recording. A recorder thread takes the newest frame from the frame
+// export ring (frame_export.cpp) at a constant frame rate, converts it to
+// 4:2:0 YUV (yuv_convert.cpp) and hands it to a Video_Sink: Media Foundation's
+// H.264 encoder on Windows (win32_mf_record.cpp), which uses the GPU's encoder
+// when there is one, or a raw .y4m file anywhere. The game thread does nothing
+// for it; the present thread only copies dirty rects into the ring.
+// A frame that doesn't change by the next sample is written again, and one
+// with a different size than the first is skipped for the last good one, so
+// the output keeps its rate and size.
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define RECORD_FPS 60
+
+struct Video_Sink {
+	int chroma_step; // 1 for I420, 2 for NV12 (see rgb_to_yuv420)
+	void* data;
+	// planes is the Y plane followed by the chroma, time is in seconds from the start
+	bool (*write)(void* data, u8* planes, double time);
+	void (*close)(void* data);
+};
+
+// Called on the recorder thread once the size is known.
+typedef bool Open_Video_Sink(Video_Sink* sink, const char* path, int width, int height, int fps);
+
+struct Video_Recorder {
+	std::thread thread;
+	std::atomic<bool> stop;
+	char path[260];
+	Open_Video_Sink* open;
+
+	// Recorder thread only
+	int width, height;
+	u8* planes[2]; // Converted into the second, swapped once it was intact
+	u64 written, repeated;
+};
+
+global_variable Video_Recorder video_recorder;
+
+struct Y4M_Sink {
+	FILE* file;
+	size_t size;
+};
+
+internal bool
+y4m_write(void* data, u8* planes, double time) {
+	Y4M_Sink* sink = (Y4M_Sink*)data;
+	fputs("FRAME\n", sink->file);
+	return fwrite(planes, 1, sink->size, sink->file) == sink->size;
+}
+
+internal void
+y4m_close(void* data) {
+	Y4M_Sink* sink = (Y4M_Sink*)data;
+	fclose(sink->file);
+	free(sink);
+}
+
+// Uncompressed I420 in a YUV4MPEG2 stream, which ffmpeg, x264 and most
+// encoders read as is.
+internal bool
+open_y4m_sink(Video_Sink* sink, const char* path, int width, int height, int fps) {
+	FILE* file = fopen(path, "wb");
+	if (!file) return false;
+	fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", width, height, fps);
+
+	Y4M_Sink* y4m = (Y4M_Sink*)malloc(sizeof(Y4M_Sink));
+	y4m->file = file;
+	y4m->size = (size_t)width * height * 3 / 2;
+	sink->chroma_step = 1;
+	sink->data = y4m;
+	sink->write = y4m_write;
+	sink->close = y4m_close;
+	return true;
+}
+
+// Converts the slot into planes, chroma laid out for the sink.
+internal void
+record_convert(Video_Recorder* r, Frame_Export_Slot* slot, u8* planes, int chroma_step) {
+	u32* pixels = (u32*)(frame_export.base + slot->offset);
+	u8* chroma = planes + (size_t)r->width * r->height;
+	if (chroma_step == 2) {
+		rgb_to_yuv420(pixels, slot->pitch, slot->height, r->width, r->height, planes, r->width, chroma, chroma + 1, r->width, 2);
+	} else {
+		u8* v = chroma + (size_t)r->width * r->height / 4;
+		rgb_to_yuv420(pixels, slot->pitch, slot->height, r->width, r->height, planes, r->width, chroma, v, r->width / 2, 1);
+	}
+}
+
+internal void
+recorder_thread() {
+	Video_Recorder* r = &video_recorder;
+	profile_thread_name("RECORD");
+	Frame_Export_Header* header = frame_export.header;
+
+	Video_Sink sink = {};
+	bool open = false;
+	u64 last_frame = ~0ull;
+	double period = 1. / RECORD_FPS;
+	double start = present_clock();
+	u64 sample = 0;
+
+	while (!r->stop.load(std::memory_order_relaxed)) {
+		double due = start + (sample + 1) * period;
+		double now = present_clock();
+		if (due > now) std::this_thread::sleep_for(std::chrono::duration<double>(due - now));
+		PROFILE_SCOPE("RECORD");
+
+		u64 frame, sequence;
+		Frame_Export_Slot* slot = frame_export_latest(header, &frame, &sequence);
+		if (!open) {
+			if (!slot) {
+				// Nothing to record yet, the video starts with the first frame.
+				start = present_clock();
+				continue;
+			}
+			r->width = slot->width & ~1;
+			r->height = slot->height & ~1;
+			size_t size = (size_t)r->width * r->height * 3 / 2;
+			r->planes[0] = (u8*)calloc(1, size);
+			r->planes[1] = (u8*)calloc(1, size);
+			if (!r->width || !r->height || !r->planes[0] || !r->planes[1] || !r->open(&sink, r->path, r->width, r->height, RECORD_FPS)) break;
+			open = true;
+			start = present_clock() - period;
+			sample = 0;
+		}
+
+		bool fits = slot && (slot->width & ~1) == (u32)r->width && (slot->height & ~1) == (u32)r->height;
+		if (fits && frame != last_frame) {
+			record_convert(r, slot, r->planes[1], sink.chroma_step);
+			if (frame_export_intact(slot, sequence)) {
+				u8* planes = r->planes[0];
+				r->planes[0] = r->planes[1];
+				r->planes[1] = planes;
+				last_frame = frame;
+			}
+		} else {
+			r->repeated++;
+		}
+
+		// Late samples are caught up with copies, so the video keeps real time.
+		u64 samples_due = (u64)((present_clock() - start) / period);
+		if (samples_due > sample + RECORD_FPS) sample = samples_due - RECORD_FPS;
+		do {
+			if (!sink.write(sink.data, r->planes[0], sample * period)) {
+				r->stop.store(true, std::memory_order_relaxed);
+				break;
+			}
+			r->written++;
+			sample++;
+		} while (sample < samples_due);
+	}
+
+	if (open) sink.close(sink.data);
+	free(r->planes[0]);
+	free(r->planes[1]);
+}
+
+// Records into path until shutdown_video_recorder. Needs the frame export ring;
+// a local one is made when -export didn't make a shared one, and freed by
+// close_local_frame_export.
+internal bool
+init_video_recorder(const char* path, Open_Video_Sink* open, size_t slot_size) {
+	if (!frame_export.header && !init_local_frame_export(slot_size)) return false;
+	snprintf(video_recorder.path, sizeof(video_recorder.path), "%s", path);
+	video_recorder.open = open;
+	video_recorder.thread = std::thread(recorder_thread);
+	return true;
+}
+
+// Before shutdown_frame_buffers, so the last frames still get written.
+internal void
+shutdown_video_recorder() {
+	if (!video_recorder.thread.joinable()) return;
+	video_recorder.stop.store(true, std::memory_order_relaxed);
+	video_recorder.thread.join();
+}
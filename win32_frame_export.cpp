@@ -0,0 +1,37 @@
+// The named mapping behind frame_export.cpp. Readers open it with
+// OpenFileMapping(FILE_MAP_READ, FALSE, "Local\\pong_frames").
+
+#define WIN32_FRAME_EXPORT_NAME "Local\\pong_frames"
+
+global_variable HANDLE frame_export_mapping;
+
+// slot_size is the biggest frame in bytes. Fails when the mapping can't be made
+// or another instance already exports.
+internal bool
+win32_init_frame_export(size_t slot_size) {
+	u64 size = frame_export_size(slot_size);
+	HANDLE mapping = CreateFileMapping(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, WIN32_FRAME_EXPORT_NAME);
+	if (!mapping) return false;
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if (!memory) {
+		CloseHandle(mapping);
+		return false;
+	}
+	frame_export_mapping = mapping;
+	init_frame_export(memory, slot_size);
+	frame_buffers_on_presented(frame_export_present, &frame_export);
+	return true;
+}
+
+// After shutdown_frame_buffers.
+internal void
+win32_shutdown_frame_export() {
+	if (!frame_export_mapping) return;
+	UnmapViewOfFile(frame_export.header);
+	CloseHandle(frame_export_mapping);
+}
@@ -0,0 +1,99 @@
+// Framebuffer memory that survives resizes. Every buffer reserves address space
+// for a frame as big as the whole virtual screen once; a resize only commits
+// the pages the new size needs on top of what is already committed. Nothing is
+// ever decommitted, so dragging a window edge back and forth doesn't zero and
+// fault in the same pages again. Only a frame bigger than the reservation (a
+// monitor plugged in later) releases everything and reserves again.
+// With -largepages and SeLockMemoryPrivilege the buffers are committed up front
+// from large pages instead, since those can't be committed piece by piece.
+
+struct Win32_Frame_Memory {
+	u8* base[MAX_FRAME_BUFFERS];
+	size_t reserved; // Per buffer
+	size_t committed; // Per buffer
+	bool large_pages;
+};
+
+global_variable Win32_Frame_Memory frame_memory;
+
+internal bool
+enable_lock_memory_privilege() {
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool result = LookupPrivilegeValue(0, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, 0, 0) && GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	return result;
+}
+
+internal void
+release_frame_memory() {
+	for (int i = 0; i < MAX_FRAME_BUFFERS; i++) {
+		if (frame_memory.base[i]) VirtualFree(frame_memory.base[i], 0, MEM_RELEASE);
+		frame_memory.base[i] = 0;
+	}
+	frame_memory.reserved = 0;
+	frame_memory.committed = 0;
+}
+
+internal bool
+reserve_frame_memory(int count, size_t bytes) {
+	if (frame_memory.large_pages) {
+		size_t page = GetLargePageMinimum();
+		size_t size = (bytes + page - 1) & ~(page - 1);
+		bool ok = true;
+		for (int i = 0; i < count && ok; i++) {
+			frame_memory.base[i] = (u8*)VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			ok = frame_memory.base[i] != 0;
+		}
+		if (ok) {
+			frame_memory.reserved = frame_memory.committed = size;
+			return true;
+		}
+		// Not enough contiguous physical memory left, use normal pages from now on.
+		release_frame_memory();
+		frame_memory.large_pages = false;
+	}
+
+	for (int i = 0; i < count; i++) {
+		frame_memory.base[i] = (u8*)VirtualAlloc(0, bytes, MEM_RESERVE, PAGE_READWRITE);
+		if (!frame_memory.base[i]) {
+			release_frame_memory();
+			return false;
+		}
+	}
+	frame_memory.reserved = bytes;
+	return true;
+}
+
+internal void
+init_frame_memory(bool large_pages) {
+	frame_memory.large_pages = large_pages && GetLargePageMinimum() && enable_lock_memory_privilege();
+}
+
+// Points frame_buffers.memory at buffers of at least bytes each. Contents are
+// kept unless the reservation had to grow.
+internal bool
+win32_frame_memory_fit(size_t bytes) {
+	int count = frame_buffers.count;
+	if (bytes > frame_memory.reserved) {
+		int w = GetSystemMetrics(SM_CXVIRTUALSCREEN), h = GetSystemMetrics(SM_CYVIRTUALSCREEN);
+		size_t screen_bytes = (size_t)frame_pitch(w) * h * sizeof(u32);
+		release_frame_memory();
+		if (!reserve_frame_memory(count, bytes > screen_bytes ? bytes : screen_bytes)) return false;
+	}
+
+	if (bytes > frame_memory.committed) {
+		for (int i = 0; i < count; i++) {
+			if (!VirtualAlloc(frame_memory.base[i], bytes, MEM_COMMIT, PAGE_READWRITE)) return false;
+		}
+		frame_memory.committed = bytes;
+	}
+
+	for (int i = 0; i < count; i++) frame_buffers.memory[i] = frame_memory.base[i];
+	return true;
+}
@@ -0,0 +1,88 @@
+// Frame limiter. frame_pacer_wait sleeps on a waitable timer until shortly
+// before the next frame is due and spins the rest, so frames start within a
+// few microseconds of their deadline without burning a core in between.
+// Deadlines advance by whole periods and don't drift with frame times; a frame
+// that runs late starts a new schedule instead of rushing to catch up.
+// Windows 10 1803+ has high resolution timers. Older versions fall back to a
+// normal timer with the system timer period raised to 1 ms, and spin longer.
+
+#pragma comment(lib, "winmm.lib")
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+struct Win32_Frame_Pacer {
+	HANDLE timer;
+	bool high_resolution;
+	s64 frequency; // Performance counter ticks per second
+	s64 spin; // Ticks before a deadline that are spun instead of slept
+	s64 next; // Deadline of the next frame, 0 when there is no schedule
+};
+
+global_variable Win32_Frame_Pacer frame_pacer;
+
+internal s64
+pacer_now() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+internal void
+init_frame_pacer() {
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	frame_pacer.frequency = frequency.QuadPart;
+
+	frame_pacer.timer = CreateWaitableTimerExW(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	frame_pacer.high_resolution = frame_pacer.timer != 0;
+	if (!frame_pacer.timer) {
+		frame_pacer.timer = CreateWaitableTimer(0, TRUE, 0);
+		timeBeginPeriod(1);
+	}
+
+	// How late a wakeup can be
+	frame_pacer.spin = frame_pacer.frequency / (frame_pacer.high_resolution ? 2000 : 500);
+}
+
+internal void
+shutdown_frame_pacer() {
+	if (!frame_pacer.high_resolution) timeEndPeriod(1);
+	if (frame_pacer.timer) CloseHandle(frame_pacer.timer);
+}
+
+// Forget the schedule, after a pause for example.
+internal void
+frame_pacer_reset() {
+	frame_pacer.next = 0;
+}
+
+// Returns when the next frame at hz is due. hz 0 doesn't wait.
+internal void
+frame_pacer_wait(float hz) {
+	Win32_Frame_Pacer* pacer = &frame_pacer;
+	if (hz <= 0) {
+		pacer->next = 0;
+		return;
+	}
+
+	PROFILE_SCOPE("PACE");
+	s64 period = (s64)(pacer->frequency / hz);
+	s64 now = pacer_now();
+	if (!pacer->next || now - pacer->next > period) pacer->next = now;
+	s64 deadline = pacer->next + period;
+	pacer->next = deadline;
+
+	s64 sleep = deadline - pacer->spin - now;
+	if (sleep > 0 && pacer->timer) {
+		// Relative due times are negative, in 100 ns units
+		LARGE_INTEGER due;
+		due.QuadPart = -(sleep * 10000000 / pacer->frequency);
+		if (due.QuadPart < 0 && SetWaitableTimer(pacer->timer, &due, 0, 0, 0, FALSE)) {
+			WaitForSingleObject(pacer->timer, INFINITE);
+		}
+	}
+
+	while (pacer_now() < deadline) YieldProcessor();
+}
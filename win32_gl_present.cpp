@@ -0,0 +1,254 @@
+// OpenGL presenter. The frame lives in one streaming texture; every present
+// only uploads the rects that changed and draws the texture over the window,
+// so the GPU does the copy to the screen instead of GDI. With GL 4.4
+// (ARB_buffer_storage) the rects go through a persistently mapped pixel buffer
+// split in GL_UPLOAD_REGIONS parts, each guarded by a fence, so the CPU never
+// waits on an upload the GPU is still reading. Older drivers upload straight
+// from the framebuffer. The context is created on the main thread and made
+// current by whichever thread presents first. A frame smaller than the window
+// is scaled onto the viewport with nearest filtering.
+// win32_gl_init returns false when no usable context exists; StretchDIBits stays the fallback.
+
+#include <GL/gl.h>
+
+#pragma comment(lib, "opengl32.lib")
+
+#define GL_BGRA 0x80E1
+#define GL_CLAMP_TO_EDGE 0x812F
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+
+#define GL_UPLOAD_REGIONS 3
+
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+typedef u64 GLuint64;
+typedef struct __GLsync* GLsync;
+
+typedef void WINAPI Gl_Gen_Buffers(GLsizei n, GLuint* buffers);
+typedef void WINAPI Gl_Delete_Buffers(GLsizei n, const GLuint* buffers);
+typedef void WINAPI Gl_Bind_Buffer(GLenum target, GLuint buffer);
+typedef void WINAPI Gl_Buffer_Storage(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void* WINAPI Gl_Map_Buffer_Range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLsync WINAPI Gl_Fence_Sync(GLenum condition, GLbitfield flags);
+typedef GLenum WINAPI Gl_Client_Wait_Sync(GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void WINAPI Gl_Delete_Sync(GLsync sync);
+typedef BOOL WINAPI Wgl_Swap_Interval(int interval);
+
+struct Gl_Presenter {
+	HWND window;
+	HDC dc;
+	HGLRC context;
+	bool current; // Made current on the presenting thread
+	bool vsync;
+
+	GLuint texture;
+	int texture_width, texture_height, texture_pitch;
+
+	// Persistently mapped upload buffer, 0 when the driver has no ARB_buffer_storage
+	GLuint pbo;
+	u8* pbo_memory;
+	s64 region_size;
+	int region;
+	GLsync fences[GL_UPLOAD_REGIONS];
+
+	Gl_Gen_Buffers* glGenBuffers;
+	Gl_Delete_Buffers* glDeleteBuffers;
+	Gl_Bind_Buffer* glBindBuffer;
+	Gl_Buffer_Storage* glBufferStorage;
+	Gl_Map_Buffer_Range* glMapBufferRange;
+	Gl_Fence_Sync* glFenceSync;
+	Gl_Client_Wait_Sync* glClientWaitSync;
+	Gl_Delete_Sync* glDeleteSync;
+	Wgl_Swap_Interval* wglSwapIntervalEXT;
+};
+
+global_variable Gl_Presenter gl_presenter;
+
+internal void*
+gl_proc(const char* name) {
+	void* proc = (void*)wglGetProcAddress(name);
+	// Some drivers return small integers instead of 0 for missing functions
+	if (proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1) return 0;
+	return proc;
+}
+
+internal bool
+win32_gl_init(HWND window, bool vsync) {
+	Gl_Presenter* gl = &gl_presenter;
+	gl->window = window;
+	gl->vsync = vsync;
+	gl->dc = GetDC(window);
+
+	PIXELFORMATDESCRIPTOR desired = {};
+	desired.nSize = sizeof(desired);
+	desired.nVersion = 1;
+	desired.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+	desired.iPixelType = PFD_TYPE_RGBA;
+	desired.cColorBits = 32;
+	desired.cAlphaBits = 8;
+	desired.iLayerType = PFD_MAIN_PLANE;
+
+	int format = ChoosePixelFormat(gl->dc, &desired);
+	PIXELFORMATDESCRIPTOR suggested;
+	if (!format || !DescribePixelFormat(gl->dc, format, sizeof(suggested), &suggested) ||
+		!SetPixelFormat(gl->dc, format, &suggested)) {
+		return false;
+	}
+
+	gl->context = wglCreateContext(gl->dc);
+	if (!gl->context) return false;
+	if (!wglMakeCurrent(gl->dc, gl->context)) {
+		wglDeleteContext(gl->context);
+		gl->context = 0;
+		return false;
+	}
+
+	// The generic software implementation would be slower than GDI.
+	const char* vendor = (const char*)glGetString(GL_VENDOR);
+	if (!vendor || (suggested.dwFlags & PFD_GENERIC_FORMAT && !(suggested.dwFlags & PFD_GENERIC_ACCELERATED))) {
+		wglMakeCurrent(0, 0);
+		wglDeleteContext(gl->context);
+		gl->context = 0;
+		return false;
+	}
+
+	gl->glGenBuffers = (Gl_Gen_Buffers*)gl_proc("glGenBuffers");
+	gl->glDeleteBuffers = (Gl_Delete_Buffers*)gl_proc("glDeleteBuffers");
+	gl->glBindBuffer = (Gl_Bind_Buffer*)gl_proc("glBindBuffer");
+	gl->glBufferStorage = (Gl_Buffer_Storage*)gl_proc("glBufferStorage");
+	gl->glMapBufferRange = (Gl_Map_Buffer_Range*)gl_proc("glMapBufferRange");
+	gl->glFenceSync = (Gl_Fence_Sync*)gl_proc("glFenceSync");
+	gl->glClientWaitSync = (Gl_Client_Wait_Sync*)gl_proc("glClientWaitSync");
+	gl->glDeleteSync = (Gl_Delete_Sync*)gl_proc("glDeleteSync");
+	gl->wglSwapIntervalEXT = (Wgl_Swap_Interval*)gl_proc("wglSwapIntervalEXT");
+
+	glGenTextures(1, &gl->texture);
+	wglMakeCurrent(0, 0);
+	return true;
+}
+
+internal bool
+gl_has_persistent_pbo(Gl_Presenter* gl) {
+	return gl->glGenBuffers && gl->glDeleteBuffers && gl->glBindBuffer && gl->glBufferStorage &&
+		gl->glMapBufferRange && gl->glFenceSync && gl->glClientWaitSync && gl->glDeleteSync;
+}
+
+// New texture and upload buffer for a new frame size. The first frame after a
+// resize is a full redraw, so nothing has to be carried over.
+internal void
+gl_resize(Gl_Presenter* gl, int width, int height, int pitch) {
+	gl->texture_width = width;
+	gl->texture_height = height;
+	gl->texture_pitch = pitch;
+
+	glBindTexture(GL_TEXTURE_2D, gl->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+
+	if (!gl_has_persistent_pbo(gl)) return;
+
+	if (gl->pbo) {
+		for (int i = 0; i < GL_UPLOAD_REGIONS; i++) {
+			if (gl->fences[i]) gl->glDeleteSync(gl->fences[i]);
+			gl->fences[i] = 0;
+		}
+		gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		gl->glDeleteBuffers(1, &gl->pbo);
+		gl->pbo = 0;
+		gl->pbo_memory = 0;
+	}
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	gl->region_size = (s64)pitch * height * sizeof(u32);
+	gl->region = 0;
+	gl->glGenBuffers(1, &gl->pbo);
+	gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo);
+	gl->glBufferStorage(GL_PIXEL_UNPACK_BUFFER, gl->region_size * GL_UPLOAD_REGIONS, 0, flags);
+	gl->pbo_memory = (u8*)gl->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, gl->region_size * GL_UPLOAD_REGIONS, flags);
+	gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!gl->pbo_memory) {
+		gl->glDeleteBuffers(1, &gl->pbo);
+		gl->pbo = 0;
+	}
+}
+
+// Present_Rects for frame_buffers. Rows are bottom first, like the texture.
+internal void
+win32_gl_present(void* memory, Present_Frame* frame, void* context) {
+	Gl_Presenter* gl = &gl_presenter;
+	int width = frame->width, height = frame->height, pitch = frame->pitch;
+	Pixel_Rect* rects = frame->rects.rects;
+	int count = frame->rects.count;
+	if (!gl->current) {
+		wglMakeCurrent(gl->dc, gl->context);
+		if (gl->wglSwapIntervalEXT) gl->wglSwapIntervalEXT(gl->vsync ? 1 : 0);
+		gl->current = true;
+	}
+	if (width != gl->texture_width || height != gl->texture_height || pitch != gl->texture_pitch) gl_resize(gl, width, height, pitch);
+
+	glBindTexture(GL_TEXTURE_2D, gl->texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
+
+	if (gl->pbo) {
+		// Wait until the GPU is done with the uploads that last used this region.
+		GLsync* fence = &gl->fences[gl->region];
+		if (*fence) {
+			gl->glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, ~0ull);
+			gl->glDeleteSync(*fence);
+			*fence = 0;
+		}
+
+		// Same layout as the framebuffer, so a rect keeps its offset.
+		s64 region_offset = gl->region * gl->region_size;
+		u8* region = gl->pbo_memory + region_offset;
+		gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo);
+		for (int i = 0; i < count; i++) {
+			Pixel_Rect r = rects[i];
+			for (int y = r.y0; y < r.y1; y++) {
+				s64 offset = ((s64)y * pitch + r.x0) * sizeof(u32);
+				memcpy(region + offset, (u8*)memory + offset, (r.x1 - r.x0) * sizeof(u32));
+			}
+			s64 offset = ((s64)r.y0 * pitch + r.x0) * sizeof(u32);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, GL_BGRA, GL_UNSIGNED_BYTE, (void*)(size_t)(region_offset + offset));
+		}
+		gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		*fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		gl->region = (gl->region + 1) % GL_UPLOAD_REGIONS;
+	} else {
+		for (int i = 0; i < count; i++) {
+			Pixel_Rect r = rects[i];
+			u32* pixels = (u32*)memory + (s64)r.y0 * pitch + r.x0;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+		}
+	}
+
+	// The swap shows the whole back buffer, so the whole texture is drawn.
+	Pixel_Rect v = frame->viewport;
+	glViewport(0, 0, frame->window_width, frame->window_height);
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glViewport(v.x0, v.y0, v.x1 - v.x0, v.y1 - v.y0);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glEnable(GL_TEXTURE_2D);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0, 0); glVertex2f(-1, -1);
+	glTexCoord2f(1, 0); glVertex2f(1, -1);
+	glTexCoord2f(1, 1); glVertex2f(1, 1);
+	glTexCoord2f(0, 1); glVertex2f(-1, 1);
+	glEnd();
+
+	SwapBuffers(gl->dc);
+}
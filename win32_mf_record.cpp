@@ -0,0 +1,116 @@
+// Media Foundation sink for video_record.cpp: H.264 in an .mp4 through the
+// sink writer, NV12 in. With hardware transforms enabled the sink writer picks
+// the GPU's encoder (NVENC, Quick Sync, AMF all show up as MFTs) and falls back
+// to the software one. Everything here runs on the recorder thread.
+
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+#pragma comment(lib, "ole32.lib")
+
+#define MF_RECORD_BITS_PER_PIXEL 4 // Per second at 60 fps: 1080p comes out at about 8 Mbit
+
+struct Win32_MF_Sink {
+	IMFSinkWriter* writer;
+	DWORD stream;
+	DWORD size; // Bytes per frame
+	LONGLONG duration; // 100 ns units
+};
+
+internal bool
+mf_write(void* data, u8* planes, double time) {
+	Win32_MF_Sink* sink = (Win32_MF_Sink*)data;
+	IMFMediaBuffer* buffer = 0;
+	IMFSample* sample = 0;
+	bool result = false;
+
+	BYTE* memory;
+	if (SUCCEEDED(MFCreateMemoryBuffer(sink->size, &buffer)) && SUCCEEDED(buffer->Lock(&memory, 0, 0))) {
+		memcpy(memory, planes, sink->size);
+		buffer->Unlock();
+		buffer->SetCurrentLength(sink->size);
+		result = SUCCEEDED(MFCreateSample(&sample)) &&
+			SUCCEEDED(sample->AddBuffer(buffer)) &&
+			SUCCEEDED(sample->SetSampleTime((LONGLONG)(time * 10000000))) &&
+			SUCCEEDED(sample->SetSampleDuration(sink->duration)) &&
+			SUCCEEDED(sink->writer->WriteSample(sink->stream, sample));
+	}
+	if (sample) sample->Release();
+	if (buffer) buffer->Release();
+	return result;
+}
+
+internal void
+mf_close(void* data) {
+	Win32_MF_Sink* sink = (Win32_MF_Sink*)data;
+	sink->writer->Finalize();
+	sink->writer->Release();
+	free(sink);
+	MFShutdown();
+	CoUninitialize();
+}
+
+internal bool
+mf_set_video_type(IMFMediaType* type, const GUID& subtype, int width, int height, int fps) {
+	return SUCCEEDED(type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video)) &&
+		SUCCEEDED(type->SetGUID(MF_MT_SUBTYPE, subtype)) &&
+		SUCCEEDED(type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive)) &&
+		SUCCEEDED(MFSetAttributeSize(type, MF_MT_FRAME_SIZE, width, height)) &&
+		SUCCEEDED(MFSetAttributeRatio(type, MF_MT_FRAME_RATE, fps, 1)) &&
+		SUCCEEDED(MFSetAttributeRatio(type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
+}
+
+internal bool
+open_mf_sink(Video_Sink* sink, const char* path, int width, int height, int fps) {
+	if (FAILED(CoInitializeEx(0, COINIT_MULTITHREADED))) return false;
+	if (FAILED(MFStartup(MF_VERSION))) {
+		CoUninitialize();
+		return false;
+	}
+
+	wchar_t wide_path[MAX_PATH];
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, wide_path, MAX_PATH);
+
+	IMFAttributes* attributes = 0;
+	IMFSinkWriter* writer = 0;
+	IMFMediaType* output = 0;
+	IMFMediaType* input = 0;
+	DWORD stream = 0;
+	bool ok = SUCCEEDED(MFCreateAttributes(&attributes, 1)) &&
+		SUCCEEDED(attributes->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE)) &&
+		SUCCEEDED(MFCreateSinkWriterFromURL(wide_path, 0, attributes, &writer)) &&
+		SUCCEEDED(MFCreateMediaType(&output)) &&
+		mf_set_video_type(output, MFVideoFormat_H264, width, height, fps) &&
+		SUCCEEDED(output->SetUINT32(MF_MT_AVG_BITRATE, (UINT32)((u64)width * height * MF_RECORD_BITS_PER_PIXEL))) &&
+		SUCCEEDED(writer->AddStream(output, &stream)) &&
+		SUCCEEDED(MFCreateMediaType(&input)) &&
+		mf_set_video_type(input, MFVideoFormat_NV12, width, height, fps) &&
+		SUCCEEDED(input->SetUINT32(MF_MT_DEFAULT_STRIDE, width)) &&
+		SUCCEEDED(writer->SetInputMediaType(stream, input, 0)) &&
+		SUCCEEDED(writer->BeginWriting());
+
+	if (input) input->Release();
+	if (output) output->Release();
+	if (attributes) attributes->Release();
+	if (!ok) {
+		if (writer) writer->Release();
+		MFShutdown();
+		CoUninitialize();
+		return false;
+	}
+
+	Win32_MF_Sink* mf = (Win32_MF_Sink*)malloc(sizeof(Win32_MF_Sink));
+	mf->writer = writer;
+	mf->stream = stream;
+	mf->size = (DWORD)((size_t)width * height * 3 / 2);
+	mf->duration = 10000000 / fps;
+	sink->chroma_step = 2;
+	sink->data = mf;
+	sink->write = mf_write;
+	sink->close = mf_close;
+	return true;
+}
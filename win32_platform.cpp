@@ -1,37 +1,123 @@
-typedef char s8;
-typedef unsigned char u8;
-typedef short s16;
-typedef unsigned short u16;
-typedef int s32;
-typedef unsigned int u32;
-typedef long long s64;
-typedef unsigned long long u64;
-
-#define global_variable static
-#define internal static
-
-inline int
-clamp(int min, int val, int max) {
-	if (val < min) return min;
-	if (val > max) return max;
-	return val;
-}
+#include "utilis.cpp"
 
+#include <winsock2.h> // Before windows.h, for win32_udp.cpp
 #include <windows.h>
+#include <string.h>
 
 global_variable bool running = true;
-struct Render_State {
-	int height, width;
-	void* memory;
-
-	BITMAPINFO bitmap_info;
+// BITMAPINFO only has room for one of the three BI_BITFIELDS masks RGB565 needs
+struct Win32_Bitmap_Info {
+	BITMAPINFOHEADER bmiHeader;
+	DWORD masks[3];
 };
-
-global_variable Render_State render_state;
+global_variable Win32_Bitmap_Info bitmap_info;
 
 #include "platform_common.cpp"
+#include "profiler.cpp"
+#include "input_events.cpp"
+#include "span_fill.cpp"
+#include "dirty_rects.cpp"
+#include "work_pool.cpp"
+#include "frame_buffers.cpp"
+#include "frame_export.cpp"
+#include "yuv_convert.cpp"
+#include "video_record.cpp"
+#include "win32_frame_memory.cpp"
+#include "win32_frame_export.cpp"
+#include "win32_mf_record.cpp"
+#include "win32_gl_present.cpp"
+#include "win32_frame_pacer.cpp"
+#include "win32_raw_input.cpp"
+#include "win32_udp.cpp"
+#include "pixel_kernels.cpp"
 #include "renderer.cpp"
-#include "game.cpp"
+#include "glyph_atlas.cpp"
+#include "render_commands.cpp"
+#include "render_tiles.cpp"
+#include "score_widget.cpp"
+#include "profiler_overlay.cpp"
+#include "simulation.cpp"
+#include "match_batch.cpp"
+#include "ai_opponent.cpp"
+#include "effects.cpp"
+#include "gamemovement.cpp"
+#include "replay.cpp"
+#include "net_rollback.cpp"
+#include "game_loop.cpp"
+
+// Set from the command line: -res 480 renders 480 pixel rows and scales them up
+// to the window, -stretch fills the window instead of scaling by whole pixels.
+global_variable int render_height;
+global_variable Upscale_Mode upscale_mode = UPSCALE_INTEGER;
+
+// Set when the window loses focus; the keys held then never see their release.
+global_variable bool focus_lost;
+
+// The DIB is bottom-up, so the source y counts from the bottom row while the
+// destination y counts from the top. Rect edges are scaled one by one, so
+// neighbouring rects meet on the same window pixel.
+internal void
+win32_present(void* memory, Present_Frame* frame, void* context) {
+	static HDC hdc = GetDC((HWND)context);
+	Pixel_Rect v = frame->viewport;
+	int vw = v.x1 - v.x0, vh = v.y1 - v.y0;
+	bool scaled = vw != frame->width || vh != frame->height;
+	if (scaled) SetStretchBltMode(hdc, COLORONCOLOR);
+
+	if (frame->full_redraw && (vw != frame->window_width || vh != frame->window_height)) {
+		int top = frame->window_height - v.y1;
+		PatBlt(hdc, 0, 0, frame->window_width, top, BLACKNESS);
+		PatBlt(hdc, 0, frame->window_height - v.y0, frame->window_width, v.y0, BLACKNESS);
+		PatBlt(hdc, 0, top, v.x0, vh, BLACKNESS);
+		PatBlt(hdc, v.x1, top, frame->window_width - v.x1, vh, BLACKNESS);
+	}
+
+	for (int i = 0; i < frame->rects.count; i++) {
+		Pixel_Rect r = frame->rects.rects[i];
+		int w = r.x1 - r.x0;
+		int h = r.y1 - r.y0;
+		Pixel_Rect d = r;
+		if (scaled) {
+			d.x0 = v.x0 + (int)((s64)r.x0 * vw / frame->width);
+			d.x1 = v.x0 + (int)((s64)r.x1 * vw / frame->width);
+			d.y0 = v.y0 + (int)((s64)r.y0 * vh / frame->height);
+			d.y1 = v.y0 + (int)((s64)r.y1 * vh / frame->height);
+		}
+		StretchDIBits(hdc, d.x0, frame->window_height - d.y1, d.x1 - d.x0, d.y1 - d.y0, r.x0, r.y0, w, h, memory, (BITMAPINFO*)&bitmap_info, DIB_RGB_COLORS, SRCCOPY);
+	}
+}
+
+internal void
+win32_resize_frame_buffers(HWND hwnd) {
+	RECT rect;
+	GetClientRect(hwnd, &rect);
+
+	// The present thread may still be reading the old buffers.
+	frame_buffers_drain();
+	frame_buffers_layout(rect.right - rect.left, rect.bottom - rect.top, render_height, upscale_mode);
+
+	size_t size = (size_t)render_state.pitch * render_state.height * sizeof(unsigned int);
+	if (!win32_frame_memory_fit(size)) {
+		// Out of address space. Nothing gets drawn while the loop winds down.
+		render_state.width = render_state.height = 0;
+		running = false;
+	}
+
+	// The DIB is pitch pixels wide; present only ever reads the first width of them.
+	bitmap_info.bmiHeader.biSize = sizeof(bitmap_info.bmiHeader);
+	bitmap_info.bmiHeader.biWidth = render_state.pitch;
+	bitmap_info.bmiHeader.biHeight = render_state.height;
+	bitmap_info.bmiHeader.biPlanes = 1;
+	bitmap_info.bmiHeader.biBitCount = render_state.format == PIXEL_RGB565 ? 16 : 32;
+	bitmap_info.bmiHeader.biCompression = render_state.format == PIXEL_RGB565 ? BI_BITFIELDS : BI_RGB;
+	bitmap_info.masks[0] = 0xf800;
+	bitmap_info.masks[1] = 0x07e0;
+	bitmap_info.masks[2] = 0x001f;
+
+	frame_buffers_resized();
+	rebuild_viewport_transform();
+	rebuild_glyph_atlas();
+}
 
 LRESULT CALLBACK window_callback(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 	LRESULT result = 0;
@@ -43,23 +129,20 @@ LRESULT CALLBACK window_callback(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
 		} break;
 
 		case WM_SIZE: {
-			RECT rect;
-			GetClientRect(hwnd, &rect);
-			render_state.width = rect.right - rect.left;
-			render_state.height = rect.bottom - rect.top;
-
-			int size = render_state.width * render_state.height * sizeof(unsigned int);
-
-			if (render_state.memory) VirtualFree(render_state.memory, 0, MEM_RELEASE);
-			render_state.memory = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			// The first WM_SIZE arrives during CreateWindow, before the buffers exist.
+			if (frame_buffers.count) win32_resize_frame_buffers(hwnd);
+		} break;
 
-			render_state.bitmap_info.bmiHeader.biSize = sizeof(render_state.bitmap_info.bmiHeader);
-			render_state.bitmap_info.bmiHeader.biWidth = render_state.width;
-			render_state.bitmap_info.bmiHeader.biHeight = render_state.height;
-			render_state.bitmap_info.bmiHeader.biPlanes = 1;
-			render_state.bitmap_info.bmiHeader.biBitCount = 32;
-			render_state.bitmap_info.bmiHeader.biCompression = BI_RGB;
+		case WM_ACTIVATEAPP: {
+			if (!wParam) focus_lost = true;
+		} break;
 
+		case WM_PAINT: {
+			// Parts of the window were uncovered, present the whole frame next time.
+			PAINTSTRUCT paint;
+			BeginPaint(hwnd, &paint);
+			EndPaint(hwnd, &paint);
+			invalidate_frame();
 		} break;
 
 		default: {
@@ -75,7 +158,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
 	// Create Window Class
 	WNDCLASS window_class = {};
-	window_class.style = CS_HREDRAW | CS_VREDRAW;
+	window_class.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
 	window_class.lpszClassName = "Game Window Class";
 	window_class.lpfnWndProc = window_callback;
 	
@@ -92,9 +175,105 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 		SetWindowPos(window, HWND_TOP, mi.rcMonitor.left, mi.rcMonitor.top, mi.rcMonitor.right - mi.rcMonitor.left, mi.rcMonitor.bottom - mi.rcMonitor.top, SWP_NOOWNERZORDER | SWP_FRAMECHANGED);
 	}
 	
-	HDC hdc = GetDC(window);
+	init_profiler();
+	init_span_fill();
+	// -deterministic keeps rasterization on the main thread, for frame tests
+	init_render_workers(0, strstr(lpCmdLine, "-deterministic") != 0);
+
+	// -buffers 1 presents on the main thread, 2 or 3 on a present thread
+	int buffer_count = 2;
+	if (const char* arg = strstr(lpCmdLine, "-buffers ")) buffer_count = atoi(arg + 9);
+	if (const char* arg = strstr(lpCmdLine, "-res ")) render_height = atoi(arg + 5);
+	if (strstr(lpCmdLine, "-stretch")) upscale_mode = UPSCALE_STRETCH;
+	// -rgb565 draws 16 bit frames (see pixel_kernels.cpp), which only GDI presents
+	if (strstr(lpCmdLine, "-rgb565")) render_state.format = PIXEL_RGB565;
+	// Presents through OpenGL unless -gdi is given or no accelerated context
+	// exists. -novsync stops the OpenGL present from waiting for the display.
+	Present_Rects* present = win32_present;
+	bool vsync = !strstr(lpCmdLine, "-novsync");
+	bool gdi = strstr(lpCmdLine, "-gdi") || render_state.format != PIXEL_XRGB8888;
+	if (!gdi && win32_gl_init(window, vsync)) present = win32_gl_present;
+	init_frame_buffers(buffer_count, present, window);
+	init_frame_memory(strstr(lpCmdLine, "-largepages") != 0);
+	win32_resize_frame_buffers(window);
+
+	// -export puts every presented frame in shared memory for encoders, see
+	// frame_export.cpp. -record FILE records them, H.264 into an .mp4 or raw
+	// into a .y4m (see video_record.cpp). Both take XRGB8888 frames only.
+	size_t export_slot_size = (size_t)frame_pitch(GetSystemMetrics(SM_CXVIRTUALSCREEN)) * GetSystemMetrics(SM_CYVIRTUALSCREEN) * sizeof(u32);
+	bool exportable = render_state.format == PIXEL_XRGB8888;
+	if (exportable && strstr(lpCmdLine, "-export")) win32_init_frame_export(export_slot_size);
+	if (const char* arg = exportable ? strstr(lpCmdLine, "-record ") : 0) {
+		char path[MAX_PATH];
+		if (sscanf(arg + 8, "%259s", path) == 1) {
+			size_t length = strlen(path);
+			bool y4m = length > 4 && !strcmp(path + length - 4, ".y4m");
+			init_video_recorder(path, y4m ? open_y4m_sink : open_mf_sink, export_slot_size);
+		}
+	}
+
+	// Frames are paced to -hz N, by default the display refresh rate unless
+	// vsync already does it; -hz 0 runs unlimited. -adaptive sleeps while the
+	// window is minimized and drops to -background_hz N (10 by default) while
+	// it is not in the foreground.
+	float target_hz = 0;
+	if (present != win32_gl_present || !vsync) {
+		HDC dc = GetDC(window);
+		target_hz = (float)GetDeviceCaps(dc, VREFRESH);
+		ReleaseDC(window, dc);
+		if (target_hz <= 1) target_hz = 60; // 0 and 1 mean the hardware default
+	}
+	if (const char* arg = strstr(lpCmdLine, "-hz ")) target_hz = (float)atof(arg + 4);
+	bool adaptive = strstr(lpCmdLine, "-adaptive") != 0;
+	float background_hz = 10;
+	if (const char* arg = strstr(lpCmdLine, "-background_hz ")) background_hz = (float)atof(arg + 15);
+	init_frame_pacer();
+	init_raw_input(window);
+
+	Game_Loop loop;
+	init_game_loop(&loop);
+	init_effects(MAX_PARTICLES);
+
+	// -ai LEVEL picks how the single player opponent plays (see ai_opponent.cpp)
+	if (const char* arg = strstr(lpCmdLine, "-ai ")) {
+		char name[16];
+		int level = sscanf(arg + 4, "%15s", name) == 1 ? find_ai_level(name) : -1;
+		if (level >= 0) loop.game.ai_level = (u8)level;
+	}
 
-	Input input = {};
+	// -save_replay FILE logs every tick's input, -replay FILE plays one back
+	// before handing over to the keyboard (see replay.cpp).
+	Replay_Writer replay_log = {};
+	Replay replay = {};
+	if (const char* arg = strstr(lpCmdLine, "-save_replay ")) {
+		char path[260];
+		if (sscanf(arg + 13, "%259s", path) == 1 && open_replay_writer(&replay_log, path)) loop.replay_log = &replay_log;
+	}
+	if (const char* arg = strstr(lpCmdLine, "-replay ")) {
+		char path[260];
+		if (sscanf(arg + 8, "%259s", path) == 1 && open_replay(&replay, path) && replay_seek(&replay, 0, &loop.game)) loop.replay = &replay;
+	}
+
+	// -host [PORT] waits for a second player, -join ADDRESS[:PORT] plays
+	// against one online, -delay N sets the host's input delay in ticks (see
+	// net_rollback.cpp). The online match is logged with -save_replay too.
+	Net_Session net = {};
+	if (const char* arg = strstr(lpCmdLine, "-host")) {
+		u16 port = NET_DEFAULT_PORT;
+		int delay = NET_DEFAULT_DELAY;
+		sscanf(arg + 5, "%hu", &port);
+		if (const char* delay_arg = strstr(lpCmdLine, "-delay ")) delay = atoi(delay_arg + 7);
+		if (net_host(&net, port, delay)) loop.net = &net;
+	} else if (const char* arg = strstr(lpCmdLine, "-join ")) {
+		char host_name[256];
+		u16 port = NET_DEFAULT_PORT;
+		if (sscanf(arg + 6, "%255[^: ]:%hu", host_name, &port) >= 1 && net_join(&net, host_name, port)) loop.net = &net;
+	}
+	if (loop.net) {
+		net.replay_log = loop.replay_log;
+		loop.replay_log = 0;
+		loop.replay = 0;
+	}
 
 	float delta_time = 0.016666f;
 	LARGE_INTEGER frame_begin_time;
@@ -108,57 +287,65 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 	}
 
 	while (running) {
+		if (adaptive && IsIconic(window)) {
+			// Nothing to show. The time spent here is left out of the next frame.
+			WaitMessage();
+			frame_pacer_reset();
+			QueryPerformanceCounter(&frame_begin_time);
+		}
+
 		// Input
 		MSG message;
 
-		for (int i = 0; i < BUTTON_COUNT; i++) {
-			input.buttons[i].changed = false;
-		}
-		// read message only once makanya di PM_remove
-		while (PeekMessage(&message, window, 0, 0, PM_REMOVE)) {
-
-			switch (message.message) {
-				case WM_KEYUP:
-				case WM_KEYDOWN: {
-					u32 vk_code = (u32)message.wParam;
-					bool is_down = ((message.lParam & (1 << 31)) == 0);
-					
-#define process_button(b, vk)\
-case vk: {\
-input.buttons[b].changed = is_down != input.buttons[b].is_down;\
-input.buttons[b].is_down = is_down;\
-} break;
-
-					switch (vk_code) {
-						process_button(BUTTON_UP, VK_UP);
-						process_button(BUTTON_DOWN, VK_DOWN);
-						process_button(BUTTON_W, 'W');
-						process_button(BUTTON_S, 'S');
-						process_button(BUTTON_LEFT, VK_LEFT);
-						process_button(BUTTON_RIGHT, VK_RIGHT);
-						process_button(BUTTON_ENTER, VK_RETURN);
-					}
-				} break;
+		{
+			PROFILE_SCOPE("INPUT");
+			// read message only once makanya di PM_remove
+			while (PeekMessage(&message, window, 0, 0, PM_REMOVE)) {
 
-				default: {
-					TranslateMessage(&message);
-					DispatchMessage(&message);
+				switch (message.message) {
+					case WM_KEYUP:
+					case WM_KEYDOWN: {
+						win32_key_event(&message);
+					} break;
+
+					default: {
+						TranslateMessage(&message);
+						DispatchMessage(&message);
+					}
 				}
+				
 			}
-			
 		}
+		// Before input_time, so without Raw Input the releases go to this frame's ticks
+		if (focus_lost) {
+			win32_release_all_input();
+			focus_lost = false;
+		}
+		double input_time = present_clock();
 
-		// Simulate
-
-		simulate_game(&input, delta_time);
+		game_loop_frame(&loop, delta_time, input_time);
 
-		// Render
-		StretchDIBits(hdc, 0, 0, render_state.width, render_state.height, 0, 0, render_state.width, render_state.height, render_state.memory, &render_state.bitmap_info, DIB_RGB_COLORS, SRCCOPY);
+		bool background = adaptive && GetForegroundWindow() != window;
+		frame_pacer_wait(background ? background_hz : target_hz);
 
 		LARGE_INTEGER frame_end_time;
 		QueryPerformanceCounter(&frame_end_time);
 		delta_time = (float)(frame_end_time.QuadPart - frame_begin_time.QuadPart) / performance_frequency;
 		frame_begin_time = frame_end_time;
+		profiler_end_frame(delta_time);
 	}
 
+	shutdown_raw_input();
+	if (loop.net) close_net_session(loop.net);
+	close_replay_writer(&replay_log);
+	close_replay(&replay);
+	shutdown_video_recorder();
+	shutdown_frame_pacer();
+	shutdown_frame_buffers();
+	win32_shutdown_frame_export();
+	close_local_frame_export();
+	shutdown_render_workers();
+
+	// -trace writes the last PROFILE_RING_EVENTS scopes of every thread as Chrome trace JSON
+	if (strstr(lpCmdLine, "-trace")) profiler_write_trace("trace.json");
 }
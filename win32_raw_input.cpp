@@ -0,0 +1,140 @@
+// Raw Input keyboard reader. A thread of its own owns a message-only window
+// that receives WM_INPUT, so every key event is timestamped when it arrives
+// instead of when the main loop gets around to its messages. Events go to
+// input_queue; this thread is its only producer while it runs. Keys only count
+// while the game window is in the foreground.
+// When Raw Input can't be registered the main loop feeds the queue from
+// WM_KEYDOWN/WM_KEYUP instead (see win32_key_event).
+
+#include <thread>
+
+#define RAW_INPUT_RELEASE_ALL (WM_APP + 1) // Posted to the thread on focus loss
+
+struct Win32_Raw_Input {
+	bool active;
+	HWND game_window;
+	HWND sink;
+	DWORD thread_id;
+	std::thread thread;
+};
+
+global_variable Win32_Raw_Input raw_input;
+
+internal int
+win32_button_for_key(u32 vk_code) {
+	switch (vk_code) {
+		case VK_UP: return BUTTON_UP;
+		case VK_DOWN: return BUTTON_DOWN;
+		case 'W': return BUTTON_W;
+		case 'S': return BUTTON_S;
+		case VK_LEFT: return BUTTON_LEFT;
+		case VK_RIGHT: return BUTTON_RIGHT;
+		case VK_RETURN: return BUTTON_ENTER;
+		case VK_F3: return BUTTON_F3;
+	}
+	return -1;
+}
+
+// Legacy key messages, for when there is no Raw Input. The message time only
+// has millisecond resolution and a different clock, so it is turned into an
+// age and subtracted from now.
+internal void
+win32_key_event(MSG* message) {
+	if (raw_input.active) return;
+	int button = win32_button_for_key((u32)message->wParam);
+	if (button < 0) return;
+
+	Input_Event event;
+	event.button = (u8)button;
+	event.is_down = (message->lParam & (1 << 31)) == 0;
+	LONG age = (LONG)(GetTickCount() - (DWORD)GetMessageTime());
+	event.time = present_clock() - (age > 0 && age < 1000 ? age / 1000. : 0.);
+	input_queue_push(&input_queue, event);
+}
+
+internal LRESULT CALLBACK
+raw_input_callback(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam) {
+	if (message != WM_INPUT) return DefWindowProc(hwnd, message, wParam, lParam);
+
+	double time = present_clock();
+	RAWINPUT raw;
+	UINT size = sizeof(raw);
+	if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) != (UINT)-1 &&
+		raw.header.dwType == RIM_TYPEKEYBOARD && GetForegroundWindow() == raw_input.game_window) {
+
+		int button = win32_button_for_key(raw.data.keyboard.VKey);
+		if (button >= 0) {
+			Input_Event event;
+			event.time = time;
+			event.button = (u8)button;
+			event.is_down = !(raw.data.keyboard.Flags & RI_KEY_BREAK);
+			input_queue_push(&input_queue, event);
+		}
+	}
+	return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+internal void
+raw_input_thread(HANDLE ready) {
+	profile_thread_name("INPUT");
+	raw_input.thread_id = GetCurrentThreadId();
+
+	WNDCLASS window_class = {};
+	window_class.lpszClassName = "Raw Input Sink";
+	window_class.lpfnWndProc = raw_input_callback;
+	RegisterClass(&window_class);
+	raw_input.sink = CreateWindow(window_class.lpszClassName, "", 0, 0, 0, 0, 0, HWND_MESSAGE, 0, 0, 0);
+
+	// INPUTSINK also delivers while another window has focus; that is filtered
+	// per event, so focus changes need no re-registration.
+	RAWINPUTDEVICE keyboard = {};
+	keyboard.usUsagePage = 0x01; // Generic desktop
+	keyboard.usUsage = 0x06; // Keyboard
+	keyboard.dwFlags = RIDEV_INPUTSINK;
+	keyboard.hwndTarget = raw_input.sink;
+	raw_input.active = raw_input.sink && RegisterRawInputDevices(&keyboard, 1, sizeof(keyboard));
+	SetEvent(ready);
+	if (!raw_input.active) {
+		if (raw_input.sink) DestroyWindow(raw_input.sink);
+		return;
+	}
+
+	MSG message;
+	while (GetMessage(&message, 0, 0, 0) > 0) {
+		if (!message.hwnd && message.message == RAW_INPUT_RELEASE_ALL) input_release_all(&input_queue, present_clock());
+		else DispatchMessage(&message);
+	}
+
+	keyboard.dwFlags = RIDEV_REMOVE;
+	keyboard.hwndTarget = 0;
+	RegisterRawInputDevices(&keyboard, 1, sizeof(keyboard));
+	DestroyWindow(raw_input.sink);
+}
+
+// Returns false when Raw Input isn't available; the legacy messages are used then.
+internal bool
+init_raw_input(HWND game_window) {
+	raw_input.game_window = game_window;
+	HANDLE ready = CreateEvent(0, TRUE, FALSE, 0);
+	raw_input.thread = std::thread(raw_input_thread, ready);
+	WaitForSingleObject(ready, INFINITE);
+	CloseHandle(ready);
+	if (!raw_input.active) raw_input.thread.join();
+	return raw_input.active;
+}
+
+// Focus loss, from the main loop. While the thread runs it is the queue's only
+// producer, so it queues the releases itself.
+internal void
+win32_release_all_input() {
+	if (raw_input.active) PostThreadMessage(raw_input.thread_id, RAW_INPUT_RELEASE_ALL, 0, 0);
+	else input_release_all(&input_queue, present_clock());
+}
+
+internal void
+shutdown_raw_input() {
+	if (!raw_input.active) return;
+	PostThreadMessage(raw_input.thread_id, WM_QUIT, 0, 0);
+	raw_input.thread.join();
+	raw_input.active = false;
+}
@@ -0,0 +1,124 @@
+// Non-blocking UDP sockets for net_rollback.cpp. winsock2.h has to come before
+// windows.h, which is why win32_platform.cpp includes it first.
+
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+struct Net_Socket {
+	SOCKET socket;
+};
+
+// Port 0 takes any free port.
+internal bool
+open_net_socket(Net_Socket* s, u16 port) {
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) return false;
+	s->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s->socket == INVALID_SOCKET) {
+		WSACleanup();
+		return false;
+	}
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	u_long non_blocking = 1;
+	if (bind(s->socket, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || ioctlsocket(s->socket, FIONBIO, &non_blocking) == SOCKET_ERROR) {
+		closesocket(s->socket);
+		s->socket = INVALID_SOCKET;
+		WSACleanup();
+		return false;
+	}
+	return true;
+}
+
+// For sockets that take bursts, like the server's.
+internal void
+net_socket_set_buffers(Net_Socket* s, int bytes) {
+	setsockopt(s->socket, SOL_SOCKET, SO_RCVBUF, (const char*)&bytes, sizeof(bytes));
+	setsockopt(s->socket, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+}
+
+internal void
+close_net_socket(Net_Socket* s) {
+	if (s->socket == INVALID_SOCKET) return;
+	closesocket(s->socket);
+	s->socket = INVALID_SOCKET;
+	WSACleanup();
+}
+
+internal void
+net_socket_send(Net_Socket* s, Net_Address to, void* data, int size) {
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(to.ip);
+	address.sin_port = htons(to.port);
+	sendto(s->socket, (const char*)data, size, 0, (sockaddr*)&address, sizeof(address));
+}
+
+// Bytes of the next datagram, or -1 when none is waiting.
+internal int
+net_socket_receive(Net_Socket* s, Net_Address* from, void* buffer, int size) {
+	sockaddr_in address;
+	for (;;) {
+		int length = sizeof(address);
+		int result = recvfrom(s->socket, (char*)buffer, size, 0, (sockaddr*)&address, &length);
+		// An ICMP port unreachable from an earlier send shows up here; it says nothing about this datagram
+		if (result == SOCKET_ERROR && WSAGetLastError() == WSAECONNRESET) continue;
+		if (result == SOCKET_ERROR) return -1;
+		from->ip = ntohl(address.sin_addr.s_addr);
+		from->port = ntohs(address.sin_port);
+		return result;
+	}
+}
+
+internal bool
+net_resolve(const char* name, u16 port, Net_Address* result) {
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) return false;
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* info;
+	bool found = getaddrinfo(name, 0, &hints, &info) == 0;
+	if (found) {
+		result->ip = ntohl(((sockaddr_in*)info->ai_addr)->sin_addr.s_addr);
+		result->port = port;
+		freeaddrinfo(info);
+	}
+	WSACleanup();
+	return found;
+}
+
+// A datagram for the batch calls. data has room for size bytes; a receive
+// sets size to what arrived.
+struct Net_Datagram {
+	Net_Address address;
+	int size;
+	u8* data;
+};
+
+#define NET_BATCH 64 // What callers size their batches by, like linux_udp.cpp's
+
+// Winsock has no sendmmsg. Registered I/O could batch these but needs
+// registered buffers and completion queues, and the server runs on Linux, so
+// here it is one call per datagram.
+internal int
+net_socket_send_batch(Net_Socket* s, Net_Datagram* datagrams, int count) {
+	for (int i = 0; i < count; i++) net_socket_send(s, datagrams[i].address, datagrams[i].data, datagrams[i].size);
+	return count;
+}
+
+internal int
+net_socket_receive_batch(Net_Socket* s, Net_Datagram* datagrams, int count) {
+	int received = 0;
+	while (received < count) {
+		Net_Datagram* d = &datagrams[received];
+		int size = net_socket_receive(s, &d->address, d->data, d->size);
+		if (size < 0) break;
+		d->size = size;
+		received++;
+	}
+	return received;
+}
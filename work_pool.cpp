@@ -0,0 +1,166 @@
+// Persistent worker pool with work stealing. work_pool_run splits [0, count)
+// into one contiguous range per worker; a worker takes items from the front of
+// its own range and steals from the back of the others once it runs dry.
+// The calling thread works as worker 0, nothing is created per run.
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define MAX_WORKERS 32
+
+typedef void Work_Job(int index, int worker, void* data);
+
+struct alignas(64) Work_Range {
+	std::atomic<u64> range; // head in the low 32 bits, tail in the high 32
+};
+
+struct Work_Pool {
+	int worker_count; // Including the calling thread
+	bool deterministic; // Run every item in order on the calling thread
+	std::thread threads[MAX_WORKERS];
+	Work_Range ranges[MAX_WORKERS];
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	u64 generation;
+	int busy;
+	bool quit;
+
+	Work_Job* job;
+	void* data;
+};
+
+internal u64
+pack_range(u32 head, u32 tail) {
+	return ((u64)tail << 32) | head;
+}
+
+internal bool
+take_front(Work_Range* r, int* index) {
+	u64 range = r->range.load(std::memory_order_relaxed);
+	for (;;) {
+		u32 head = (u32)range, tail = (u32)(range >> 32);
+		if (head >= tail) return false;
+		if (r->range.compare_exchange_weak(range, pack_range(head + 1, tail), std::memory_order_acquire)) {
+			*index = (int)head;
+			return true;
+		}
+	}
+}
+
+internal bool
+take_back(Work_Range* r, int* index) {
+	u64 range = r->range.load(std::memory_order_relaxed);
+	for (;;) {
+		u32 head = (u32)range, tail = (u32)(range >> 32);
+		if (head >= tail) return false;
+		if (r->range.compare_exchange_weak(range, pack_range(head, tail - 1), std::memory_order_acquire)) {
+			*index = (int)tail - 1;
+			return true;
+		}
+	}
+}
+
+internal void
+work_pool_drain(Work_Pool* pool, int worker) {
+	PROFILE_SCOPE("WORK");
+	int index;
+	for (;;) {
+		while (take_front(&pool->ranges[worker], &index)) pool->job(index, worker, pool->data);
+
+		bool stole = false;
+		for (int i = 1; i < pool->worker_count; i++) {
+			int victim = (worker + i) % pool->worker_count;
+			if (take_back(&pool->ranges[victim], &index)) {
+				pool->job(index, worker, pool->data);
+				stole = true;
+				break;
+			}
+		}
+		if (!stole) return;
+	}
+}
+
+internal void
+work_pool_worker(Work_Pool* pool, int worker) {
+	profile_thread_name("WORKER");
+	u64 seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(pool->mutex);
+			pool->wake.wait(lock, [&] { return pool->quit || pool->generation != seen; });
+			if (pool->quit) return;
+			seen = pool->generation;
+			pool->busy++;
+		}
+
+		work_pool_drain(pool, worker);
+
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			if (--pool->busy == 0) pool->done.notify_all();
+		}
+	}
+}
+
+// worker_count 0 picks one worker per hardware thread.
+internal void
+work_pool_start(Work_Pool* pool, int worker_count) {
+	if (worker_count <= 0) worker_count = (int)std::thread::hardware_concurrency();
+	if (worker_count < 1) worker_count = 1;
+	if (worker_count > MAX_WORKERS) worker_count = MAX_WORKERS;
+
+	pool->worker_count = worker_count;
+	for (int i = 1; i < worker_count; i++) {
+		pool->threads[i] = std::thread(work_pool_worker, pool, i);
+	}
+}
+
+internal void
+work_pool_stop(Work_Pool* pool) {
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		pool->quit = true;
+	}
+	pool->wake.notify_all();
+	for (int i = 1; i < pool->worker_count; i++) pool->threads[i].join();
+	pool->worker_count = 0;
+	pool->quit = false;
+}
+
+// Calls job once for every index in [0, count) and returns when all of them are done.
+internal void
+work_pool_run(Work_Pool* pool, int count, Work_Job* job, void* data) {
+	if (pool->deterministic || pool->worker_count <= 1 || count <= 1) {
+		for (int i = 0; i < count; i++) job(i, 0, data);
+		return;
+	}
+
+	int workers = pool->worker_count;
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		// A worker that woke for the last run can still be draining, outside
+		// the lock. job and data go first and every range is released after
+		// them, so whatever index it takes comes with this run's job. It's
+		// counted in busy, so this run waits for it.
+		pool->job = job;
+		pool->data = data;
+		for (int i = 0; i < workers; i++) {
+			u32 head = (u32)((s64)count * i / workers);
+			u32 tail = (u32)((s64)count * (i + 1) / workers);
+			pool->ranges[i].range.store(pack_range(head, tail), std::memory_order_release);
+		}
+		pool->generation++;
+		pool->busy++;
+	}
+	pool->wake.notify_all();
+
+	work_pool_drain(pool, 0);
+
+	std::unique_lock<std::mutex> lock(pool->mutex);
+	pool->busy--;
+	pool->done.wait(lock, [&] { return pool->busy == 0; });
+}
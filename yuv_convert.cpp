@@ -0,0 +1,108 @@
+// 0x00RRGGBB frames to 8 bit 4:2:0 YUV for video encoders, BT.601 limited
+// range. Chroma is the average of each 2x2 block. The frame is bottom row
+// first, the output top row first. Chroma goes to u and v every chroma_step
+// bytes: 1 for planar I420, 2 with v = u + 1 for NV12.
+// SSE2 does 8 pixels of two rows at a time; the coefficients are the usual
+// 8 bit fixed point ones, so the scalar tail gives the same bytes.
+
+#include <emmintrin.h>
+
+internal void
+rgb_to_yuv_scalar(u32* row_0, u32* row_1, int x0, int x1, u8* y_0, u8* y_1, u8* u, u8* v, int chroma_step) {
+	for (int x = x0; x < x1; x += 2) {
+		int r = 0, g = 0, b = 0;
+		u32 pixels[4] = { row_0[x], row_0[x + 1], row_1[x], row_1[x + 1] };
+		for (int i = 0; i < 4; i++) {
+			int pr = (pixels[i] >> 16) & 0xff, pg = (pixels[i] >> 8) & 0xff, pb = pixels[i] & 0xff;
+			u8 luma = (u8)(((66 * pr + 129 * pg + 25 * pb + 128) >> 8) + 16);
+			if (i < 2) y_0[x + i] = luma;
+			else y_1[x + i - 2] = luma;
+			r += pr;
+			g += pg;
+			b += pb;
+		}
+		int c = x / 2 * chroma_step;
+		u[c] = (u8)(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+		v[c] = (u8)(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+	}
+}
+
+// Sums of the B G R X pairs of madd results, for the 4 pixels (or 2x2 blocks) in a and b.
+internal __m128i
+yuv_hadd(__m128i a, __m128i b) {
+	__m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+	return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+// 8 pixels of luma from two times 4.
+internal __m128i
+yuv_luma(__m128i p0, __m128i p1) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i coefficients = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+	__m128i round = _mm_set1_epi32(128);
+	__m128i a = yuv_hadd(_mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), coefficients), _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), coefficients));
+	__m128i b = yuv_hadd(_mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), coefficients), _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), coefficients));
+	a = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(a, round), 8), _mm_set1_epi32(16));
+	b = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(b, round), 8), _mm_set1_epi32(16));
+	__m128i words = _mm_packs_epi32(a, b);
+	return _mm_packus_epi16(words, words);
+}
+
+// Channel sums of two 2x2 blocks, as 16 bit B G R X B G R X.
+internal __m128i
+yuv_block_sums(__m128i top, __m128i bottom) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+	lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+	hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+// 4 chroma bytes from the sums of four 2x2 blocks.
+internal __m128i
+yuv_chroma(__m128i s0, __m128i s1, __m128i coefficients) {
+	__m128i c = yuv_hadd(_mm_madd_epi16(s0, coefficients), _mm_madd_epi16(s1, coefficients));
+	c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(512)), 10), _mm_set1_epi32(128));
+	__m128i words = _mm_packs_epi32(c, c);
+	return _mm_packus_epi16(words, words);
+}
+
+// width and height are even and at most the frame's.
+internal void
+rgb_to_yuv420(u32* frame, int pitch, int frame_height, int width, int height,
+	u8* y_plane, int y_stride, u8* u, u8* v, int chroma_stride, int chroma_step) {
+	__m128i u_coefficients = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+	__m128i v_coefficients = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+
+	for (int y = 0; y < height; y += 2) {
+		u32* row_0 = frame + (s64)(frame_height - 1 - y) * pitch;
+		u32* row_1 = row_0 - pitch;
+		u8* y_0 = y_plane + (s64)y * y_stride;
+		u8* y_1 = y_0 + y_stride;
+		u8* u_row = u + (s64)(y / 2) * chroma_stride;
+		u8* v_row = v + (s64)(y / 2) * chroma_stride;
+
+		int x = 0;
+		for (; x + 8 <= width; x += 8) {
+			__m128i a0 = _mm_loadu_si128((__m128i*)(row_0 + x));
+			__m128i a1 = _mm_loadu_si128((__m128i*)(row_0 + x + 4));
+			__m128i b0 = _mm_loadu_si128((__m128i*)(row_1 + x));
+			__m128i b1 = _mm_loadu_si128((__m128i*)(row_1 + x + 4));
+			_mm_storel_epi64((__m128i*)(y_0 + x), yuv_luma(a0, a1));
+			_mm_storel_epi64((__m128i*)(y_1 + x), yuv_luma(b0, b1));
+
+			__m128i s0 = yuv_block_sums(a0, b0), s1 = yuv_block_sums(a1, b1);
+			__m128i cu = yuv_chroma(s0, s1, u_coefficients);
+			__m128i cv = yuv_chroma(s0, s1, v_coefficients);
+			if (chroma_step == 2) {
+				_mm_storel_epi64((__m128i*)(u_row + x), _mm_unpacklo_epi8(cu, cv));
+			} else {
+				*(int*)(u_row + x / 2) = _mm_cvtsi128_si32(cu);
+				*(int*)(v_row + x / 2) = _mm_cvtsi128_si32(cv);
+			}
+		}
+		rgb_to_yuv_scalar(row_0, row_1, x, width, y_0, y_1, u_row, v_row, chroma_step);
+	}
+}